@@ -0,0 +1,120 @@
+// capture.cpp
+//
+// See capture.h. Records are encoded under a lock into an in-memory buffer that is written
+// out in 64 KB chunks, so a capturing game pays for a memcpy per call rather than a write.
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <atomic>
+
+#include "capture.h"
+#include "config.h"
+#include "core/capture_format.h"
+#include "log.h"
+
+static const size_t kCaptureFlushSize = 64 * 1024;
+
+std::atomic<bool> g_captureActive(false);
+static std::atomic<unsigned short> g_nextCaptureDeviceId(0);
+
+static SRWLOCK g_captureLock = SRWLOCK_INIT;
+static CaptureEncoder* g_pCaptureEncoder = nullptr;
+static HANDLE g_hCaptureFile = INVALID_HANDLE_VALUE;
+static LARGE_INTEGER g_captureStart;
+static LARGE_INTEGER g_captureFrequency;
+
+static uint64_t GetCaptureTimeUs() {
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	uint64_t ticks = static_cast<uint64_t>(now.QuadPart - g_captureStart.QuadPart);
+	uint64_t frequency = static_cast<uint64_t>(g_captureFrequency.QuadPart);
+	return ticks / frequency * 1000000 + ticks % frequency * 1000000 / frequency;
+}
+
+// Called with g_captureLock held.
+static void FlushCaptureLocked() {
+	const std::vector<uint8_t>& buffer = g_pCaptureEncoder->GetBuffer();
+	if (!buffer.empty()) {
+		DWORD written = 0;
+		WriteFile(g_hCaptureFile, buffer.data(), static_cast<DWORD>(buffer.size()), &written, nullptr);
+		g_pCaptureEncoder->ClearBuffer();
+	}
+}
+
+void StartCapture() {
+	static std::atomic<bool> s_started(false);
+	if (s_started.exchange(true)) {
+		return;
+	}
+
+	char szPath[MAX_PATH];
+	{
+		ConfigReadGuard config;
+		if (config->captureFile[0] == '\0' || !ResolveModulePath(config->captureFile, szPath, MAX_PATH)) {
+			return;
+		}
+	}
+
+	HANDLE hFile = CreateFileA(szPath, GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE) {
+		Log("Could not create capture file: %s", szPath);
+		return;
+	}
+
+	AcquireSRWLockExclusive(&g_captureLock);
+	g_hCaptureFile = hFile;
+	g_pCaptureEncoder = new CaptureEncoder();
+	QueryPerformanceFrequency(&g_captureFrequency);
+	QueryPerformanceCounter(&g_captureStart);
+	ReleaseSRWLockExclusive(&g_captureLock);
+	g_captureActive.store(true, std::memory_order_release);
+	Log("Capturing raw device input to %s", szPath);
+}
+
+void StopCapture() {
+	if (!IsCaptureActive()) {
+		return;
+	}
+	// At process exit other threads are already gone, possibly while holding the lock. Losing
+	// their last partial chunk is better than hanging the exit.
+	if (!TryAcquireSRWLockExclusive(&g_captureLock)) {
+		return;
+	}
+	FlushCaptureLocked();
+	FlushFileBuffers(g_hCaptureFile);
+	ReleaseSRWLockExclusive(&g_captureLock);
+}
+
+unsigned short AllocateCaptureDeviceId() {
+	return g_nextCaptureDeviceId++;
+}
+
+void CaptureFormat(unsigned short device, const DiDataFormat* pFormat) {
+	AcquireSRWLockExclusive(&g_captureLock);
+	g_pCaptureEncoder->AddFormat(device, GetCaptureTimeUs(), pFormat);
+	ReleaseSRWLockExclusive(&g_captureLock);
+}
+
+void CaptureState(unsigned short device, HRESULT hr, DWORD cbData, const void* lpvData) {
+	AcquireSRWLockExclusive(&g_captureLock);
+	g_pCaptureEncoder->AddState(device, GetCaptureTimeUs(), hr, cbData, lpvData);
+	if (g_pCaptureEncoder->GetBuffer().size() >= kCaptureFlushSize) {
+		FlushCaptureLocked();
+	}
+	ReleaseSRWLockExclusive(&g_captureLock);
+}
+
+void CaptureEvents(unsigned short device, HRESULT hr, DWORD cbObjectData, const void* rgdod, DWORD count, DWORD dwFlags) {
+	AcquireSRWLockExclusive(&g_captureLock);
+	g_pCaptureEncoder->AddEvents(device, GetCaptureTimeUs(), hr, cbObjectData, rgdod, count, dwFlags);
+	if (g_pCaptureEncoder->GetBuffer().size() >= kCaptureFlushSize) {
+		FlushCaptureLocked();
+	}
+	ReleaseSRWLockExclusive(&g_captureLock);
+}
+
+void CaptureRanges(unsigned short device, const DiAxisRange* pRanges, DWORD count) {
+	AcquireSRWLockExclusive(&g_captureLock);
+	g_pCaptureEncoder->AddRanges(device, GetCaptureTimeUs(), pRanges, count);
+	ReleaseSRWLockExclusive(&g_captureLock);
+}
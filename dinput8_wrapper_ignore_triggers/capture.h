@@ -0,0 +1,36 @@
+// capture.h
+//
+// Capture mode: records what the real devices return, before any filtering, into the file
+// named by [capture] file in the config (format in core/capture_format.h), for replaying
+// through the filter offline with tools/filter_replay. Off unless configured.
+
+#pragma once
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <atomic>
+
+#include "core/dinput_types.h"
+
+// Opens the capture file if one is configured. Called once DirectInput is actually used, so
+// devices created afterwards see IsCaptureActive() from their first call.
+void StartCapture();
+
+// Writes out whatever is still buffered. Called from DLL_PROCESS_DETACH.
+void StopCapture();
+
+extern std::atomic<bool> g_captureActive;
+
+inline bool IsCaptureActive() {
+	return g_captureActive.load(std::memory_order_relaxed);
+}
+
+// Identifies a device wrapper in the capture.
+unsigned short AllocateCaptureDeviceId();
+
+void CaptureFormat(unsigned short device, const DiDataFormat* pFormat);
+void CaptureState(unsigned short device, HRESULT hr, DWORD cbData, const void* lpvData);
+void CaptureEvents(unsigned short device, HRESULT hr, DWORD cbObjectData, const void* rgdod, DWORD count, DWORD dwFlags);
+void CaptureRanges(unsigned short device, const DiAxisRange* pRanges, DWORD count);
@@ -0,0 +1,219 @@
+// config.cpp
+//
+// See config.h.
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <atomic>
+
+#include "config.h"
+#include "log.h"
+
+// --- Snapshot publication ---
+static EpochSnapshot<Config> g_config(&kDefaultConfig);
+std::atomic<unsigned long> g_configGeneration(0);
+static SRWLOCK g_configPublishLock = SRWLOCK_INIT;
+static void (*g_pfnReloadListener)();
+
+ConfigReadGuard::ConfigReadGuard() : m_guard(g_config) {
+}
+
+static void PublishConfig(Config* pNewConfig) {
+	AcquireSRWLockExclusive(&g_configPublishLock);
+	pNewConfig->generation = g_configGeneration.load() + 1;
+	const Config* pOldConfig = g_config.Publish(pNewConfig);
+	g_configGeneration.store(pNewConfig->generation, std::memory_order_release);
+	SetLogEnabledByConfig(pNewConfig->logEnabled);
+	ReleaseSRWLockExclusive(&g_configPublishLock);
+
+	if (pOldConfig != &kDefaultConfig) {
+		delete pOldConfig;
+	}
+}
+
+void SetConfigReloadListener(void (*pfnListener)()) {
+	g_pfnReloadListener = pfnListener;
+}
+
+// --- File loading ---
+static const size_t kMaxConfigFileSize = 1024 * 1024;
+
+static HMODULE g_hConfigModule;
+
+// The host executable, identified once at load time.
+static ProfileKey g_processKey;
+static char g_processName[MAX_PATH];
+
+static void IdentifyProcess() {
+	wchar_t szPath[MAX_PATH];
+	DWORD len = GetModuleFileNameW(nullptr, szPath, MAX_PATH);
+	if (len == 0 || len >= MAX_PATH) {
+		return;
+	}
+	const wchar_t* pName = wcsrchr(szPath, L'\\');
+	pName = pName ? pName + 1 : szPath;
+	int nameLen = WideCharToMultiByte(CP_UTF8, 0, pName, -1, g_processName, sizeof(g_processName), nullptr, nullptr);
+	if (nameLen <= 0) {
+		g_processName[0] = '\0';
+		return;
+	}
+	g_processKey.nameHash = HashProfileName(g_processName, static_cast<size_t>(nameLen - 1));
+
+	// The executable image is mapped and its headers are readable for the life of the process.
+	const BYTE* pImage = reinterpret_cast<const BYTE*>(GetModuleHandleW(nullptr));
+	const IMAGE_DOS_HEADER* pDosHeader = reinterpret_cast<const IMAGE_DOS_HEADER*>(pImage);
+	if (pDosHeader && pDosHeader->e_magic == IMAGE_DOS_SIGNATURE) {
+		const IMAGE_NT_HEADERS* pNtHeaders = reinterpret_cast<const IMAGE_NT_HEADERS*>(pImage + pDosHeader->e_lfanew);
+		if (pNtHeaders->Signature == IMAGE_NT_SIGNATURE) {
+			g_processKey.timestamp = pNtHeaders->FileHeader.TimeDateStamp;
+		}
+	}
+}
+
+static wchar_t g_configDir[MAX_PATH];
+static wchar_t g_configPath[MAX_PATH];
+// Last write time and size of the file as last loaded, to ignore unrelated directory changes.
+static FILETIME g_configWriteTime;
+static DWORD g_configFileSize;
+
+static bool GetConfigFileStamp(FILETIME* pWriteTime, DWORD* pSize) {
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesExW(g_configPath, GetFileExInfoStandard, &data)) {
+		return false;
+	}
+	*pWriteTime = data.ftLastWriteTime;
+	*pSize = data.nFileSizeLow;
+	return true;
+}
+
+// Maps the config file and parses it into a new snapshot. Returns nullptr if there is no file.
+static Config* ReadConfigFile() {
+	HANDLE hFile = CreateFileW(g_configPath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE) {
+		return nullptr;
+	}
+
+	Config* pConfig = new Config;
+	SetConfigDefaults(pConfig);
+
+	LARGE_INTEGER size;
+	if (GetFileSizeEx(hFile, &size) && size.QuadPart > 0 && static_cast<ULONGLONG>(size.QuadPart) <= kMaxConfigFileSize) {
+		HANDLE hMapping = CreateFileMappingW(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (hMapping) {
+			const void* pView = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+			if (pView) {
+				ParseConfig(static_cast<const char*>(pView), static_cast<size_t>(size.QuadPart), g_processKey, pConfig);
+				UnmapViewOfFile(pView);
+			}
+			CloseHandle(hMapping);
+		}
+	}
+	CloseHandle(hFile);
+	return pConfig;
+}
+
+void LoadConfig(HMODULE hThisModule) {
+	g_hConfigModule = hThisModule;
+	IdentifyProcess();
+
+	DWORD len = GetModuleFileNameW(hThisModule, g_configDir, MAX_PATH);
+	if (len == 0 || len >= MAX_PATH) {
+		return;
+	}
+	wchar_t* pSlash = wcsrchr(g_configDir, L'\\');
+	if (!pSlash) {
+		return;
+	}
+	pSlash[1] = L'\0';
+	if (wcscpy_s(g_configPath, g_configDir) != 0 || wcscat_s(g_configPath, L"dinput8-wrapper.ini") != 0) {
+		return;
+	}
+
+	GetConfigFileStamp(&g_configWriteTime, &g_configFileSize);
+	Config* pConfig = ReadConfigFile();
+	if (pConfig) {
+		PublishConfig(pConfig);
+		if (pConfig->profile[0]) {
+			Log("Config loaded from dinput8-wrapper.ini for %s, profile %s.", g_processName, pConfig->profile);
+		}
+		else {
+			Log("Config loaded from dinput8-wrapper.ini for %s, no profile.", g_processName);
+		}
+	}
+}
+
+bool ResolveModulePath(const char* path, char* szOut, DWORD cchOut) {
+	bool isAbsolute = (path[0] == '\\' || path[0] == '/' || (path[0] != '\0' && path[1] == ':'));
+	if (isAbsolute) {
+		return strcpy_s(szOut, cchOut, path) == 0;
+	}
+
+	DWORD dirLen = GetModuleFileNameA(g_hConfigModule, szOut, cchOut);
+	if (dirLen == 0 || dirLen >= cchOut) {
+		return false;
+	}
+	char* pSlash = strrchr(szOut, '\\');
+	if (!pSlash) {
+		return false;
+	}
+	pSlash[1] = '\0';
+	return strcat_s(szOut, cchOut, path) == 0;
+}
+
+static void ReloadConfigIfChanged() {
+	FILETIME writeTime = {};
+	DWORD size = 0;
+	bool exists = GetConfigFileStamp(&writeTime, &size);
+	if (exists && CompareFileTime(&writeTime, &g_configWriteTime) == 0 && size == g_configFileSize) {
+		return;
+	}
+	g_configWriteTime = writeTime;
+	g_configFileSize = size;
+
+	Config* pConfig = ReadConfigFile();
+	if (!pConfig) {
+		// File removed: fall back to the built-in behaviour.
+		pConfig = new Config;
+		SetConfigDefaults(pConfig);
+	}
+	PublishConfig(pConfig);
+	Log("Config reloaded (generation %lu).", pConfig->generation);
+	if (g_pfnReloadListener) {
+		g_pfnReloadListener();
+	}
+}
+
+static DWORD WINAPI ConfigWatcherThread(LPVOID) {
+	HANDLE hChange = FindFirstChangeNotificationW(g_configDir, FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE);
+	if (hChange == INVALID_HANDLE_VALUE) {
+		Log("Could not watch the config directory. Hot reload is disabled.");
+		return 0;
+	}
+	while (WaitForSingleObject(hChange, INFINITE) == WAIT_OBJECT_0) {
+		// Editors often save in several steps; let them finish before reading.
+		Sleep(200);
+		ReloadConfigIfChanged();
+		if (!FindNextChangeNotification(hChange)) {
+			break;
+		}
+	}
+	FindCloseChangeNotification(hChange);
+	return 0;
+}
+
+void StartConfigWatcher() {
+	static std::atomic<bool> s_started(false);
+	if (g_configDir[0] == L'\0' || s_started.exchange(true)) {
+		return;
+	}
+
+	// The thread never exits, so keep this DLL mapped for the life of the process.
+	HMODULE hSelf = nullptr;
+	GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_PIN, reinterpret_cast<LPCWSTR>(&ConfigWatcherThread), &hSelf);
+
+	HANDLE hThread = CreateThread(nullptr, 0, ConfigWatcherThread, nullptr, 0, nullptr);
+	if (hThread) {
+		SetThreadPriority(hThread, THREAD_PRIORITY_LOWEST);
+		CloseHandle(hThread);
+	}
+}
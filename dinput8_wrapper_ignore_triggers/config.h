@@ -0,0 +1,55 @@
+// config.h
+//
+// Runtime configuration, read from dinput8-wrapper.ini next to the DLL.
+// The file is parsed once into an immutable Config snapshot. A low-priority watcher thread
+// re-parses it when it changes and publishes the new snapshot with an atomic pointer swap.
+// Old snapshots are freed only once every reader that could still see them has finished
+// (epoch_snapshot.h), so readers on the GetDeviceState path never lock or allocate.
+//
+// The file format is described in core/config_parse.h.
+
+#pragma once
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <atomic>
+
+#include "core/config_parse.h"
+#include "epoch_snapshot.h"
+
+// Identifies the host executable, then reads the config file next to hThisModule and
+// publishes it. Called from DLL_PROCESS_ATTACH, so it only does file I/O.
+void LoadConfig(HMODULE hThisModule);
+
+// Resolves a path from the environment or the config file. Relative paths are taken relative
+// to the directory this wrapper was loaded from. Returns false if it does not fit.
+bool ResolveModulePath(const char* path, char* szOut, DWORD cchOut);
+
+// Starts the reload thread. Called once DirectInput is actually used.
+void StartConfigWatcher();
+
+// Called on the reload thread after each reload is published, so whatever is built from the
+// config can be rebuilt there rather than on a game thread. Set once, before the watcher starts.
+void SetConfigReloadListener(void (*pfnListener)());
+
+// Generation of the current snapshot. Lets hot paths notice a reload with one relaxed load
+// and only pin the snapshot when they need to rebuild something from it.
+extern std::atomic<unsigned long> g_configGeneration;
+
+inline unsigned long GetConfigGeneration() {
+	return g_configGeneration.load(std::memory_order_acquire);
+}
+
+// Pins the current snapshot for the guard's lifetime.
+class ConfigReadGuard {
+public:
+	ConfigReadGuard();
+
+	const Config& Get() const { return m_guard.Get(); }
+	const Config* operator->() const { return &m_guard.Get(); }
+
+private:
+	EpochSnapshot<Config>::ReadGuard m_guard;
+};
@@ -0,0 +1,121 @@
+// action_filter.cpp
+//
+// See action_filter.h.
+
+#include <cstring>
+
+#include "action_filter.h"
+
+static const uint32_t kMaxActions = kActionTableSize * 3 / 4;
+
+// Fibonacci hashing: app data is often small consecutive integers or aligned pointers, and the
+// top bits of the product spread both.
+static uint32_t HashAppData(uintptr_t appData) {
+	return static_cast<uint32_t>((static_cast<uint64_t>(appData) * 0x9E3779B97F4A7C15ull) >> 58);
+}
+
+static_assert(kActionTableSize == 64, "HashAppData yields 6 bits");
+static_assert(kAxisCount <= 8, "ActionTable::axes holds one bit per axis");
+
+// DIDFT_GETINSTANCE.
+static uint32_t GetObjectInstance(uint32_t objId) {
+	return (objId >> 8) & 0xFFFF;
+}
+
+void SetActionMapLayout(uint32_t dataSize, FormatLayout* pLayout) {
+	pLayout->known = true;
+	pLayout->dataSize = dataSize;
+	pLayout->presentMask = 0;
+	pLayout->povCount = 0;
+}
+
+static bool AddAction(ActionTable* pTable, uintptr_t appData, int axis) {
+	uint32_t slot = HashAppData(appData);
+	while (pTable->axes[slot] != 0 && pTable->appData[slot] != appData) {
+		slot = (slot + 1) & (kActionTableSize - 1);
+	}
+	if (pTable->axes[slot] == 0) {
+		if (pTable->count == kMaxActions) {
+			return false;
+		}
+		++pTable->count;
+		pTable->appData[slot] = appData;
+	}
+	pTable->axes[slot] |= static_cast<uint8_t>(1u << axis);
+	pTable->axisMask |= 1u << axis;
+	return true;
+}
+
+bool BuildActionTable(const ActionBinding* pBindings, uint32_t count, ActionTable* pTable) {
+	memset(pTable, 0, sizeof(*pTable));
+
+	// The two lowest slider instances the map uses.
+	uint32_t sliders[2] = { 0, 0 };
+	uint32_t sliderCount = 0;
+	for (uint32_t i = 0; i < count; ++i) {
+		if (!(pBindings[i].guidType == kDiGuidSlider)) continue;
+		uint32_t instance = GetObjectInstance(pBindings[i].objId);
+		if ((sliderCount > 0 && sliders[0] == instance) || (sliderCount > 1 && sliders[1] == instance)) continue;
+		if (sliderCount < 2) {
+			sliders[sliderCount++] = instance;
+		}
+		else if (instance < sliders[1]) {
+			sliders[1] = instance;
+		}
+		if (sliderCount == 2 && sliders[1] < sliders[0]) {
+			uint32_t lower = sliders[1];
+			sliders[1] = sliders[0];
+			sliders[0] = lower;
+		}
+	}
+
+	for (uint32_t i = 0; i < count; ++i) {
+		const ActionBinding& binding = pBindings[i];
+		int axis = FindAxisByGuid(binding.guidType);
+		if (axis < 0) continue;
+		if (axis == kAxisSlider0) {
+			uint32_t instance = GetObjectInstance(binding.objId);
+			if (instance == sliders[0]) {
+				axis = kAxisSlider0;
+			}
+			else if (sliderCount > 1 && instance == sliders[1]) {
+				axis = kAxisSlider1;
+			}
+			else {
+				continue;
+			}
+		}
+		if (!AddAction(pTable, binding.appData, axis)) {
+			memset(pTable, 0, sizeof(*pTable));
+			return false;
+		}
+	}
+	return true;
+}
+
+unsigned FindActionAxes(const ActionTable& table, uintptr_t appData) {
+	uint32_t slot = HashAppData(appData);
+	while (table.axes[slot] != 0) {
+		if (table.appData[slot] == appData) {
+			return table.axes[slot];
+		}
+		slot = (slot + 1) & (kActionTableSize - 1);
+	}
+	return 0;
+}
+
+uint32_t CompactActionEvents(const ActionTable& table, unsigned suppressMask, DiDeviceObjectData* rgdod, uint32_t count) {
+	if (!(table.axisMask & suppressMask)) {
+		return count;
+	}
+	uint32_t kept = 0;
+	for (uint32_t i = 0; i < count; ++i) {
+		unsigned axes = FindActionAxes(table, rgdod[i].uAppData);
+		if (axes != 0 && !(axes & ~suppressMask)) continue;
+		if (kept != i) {
+			rgdod[kept] = rgdod[i];
+		}
+		++kept;
+	}
+	return kept;
+}
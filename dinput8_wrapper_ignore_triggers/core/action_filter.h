@@ -0,0 +1,57 @@
+// action_filter.h
+//
+// Filtering for games that drive a device through action mapping (BuildActionMap and
+// SetActionMap) instead of a data format. Their buffered events name an action through
+// uAppData, the value the game gave the DIACTION, and dwOfs refers to a format DirectInput made
+// up, so the offset-based rules in a FilterPlan do not apply. An ActionTable is built once per
+// SetActionMap from the actions the device mapped to its axes; GetDeviceData then drops the
+// events of suppressed axes with one hash probe per event.
+//
+// Only suppression applies. Remaps and deadzones are defined on the game's axes, which an
+// action-mapped game does not have.
+
+#pragma once
+
+#include <cstdint>
+
+#include "dinput_types.h"
+#include "filter.h"
+
+// Power of two. A gamepad maps a handful of actions to its axes; the table refuses more than
+// three quarters of this.
+static const uint32_t kActionTableSize = 64;
+
+struct ActionTable {
+	uint32_t count;
+	// Bit (1 << AxisIndex) for every axis some action is bound to.
+	unsigned axisMask;
+	uintptr_t appData[kActionTableSize];
+	// The axes bound to the action in the same slot, or 0 for an empty slot.
+	uint8_t axes[kActionTableSize];
+};
+
+// The layout of an action-mapped device's state: known, but with no axes or POVs at offsets
+// the wrapper understands, so GetDeviceState passes through. dataSize is the action format's
+// dwDataSize.
+void SetActionMapLayout(uint32_t dataSize, FormatLayout* pLayout);
+
+// One DIACTION the device mapped to one of its objects. guidType and objId are the object's
+// DIDEVICEOBJECTINSTANCE guidType and dwType.
+struct ActionBinding {
+	uintptr_t appData;
+	DiGuid guidType;
+	uint32_t objId;
+};
+
+// Fills pTable from the bindings. Objects that are not position axes are ignored. Sliders,
+// which share one GUID, become slider0 and slider1 in instance order among the sliders the map
+// uses. Returns false, leaving the table empty, if there are too many actions to hold.
+bool BuildActionTable(const ActionBinding* pBindings, uint32_t count, ActionTable* pTable);
+
+// The axes bound to appData, or 0.
+unsigned FindActionAxes(const ActionTable& table, uintptr_t appData);
+
+// Rewrites a buffer of DiDeviceObjectData in place, dropping the events of actions whose axes
+// are all in suppressMask. An action bound to a suppressed axis and another axis is kept,
+// since its events do not say which object sent them. Returns the number of records kept.
+uint32_t CompactActionEvents(const ActionTable& table, unsigned suppressMask, DiDeviceObjectData* rgdod, uint32_t count);
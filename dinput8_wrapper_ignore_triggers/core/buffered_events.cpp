@@ -0,0 +1,34 @@
+// buffered_events.cpp
+//
+// See buffered_events.h.
+
+#include "buffered_events.h"
+
+void InitBufferedEventState(BufferedEventState* pState) {
+	ResetEventSequence(&pState->sequence);
+	pState->neutralCount = 0;
+	pState->actionMapActive = false;
+	memset(&pState->actionTable, 0, sizeof(pState->actionTable));
+}
+
+void QueueNeutralEvents(BufferedEventState* pState, bool clear, const uint32_t* pOffsets, const int32_t* pValues, uint32_t count) {
+	pState->lock.Lock();
+	if (clear) {
+		pState->neutralCount = 0;
+	}
+	if (pState->actionMapActive) {
+		count = 0;
+	}
+	for (uint32_t i = 0; i < count; ++i) {
+		uint32_t slot = 0;
+		while (slot < pState->neutralCount && pState->neutralOffsets[slot] != pOffsets[i]) {
+			++slot;
+		}
+		if (slot < kAxisCount) {
+			pState->neutralOffsets[slot] = pOffsets[i];
+			pState->neutralValues[slot] = pValues[i];
+			pState->neutralCount = (std::max)(pState->neutralCount, slot + 1);
+		}
+	}
+	pState->lock.Unlock();
+}
@@ -0,0 +1,162 @@
+// buffered_events.h
+//
+// The GetDeviceData path: fills the game's buffer with filtered events. Dropped events do not
+// count against the buffer: the space they leave is refilled from the device until the
+// game's buffer is full or the device's is empty. Neutral events owed for silenced axes go
+// first, and the batch is renumbered once anything has been dropped or synthesized
+// (event_sequence.h). The device wrapper runs it against the real device; the benchmark runs
+// the same code against a MockDevice.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <mutex>
+#endif
+
+#include "action_filter.h"
+#include "dinput_types.h"
+#include "event_sequence.h"
+#include "filter.h"
+
+// Serializes a device's buffered reads: an SRWLOCK in the DLL, a std::mutex elsewhere.
+class EventLock {
+public:
+	EventLock() = default;
+	EventLock(const EventLock&) = delete;
+	EventLock& operator=(const EventLock&) = delete;
+
+#ifdef _WIN32
+	void Lock() { AcquireSRWLockExclusive(&m_lock); }
+	void Unlock() { ReleaseSRWLockExclusive(&m_lock); }
+
+private:
+	SRWLOCK m_lock = SRWLOCK_INIT;
+#else
+	void Lock() { m_lock.lock(); }
+	void Unlock() { m_lock.unlock(); }
+
+private:
+	std::mutex m_lock;
+#endif
+};
+
+// A device's buffered-data state. lock guards every other member.
+struct BufferedEventState {
+	EventLock lock;
+	EventSequence sequence;
+	// Axes a config reload stopped delivering events for, owed one neutral event each.
+	uint32_t neutralOffsets[kAxisCount];
+	int32_t neutralValues[kAxisCount];
+	uint32_t neutralCount;
+	// Set from SetActionMap until the next SetDataFormat. Events are then filtered by
+	// actionTable instead of the plan's event rules.
+	bool actionMapActive;
+	ActionTable actionTable;
+};
+
+// Initializes a new state: an empty sequence, no owed events and no action map.
+void InitBufferedEventState(BufferedEventState* pState);
+
+// Owes the game one neutral event at each of pOffsets, replacing any already owed at the same
+// offset. clear drops everything owed first. Takes the lock. Action-mapped events are not
+// identified by offset, so nothing is owed while an action map is active.
+void QueueNeutralEvents(BufferedEventState* pState, bool clear, const uint32_t* pOffsets, const int32_t* pValues, uint32_t count);
+
+// Reads ReadFilteredEvents makes from the device to fill the game's buffer. Each read either
+// fills the game's buffer or empties the device's, so more are only needed when events
+// arrive while the wrapper is reading.
+static const unsigned kMaxEventReads = 8;
+
+// What a ReadFilteredEvents call did, for the caller's statistics.
+struct BufferedReadStats {
+	uint32_t eventsFiltered;
+	uint32_t refills;
+};
+
+// read(pBatch, &count) is one GetDeviceData on the device into pBatch with the caller's
+// record size and flags; count is the capacity in and the records read out. rgdod holds
+// *pdwInOut records of cbObjectData bytes, which must pass IsValidObjectDataSize; *pdwInOut
+// receives the number kept. nowMs times synthesized events when no device event follows.
+// Returns the first read's result, or kDiBufferOverflow if any read reported it.
+template <class Read>
+int32_t ReadFilteredEvents(BufferedEventState* pState, const FilterPlan& plan, uint32_t cbObjectData, void* rgdod, uint32_t* pdwInOut, bool peek, uint32_t nowMs, Read read, BufferedReadStats* pStats) {
+	uint8_t* pRecords = static_cast<uint8_t*>(rgdod);
+	uint32_t capacity = *pdwInOut;
+	pStats->eventsFiltered = 0;
+	pStats->refills = 0;
+	pState->lock.Lock();
+
+	uint32_t synthesized = (std::min)(pState->neutralCount, capacity);
+	for (uint32_t i = 0; i < synthesized; ++i) {
+		WriteSynthesizedEvent(pRecords + i * cbObjectData, cbObjectData, pState->neutralOffsets[i], static_cast<uint32_t>(pState->neutralValues[i]));
+	}
+
+	uint32_t kept = synthesized;
+	bool dropped = false;
+	int32_t hr = kDiOk;
+	for (unsigned readIndex = 0; ; ++readIndex) {
+		uint32_t requested = capacity - kept;
+		uint32_t count = requested;
+		uint8_t* pBatch = pRecords + kept * cbObjectData;
+		int32_t hrRead = read(pBatch, &count);
+		if (hrRead < 0) {
+			// Events already taken from the device's buffer are still returned; the error
+			// comes back on the game's next call. If there were none, the synthesized
+			// events stay owed.
+			if (readIndex == 0) {
+				hr = hrRead;
+				kept = 0;
+			}
+			break;
+		}
+		// DI_BUFFEROVERFLOW from any read is reported.
+		if (readIndex == 0 || hrRead != kDiOk) {
+			hr = hrRead;
+		}
+		uint32_t filtered = count;
+		if (count > 0 && pState->actionMapActive) {
+			// DX3 records carry no uAppData to look up.
+			if (cbObjectData == sizeof(DiDeviceObjectData)) {
+				filtered = CompactActionEvents(pState->actionTable, plan.suppressMask, reinterpret_cast<DiDeviceObjectData*>(pBatch), count);
+			}
+		}
+		else if (count > 0 && plan.eventRuleCount > 0) {
+			filtered = CompactEvents(plan, pBatch, count, cbObjectData);
+		}
+		if (filtered != count) {
+			pStats->eventsFiltered += count - filtered;
+			dropped = true;
+		}
+		kept += filtered;
+		// A short read emptied the device's buffer. A peek would only see the same events again.
+		if (count < requested || kept == capacity || peek || readIndex + 1 == kMaxEventReads) {
+			break;
+		}
+		++pStats->refills;
+	}
+
+	if (kept > 0) {
+		if (peek) {
+			EventSequence preview = pState->sequence;
+			SequenceEvents(&preview, pRecords, synthesized, kept, cbObjectData, dropped, nowMs);
+		}
+		else {
+			SequenceEvents(&pState->sequence, pRecords, synthesized, kept, cbObjectData, dropped, nowMs);
+			pState->neutralCount -= synthesized;
+			memmove(pState->neutralOffsets, pState->neutralOffsets + synthesized, pState->neutralCount * sizeof(pState->neutralOffsets[0]));
+			memmove(pState->neutralValues, pState->neutralValues + synthesized, pState->neutralCount * sizeof(pState->neutralValues[0]));
+		}
+	}
+	pState->lock.Unlock();
+	*pdwInOut = kept;
+	return hr;
+}
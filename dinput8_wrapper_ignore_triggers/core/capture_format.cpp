@@ -0,0 +1,313 @@
+// capture_format.cpp
+//
+// See capture_format.h.
+
+#include <cstring>
+
+#include "capture_format.h"
+
+static const size_t kRecordHeaderSize = 16;
+// GUID, offset, type, flags and whether the GUID is present.
+static const size_t kFormatObjectSize = 32;
+// dwOfs, dwData, dwTimeStamp and dwSequence.
+static const size_t kEventSize = 16;
+// lMin and lMax.
+static const size_t kRangeSize = 8;
+
+// --- Encoder ---
+CaptureEncoder::CaptureEncoder() {
+	Append(kCaptureMagic, sizeof(kCaptureMagic));
+	AppendU32(kCaptureVersion);
+}
+
+void CaptureEncoder::Append(const void* pData, size_t size) {
+	size_t pos = m_buffer.size();
+	m_buffer.resize(pos + size);
+	memcpy(&m_buffer[pos], pData, size);
+}
+
+size_t CaptureEncoder::BeginRecord(CaptureRecordKind kind, uint16_t device, uint64_t timeUs) {
+	size_t headerPos = m_buffer.size();
+	uint16_t kind16 = static_cast<uint16_t>(kind);
+	Append(&kind16, sizeof(kind16));
+	Append(&device, sizeof(device));
+	AppendU32(0);
+	Append(&timeUs, sizeof(timeUs));
+	return headerPos;
+}
+
+void CaptureEncoder::EndRecord(size_t headerPos) {
+	uint32_t payloadSize = static_cast<uint32_t>(m_buffer.size() - headerPos - kRecordHeaderSize);
+	memcpy(&m_buffer[headerPos + 4], &payloadSize, sizeof(payloadSize));
+}
+
+void CaptureEncoder::AddFormat(uint16_t device, uint64_t timeUs, const DiDataFormat* pFormat) {
+	size_t headerPos = BeginRecord(kCaptureRecordFormat, device, timeUs);
+	AppendU32(pFormat->dwDataSize);
+	AppendU32(pFormat->dwNumObjs);
+	for (uint32_t i = 0; i < pFormat->dwNumObjs; ++i) {
+		const DiObjectDataFormat& odf = pFormat->rgodf[i];
+		DiGuid guid = {};
+		if (odf.pguid) {
+			guid = *odf.pguid;
+		}
+		Append(&guid, sizeof(guid));
+		AppendU32(odf.dwOfs);
+		AppendU32(odf.dwType);
+		AppendU32(odf.dwFlags);
+		AppendU32(odf.pguid ? 1 : 0);
+	}
+	EndRecord(headerPos);
+
+	// A new format means a new state layout.
+	if (device < m_lastState.size()) {
+		m_lastState[device].clear();
+	}
+}
+
+void CaptureEncoder::AddState(uint16_t device, uint64_t timeUs, int32_t hr, uint32_t cbData, const void* pData) {
+	size_t headerPos = BeginRecord(kCaptureRecordState, device, timeUs);
+	Append(&hr, sizeof(hr));
+	AppendU32(cbData);
+
+	if (hr < 0 || !pData) {
+		AppendU32(kCaptureStateNone);
+		EndRecord(headerPos);
+		return;
+	}
+
+	if (device >= m_lastState.size()) {
+		m_lastState.resize(device + 1);
+	}
+	std::vector<uint8_t>& last = m_lastState[device];
+	const uint8_t* pBytes = static_cast<const uint8_t*>(pData);
+	if (last.size() == cbData && cbData % sizeof(uint32_t) == 0) {
+		AppendU32(kCaptureStateDelta);
+		size_t countPos = m_buffer.size();
+		AppendU32(0);
+		uint32_t changed = 0;
+		for (uint32_t word = 0; word < cbData / sizeof(uint32_t); ++word) {
+			if (memcmp(&last[word * sizeof(uint32_t)], pBytes + word * sizeof(uint32_t), sizeof(uint32_t)) != 0) {
+				AppendU32(word);
+				Append(pBytes + word * sizeof(uint32_t), sizeof(uint32_t));
+				++changed;
+			}
+		}
+		memcpy(&m_buffer[countPos], &changed, sizeof(changed));
+	}
+	else {
+		AppendU32(kCaptureStateFull);
+		Append(pBytes, cbData);
+	}
+	last.assign(pBytes, pBytes + cbData);
+	EndRecord(headerPos);
+}
+
+void CaptureEncoder::AddEvents(uint16_t device, uint64_t timeUs, int32_t hr, uint32_t cbObjectData, const void* rgdod, uint32_t count, uint32_t dwFlags) {
+	size_t headerPos = BeginRecord(kCaptureRecordEvents, device, timeUs);
+	Append(&hr, sizeof(hr));
+	AppendU32(cbObjectData);
+	AppendU32(dwFlags);
+	if (hr < 0 || !rgdod || cbObjectData < kEventSize) {
+		count = 0;
+	}
+	AppendU32(count);
+	const uint8_t* pRecord = static_cast<const uint8_t*>(rgdod);
+	for (uint32_t i = 0; i < count; ++i, pRecord += cbObjectData) {
+		Append(pRecord, kEventSize);
+	}
+	EndRecord(headerPos);
+}
+
+void CaptureEncoder::AddRanges(uint16_t device, uint64_t timeUs, const DiAxisRange* pRanges, uint32_t count) {
+	size_t headerPos = BeginRecord(kCaptureRecordRanges, device, timeUs);
+	AppendU32(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		Append(&pRanges[i].lMin, sizeof(pRanges[i].lMin));
+		Append(&pRanges[i].lMax, sizeof(pRanges[i].lMax));
+	}
+	EndRecord(headerPos);
+}
+
+// --- Reader ---
+CaptureReader::CaptureReader() : m_pData(nullptr), m_size(0), m_pos(0), m_recordEnd(0) {
+}
+
+bool CaptureReader::Open(const uint8_t* pData, size_t size) {
+	m_pData = pData;
+	m_size = size;
+	m_pos = 0;
+	m_recordEnd = size;
+	char magic[4];
+	uint32_t version;
+	if (!Read(magic, sizeof(magic)) || memcmp(magic, kCaptureMagic, sizeof(magic)) != 0 || !ReadU32(&version) || version != kCaptureVersion) {
+		m_size = 0;
+		return false;
+	}
+	Rewind();
+	return true;
+}
+
+void CaptureReader::Rewind() {
+	m_pos = sizeof(kCaptureMagic) + sizeof(uint32_t);
+	m_recordEnd = m_size;
+	m_lastState.clear();
+}
+
+bool CaptureReader::Read(void* pOut, size_t size) {
+	if (size > m_recordEnd - m_pos) {
+		return false;
+	}
+	memcpy(pOut, m_pData + m_pos, size);
+	m_pos += size;
+	return true;
+}
+
+std::vector<uint8_t>& CaptureReader::GetLastState(uint16_t device) {
+	if (device >= m_lastState.size()) {
+		m_lastState.resize(device + 1);
+	}
+	return m_lastState[device];
+}
+
+bool CaptureReader::Next(CaptureRecord* pRecord) {
+	m_recordEnd = m_size;
+	if (m_pos >= m_size) {
+		return false;
+	}
+
+	uint16_t kind;
+	uint32_t payloadSize;
+	if (!Read(&kind, sizeof(kind)) || !Read(&pRecord->device, sizeof(pRecord->device)) || !ReadU32(&payloadSize) || !Read(&pRecord->timeUs, sizeof(pRecord->timeUs))) {
+		return false;
+	}
+	if (payloadSize > m_size - m_pos) {
+		return false;
+	}
+	// Payload reads below cannot run past the record.
+	m_recordEnd = m_pos + payloadSize;
+	size_t next = m_recordEnd;
+
+	pRecord->kind = static_cast<CaptureRecordKind>(kind);
+	pRecord->hr = 0;
+	pRecord->cbData = 0;
+	pRecord->pState = nullptr;
+	pRecord->cbObjectData = 0;
+	pRecord->dwFlags = 0;
+	pRecord->eventCount = 0;
+	pRecord->pEvents = nullptr;
+	pRecord->rangeCount = 0;
+	pRecord->pRanges = nullptr;
+	memset(&pRecord->format, 0, sizeof(pRecord->format));
+
+	bool ok = false;
+	switch (kind) {
+	case kCaptureRecordFormat: {
+		uint32_t dataSize;
+		uint32_t numObjs;
+		if (!ReadU32(&dataSize) || !ReadU32(&numObjs) || numObjs > (m_recordEnd - m_pos) / kFormatObjectSize) {
+			break;
+		}
+		m_guids.resize(numObjs);
+		m_objects.resize(numObjs);
+		for (uint32_t i = 0; i < numObjs; ++i) {
+			uint32_t hasGuid = 0;
+			DiObjectDataFormat& odf = m_objects[i];
+			Read(&m_guids[i], sizeof(DiGuid));
+			ReadU32(&odf.dwOfs);
+			ReadU32(&odf.dwType);
+			ReadU32(&odf.dwFlags);
+			ReadU32(&hasGuid);
+			odf.pguid = hasGuid ? &m_guids[i] : nullptr;
+		}
+		pRecord->format.dwSize = sizeof(DiDataFormat);
+		pRecord->format.dwObjSize = sizeof(DiObjectDataFormat);
+		pRecord->format.dwDataSize = dataSize;
+		pRecord->format.dwNumObjs = numObjs;
+		pRecord->format.rgodf = numObjs ? m_objects.data() : nullptr;
+		GetLastState(pRecord->device).clear();
+		ok = true;
+		break;
+	}
+	case kCaptureRecordState: {
+		uint32_t encoding;
+		if (!Read(&pRecord->hr, sizeof(pRecord->hr)) || !ReadU32(&pRecord->cbData) || !ReadU32(&encoding)) {
+			break;
+		}
+		std::vector<uint8_t>& last = GetLastState(pRecord->device);
+		if (encoding == kCaptureStateNone) {
+			ok = true;
+		}
+		else if (encoding == kCaptureStateFull) {
+			if (pRecord->cbData > m_recordEnd - m_pos) {
+				break;
+			}
+			last.assign(m_pData + m_pos, m_pData + m_pos + pRecord->cbData);
+			m_pos += pRecord->cbData;
+			pRecord->pState = last.data();
+			ok = true;
+		}
+		else if (encoding == kCaptureStateDelta) {
+			uint32_t changed;
+			if (last.size() != pRecord->cbData || !ReadU32(&changed) || changed > (m_recordEnd - m_pos) / (2 * sizeof(uint32_t))) {
+				break;
+			}
+			ok = true;
+			for (uint32_t i = 0; i < changed && ok; ++i) {
+				uint32_t word = 0;
+				ReadU32(&word);
+				if (word >= pRecord->cbData / sizeof(uint32_t)) {
+					ok = false;
+					break;
+				}
+				Read(&last[word * sizeof(uint32_t)], sizeof(uint32_t));
+			}
+			pRecord->pState = last.data();
+		}
+		break;
+	}
+	case kCaptureRecordEvents: {
+		uint32_t count;
+		if (!Read(&pRecord->hr, sizeof(pRecord->hr)) || !ReadU32(&pRecord->cbObjectData) || !ReadU32(&pRecord->dwFlags) || !ReadU32(&count) || count > (m_recordEnd - m_pos) / kEventSize) {
+			break;
+		}
+		m_events.resize(count);
+		for (uint32_t i = 0; i < count; ++i) {
+			DiDeviceObjectData& event = m_events[i];
+			Read(&event, kEventSize);
+			event.uAppData = 0;
+		}
+		pRecord->eventCount = count;
+		pRecord->pEvents = count ? m_events.data() : nullptr;
+		ok = true;
+		break;
+	}
+	case kCaptureRecordRanges: {
+		uint32_t count;
+		if (!ReadU32(&count) || count > (m_recordEnd - m_pos) / kRangeSize) {
+			break;
+		}
+		m_ranges.resize(count);
+		for (uint32_t i = 0; i < count; ++i) {
+			Read(&m_ranges[i].lMin, sizeof(m_ranges[i].lMin));
+			Read(&m_ranges[i].lMax, sizeof(m_ranges[i].lMax));
+		}
+		pRecord->rangeCount = count;
+		pRecord->pRanges = count ? m_ranges.data() : nullptr;
+		ok = true;
+		break;
+	}
+	default:
+		// Unknown kinds from a newer writer are skipped.
+		ok = true;
+		break;
+	}
+
+	m_recordEnd = m_size;
+	if (!ok) {
+		m_pos = m_size;
+		return false;
+	}
+	m_pos = next;
+	return true;
+}
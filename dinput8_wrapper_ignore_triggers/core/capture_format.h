@@ -0,0 +1,128 @@
+// capture_format.h
+//
+// Binary format for recorded controller input: what the real device returned from
+// SetDataFormat, GetDeviceState and GetDeviceData, before any filtering. The DLL writes it in
+// capture mode; the replay tool reads it back and drives the filter with it offline.
+//
+// Layout (little-endian):
+//   file header    "DI8R", uint32 version
+//   record header  uint16 kind, uint16 device, uint32 payload size, uint64 microseconds since
+//                  capture start
+//   payload        depends on kind, see CaptureEncoder
+//
+// Controller state changes a few words at a time, so a state the same size as the device's
+// previous one is stored as the list of 32-bit words that changed.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "dinput_types.h"
+
+static const char kCaptureMagic[4] = { 'D', 'I', '8', 'R' };
+static const uint32_t kCaptureVersion = 1;
+
+enum CaptureRecordKind : uint16_t {
+	// A data format the device accepted.
+	kCaptureRecordFormat = 1,
+	// A GetDeviceState call.
+	kCaptureRecordState = 2,
+	// A GetDeviceData call that was asked for records (rgdod not null).
+	kCaptureRecordEvents = 3,
+	// The DIPROP_RANGE of each axis, whenever the format or a range changes.
+	kCaptureRecordRanges = 4,
+};
+
+enum CaptureStateEncoding {
+	// The call failed; no state.
+	kCaptureStateNone = 0,
+	kCaptureStateFull = 1,
+	// Changed words relative to the device's previous state.
+	kCaptureStateDelta = 2,
+};
+
+// Appends records to an in-memory buffer. The owner drains the buffer to wherever the
+// capture goes; delta state survives ClearBuffer.
+class CaptureEncoder {
+public:
+	CaptureEncoder();
+
+	void AddFormat(uint16_t device, uint64_t timeUs, const DiDataFormat* pFormat);
+	void AddState(uint16_t device, uint64_t timeUs, int32_t hr, uint32_t cbData, const void* pData);
+	// rgdod holds count records of cbObjectData bytes each. uAppData is not stored.
+	void AddEvents(uint16_t device, uint64_t timeUs, int32_t hr, uint32_t cbObjectData, const void* rgdod, uint32_t count, uint32_t dwFlags);
+	// One range per axis, in the filter's AxisIndex order.
+	void AddRanges(uint16_t device, uint64_t timeUs, const DiAxisRange* pRanges, uint32_t count);
+
+	const std::vector<uint8_t>& GetBuffer() const { return m_buffer; }
+	void ClearBuffer() { m_buffer.clear(); }
+
+private:
+	size_t BeginRecord(CaptureRecordKind kind, uint16_t device, uint64_t timeUs);
+	void EndRecord(size_t headerPos);
+	void Append(const void* pData, size_t size);
+	void AppendU32(uint32_t value) { Append(&value, sizeof(value)); }
+
+	std::vector<uint8_t> m_buffer;
+	// Last full state per device, for delta encoding.
+	std::vector<std::vector<uint8_t>> m_lastState;
+};
+
+struct CaptureRecord {
+	CaptureRecordKind kind;
+	uint16_t device;
+	uint64_t timeUs;
+	int32_t hr;
+
+	// kCaptureRecordFormat. Points into the reader, valid until the next call to Next.
+	DiDataFormat format;
+
+	// kCaptureRecordState. pState is null when the call failed.
+	uint32_t cbData;
+	const uint8_t* pState;
+
+	// kCaptureRecordEvents. Records are widened to DiDeviceObjectData with uAppData 0;
+	// cbObjectData is what the game asked for.
+	uint32_t cbObjectData;
+	uint32_t dwFlags;
+	uint32_t eventCount;
+	const DiDeviceObjectData* pEvents;
+
+	// kCaptureRecordRanges.
+	uint32_t rangeCount;
+	const DiAxisRange* pRanges;
+};
+
+// Reads a capture from memory. Every size in the file is checked against the data, so a
+// truncated or damaged file ends the stream instead of reading out of bounds.
+class CaptureReader {
+public:
+	CaptureReader();
+
+	// Returns false if the data is not a capture this reader understands.
+	bool Open(const uint8_t* pData, size_t size);
+
+	// Returns false at the end of the data or at the first malformed record.
+	bool Next(CaptureRecord* pRecord);
+
+	// Back to the first record, forgetting delta state.
+	void Rewind();
+
+private:
+	bool Read(void* pOut, size_t size);
+	bool ReadU32(uint32_t* pValue) { return Read(pValue, sizeof(*pValue)); }
+	std::vector<uint8_t>& GetLastState(uint16_t device);
+
+	const uint8_t* m_pData;
+	size_t m_size;
+	size_t m_pos;
+	// Offset just past the current record's payload.
+	size_t m_recordEnd;
+	std::vector<std::vector<uint8_t>> m_lastState;
+	std::vector<DiGuid> m_guids;
+	std::vector<DiObjectDataFormat> m_objects;
+	std::vector<DiDeviceObjectData> m_events;
+	std::vector<DiAxisRange> m_ranges;
+};
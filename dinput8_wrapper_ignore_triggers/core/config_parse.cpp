@@ -0,0 +1,316 @@
+// config_parse.cpp
+//
+// See config_parse.h.
+
+#include <algorithm>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+
+#include "config_parse.h"
+
+// --- Defaults ---
+static const unsigned long kDefaultBufferSize = 1024;
+// DirectInput allocates the buffer up front; there is no point in more than a few seconds.
+static const unsigned long kMaxBufferSize = 64 * 1024;
+
+const Config kDefaultConfig = {
+	0,                                                  // generation
+	false,                                              // logEnabled
+	{
+		(1u << kAxisRx) | (1u << kAxisRy),              // suppressMask
+		{ kAxisX, kAxisY, kAxisZ, kAxisRx, kAxisRy, kAxisRz, kAxisSlider0, kAxisSlider1 },
+		{ 0 },                                          // deadzone
+		kDefaultBufferSize,                             // bufferSize
+	},
+	1,                                                  // ruleCount
+	{ { true, kDeviceMatchSixDof, 0, 0, "" } },
+	"",                                                 // chainDll
+	"",                                                 // captureFile
+	true,                                               // recoveryEnabled
+	false,                                              // recoveryReportsNeutral
+	"",                                                 // profile
+};
+
+void SetConfigDefaults(Config* pConfig) {
+	*pConfig = kDefaultConfig;
+}
+
+// --- Parsing ---
+static const char* const kAxisNames[kAxisCount] = { "x", "y", "z", "rx", "ry", "rz", "slider0", "slider1" };
+
+// strncpy_s(..., _TRUNCATE) without the MSVC CRT.
+static void CopyTruncated(char* pDest, size_t destSize, const char* pSource) {
+	size_t length = strlen(pSource);
+	if (length >= destSize) {
+		length = destSize - 1;
+	}
+	memcpy(pDest, pSource, length);
+	pDest[length] = '\0';
+}
+
+static std::string Trim(const std::string& str) {
+	size_t begin = str.find_first_not_of(" \t\r\n");
+	if (begin == std::string::npos) {
+		return std::string();
+	}
+	size_t end = str.find_last_not_of(" \t\r\n");
+	return str.substr(begin, end - begin + 1);
+}
+
+static std::string ToLower(std::string str) {
+	for (char& c : str) {
+		c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+	}
+	return str;
+}
+
+static int ParseAxisName(const std::string& name) {
+	for (int i = 0; i < kAxisCount; ++i) {
+		if (name == kAxisNames[i]) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static bool ParseBool(const std::string& value) {
+	return value == "1" || value == "true" || value == "yes" || value == "on";
+}
+
+// "rx, ry" or "rx ry" or "none".
+static unsigned ParseAxisMask(const std::string& value) {
+	unsigned mask = 0;
+	size_t pos = 0;
+	while (pos < value.size()) {
+		size_t end = value.find_first_of(", \t", pos);
+		if (end == std::string::npos) {
+			end = value.size();
+		}
+		int axis = ParseAxisName(value.substr(pos, end - pos));
+		if (axis >= 0) {
+			mask |= 1u << axis;
+		}
+		pos = end + 1;
+	}
+	return mask;
+}
+
+// "all", "sixdof", "vidpid:054C:0CE6" or "name:Wireless Controller".
+static bool ParseDeviceRule(bool wrap, const std::string& value, DeviceRule* pRule) {
+	std::string lower = ToLower(value);
+	pRule->wrap = wrap;
+	pRule->vid = 0;
+	pRule->pid = 0;
+	pRule->name[0] = '\0';
+	if (lower == "all") {
+		pRule->kind = kDeviceMatchAll;
+		return true;
+	}
+	if (lower == "sixdof") {
+		pRule->kind = kDeviceMatchSixDof;
+		return true;
+	}
+	if (lower.compare(0, 7, "vidpid:") == 0) {
+		char* pEnd = nullptr;
+		unsigned long vid = strtoul(lower.c_str() + 7, &pEnd, 16);
+		if (*pEnd != ':') {
+			return false;
+		}
+		unsigned long pid = strtoul(pEnd + 1, &pEnd, 16);
+		pRule->kind = kDeviceMatchVidPid;
+		pRule->vid = static_cast<unsigned short>(vid);
+		pRule->pid = static_cast<unsigned short>(pid);
+		return true;
+	}
+	if (lower.compare(0, 5, "name:") == 0) {
+		pRule->kind = kDeviceMatchName;
+		CopyTruncated(pRule->name, sizeof(pRule->name), lower.c_str() + 5);
+		return true;
+	}
+	return false;
+}
+
+static void ApplySetting(const std::string& section, const std::string& key, const std::string& value, Config* pConfig, bool* pRulesReset) {
+	if (section == "logging") {
+		if (key == "enabled") {
+			pConfig->logEnabled = ParseBool(ToLower(value));
+		}
+	}
+	else if (section == "filter") {
+		if (key == "suppress") {
+			pConfig->filter.suppressMask = ParseAxisMask(ToLower(value));
+		}
+		else if (key.compare(0, 6, "remap.") == 0) {
+			int axis = ParseAxisName(key.substr(6));
+			int source = ParseAxisName(ToLower(value));
+			if (axis >= 0 && source >= 0) {
+				pConfig->filter.remapSource[axis] = static_cast<unsigned char>(source);
+			}
+		}
+		else if (key.compare(0, 9, "deadzone.") == 0) {
+			int axis = ParseAxisName(key.substr(9));
+			if (axis >= 0) {
+				long deadzone = strtol(value.c_str(), nullptr, 10);
+				pConfig->filter.deadzone[axis] = (std::min)((std::max)(deadzone, 0L), 10000L);
+			}
+		}
+		else if (key == "buffer_size") {
+			long size = strtol(value.c_str(), nullptr, 10);
+			pConfig->filter.bufferSize = size > 0 ? (std::min)(static_cast<unsigned long>(size), kMaxBufferSize) : 0;
+		}
+	}
+	else if (section == "devices") {
+		if (key == "wrap" || key == "pass") {
+			// A [devices] section replaces the built-in rule rather than adding to it.
+			if (!*pRulesReset) {
+				pConfig->ruleCount = 0;
+				*pRulesReset = true;
+			}
+			if (pConfig->ruleCount < kMaxDeviceRules && ParseDeviceRule(key == "wrap", value, &pConfig->rules[pConfig->ruleCount])) {
+				++pConfig->ruleCount;
+			}
+		}
+	}
+	else if (section == "chain") {
+		if (key == "dll") {
+			CopyTruncated(pConfig->chainDll, sizeof(pConfig->chainDll), value.c_str());
+		}
+	}
+	else if (section == "capture") {
+		if (key == "file") {
+			CopyTruncated(pConfig->captureFile, sizeof(pConfig->captureFile), value.c_str());
+		}
+	}
+	else if (section == "recovery") {
+		if (key == "enabled") {
+			pConfig->recoveryEnabled = ParseBool(ToLower(value));
+		}
+		else if (key == "report") {
+			pConfig->recoveryReportsNeutral = ToLower(value) == "neutral";
+		}
+	}
+}
+
+// Profile sections are applied after the plain sections, and timestamp-qualified ones after
+// name-only ones, so the most specific setting wins wherever it appears in the file.
+enum ParsePhase {
+	kParsePhaseBase,
+	kParsePhaseProfileName,
+	kParsePhaseProfileBuild,
+	kParsePhaseCount,
+	kParsePhaseSkip = kParsePhaseCount
+};
+
+unsigned long long HashProfileName(const char* name, size_t length) {
+	unsigned long long hash = 14695981039346656037ull;
+	for (size_t i = 0; i < length; ++i) {
+		unsigned char c = static_cast<unsigned char>(name[i]);
+		if (c >= 'A' && c <= 'Z') {
+			c = static_cast<unsigned char>(c - 'A' + 'a');
+		}
+		hash ^= c;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// "profile:ys8.exe" or "profile:ys8.exe@5f3a2b1c", already lowercased.
+static ParsePhase ClassifySection(const std::string& section, const ProfileKey& process) {
+	if (section.compare(0, 8, "profile:") != 0) {
+		return kParsePhaseBase;
+	}
+	std::string name = section.substr(8);
+	size_t at = name.find('@');
+	bool hasTimestamp = at != std::string::npos;
+	if (hasTimestamp) {
+		char* pEnd = nullptr;
+		unsigned long timestamp = strtoul(name.c_str() + at + 1, &pEnd, 16);
+		if (*pEnd != '\0' || timestamp != process.timestamp) {
+			return kParsePhaseSkip;
+		}
+		name.erase(at);
+	}
+	name = Trim(name);
+	if (HashProfileName(name.c_str(), name.size()) != process.nameHash) {
+		return kParsePhaseSkip;
+	}
+	return hasTimestamp ? kParsePhaseProfileBuild : kParsePhaseProfileName;
+}
+
+static void ParseConfigPhase(const char* text, size_t length, const ProfileKey& process, ParsePhase phase, Config* pConfig) {
+	std::string section;
+	ParsePhase sectionPhase = kParsePhaseBase;
+	bool rulesReset = false;
+	size_t pos = 0;
+	while (pos < length) {
+		const char* pLineEnd = static_cast<const char*>(memchr(text + pos, '\n', length - pos));
+		size_t lineEnd = pLineEnd ? static_cast<size_t>(pLineEnd - text) : length;
+		std::string line(text + pos, lineEnd - pos);
+		pos = lineEnd + 1;
+
+		size_t comment = line.find_first_of(";#");
+		if (comment != std::string::npos) {
+			line.erase(comment);
+		}
+		line = Trim(line);
+		if (line.empty()) {
+			continue;
+		}
+
+		if (line[0] == '[') {
+			size_t close = line.find(']');
+			section = ToLower(Trim(line.substr(1, close == std::string::npos ? std::string::npos : close - 1)));
+			sectionPhase = ClassifySection(section, process);
+			if (sectionPhase == phase && phase != kParsePhaseBase) {
+				CopyTruncated(pConfig->profile, sizeof(pConfig->profile), section.c_str() + 8);
+			}
+			continue;
+		}
+		if (sectionPhase != phase) {
+			continue;
+		}
+
+		size_t equals = line.find('=');
+		if (equals == std::string::npos) {
+			continue;
+		}
+		std::string key = ToLower(Trim(line.substr(0, equals)));
+		std::string value = Trim(line.substr(equals + 1));
+		if (phase == kParsePhaseBase) {
+			ApplySetting(section, key, value, pConfig, &rulesReset);
+		}
+		else {
+			// Profiles hold per-game filter settings and device rules.
+			ApplySetting((key == "wrap" || key == "pass") ? "devices" : "filter", key, value, pConfig, &rulesReset);
+		}
+	}
+}
+
+void ParseConfig(const char* text, size_t length, const ProfileKey& process, Config* pConfig) {
+	SetConfigDefaults(pConfig);
+	for (int phase = kParsePhaseBase; phase < kParsePhaseCount; ++phase) {
+		ParseConfigPhase(text, length, process, static_cast<ParsePhase>(phase), pConfig);
+	}
+}
+
+// --- Device rules ---
+static bool MatchesDeviceRule(const DeviceRule& rule, const DeviceIdentity& device) {
+	switch (rule.kind) {
+	case kDeviceMatchAll: return true;
+	case kDeviceMatchSixDof: return device.sixDof;
+	case kDeviceMatchVidPid: return device.hasVidPid && device.vid == rule.vid && device.pid == rule.pid;
+	case kDeviceMatchName: return ToLower(device.name ? device.name : "").find(rule.name) != std::string::npos;
+	}
+	return false;
+}
+
+bool ShouldWrapDevice(const Config& config, const DeviceIdentity& device) {
+	for (unsigned i = 0; i < config.ruleCount; ++i) {
+		if (MatchesDeviceRule(config.rules[i], device)) {
+			return config.rules[i].wrap;
+		}
+	}
+	return false;
+}
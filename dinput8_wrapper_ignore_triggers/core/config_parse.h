@@ -0,0 +1,140 @@
+// config_parse.h
+//
+// The configuration file format and the snapshot it parses into. Platform-independent; the
+// DLL side (config.h) handles finding, watching and publishing the file.
+//
+// Example:
+//
+//   [logging]
+//   enabled = 1
+//
+//   [filter]
+//   suppress = rx, ry      ; axes reported as neutral (x y z rx ry rz slider0 slider1, or none)
+//   remap.z = rz           ; the game's Z axis reads the physical Rz axis
+//   deadzone.x = 2000      ; values within 20.00% of neutral read as neutral, like DIPROP_DEADZONE
+//   buffer_size = 1024     ; minimum real DIPROP_BUFFERSIZE for buffered input (0 = game's)
+//
+//   [devices]              ; first matching rule wins; no match means pass-through
+//   pass = name:Xbox
+//   wrap = vidpid:054C:0CE6
+//   wrap = sixdof
+//
+//   [chain]
+//   dll = dinput8_next.dll ; same as DINPUT8_CHAIN_DLL, which takes precedence
+//
+//   [capture]
+//   file = input.di8r      ; record unfiltered device input for tools/filter_replay
+//
+//   [recovery]
+//   enabled = 1            ; reacquire lost devices in the background (default on)
+//   report = neutral       ; what the game sees meanwhile: error (default) or neutral
+//
+//   [profile:ys8.exe]      ; only applied when the host executable is ys8.exe
+//   suppress = rx, ry, z   ; [filter] keys, plus wrap/pass which replace the [devices] rules
+//
+//   [profile:ys8.exe@5F3A2B1C] ; only that build (PE header timestamp, hex); applied last
+//   remap.z = rz
+
+#pragma once
+
+#include <cstddef>
+
+// Axes a joystick data format can carry, in DIJOYSTATE order.
+enum AxisIndex {
+	kAxisX,
+	kAxisY,
+	kAxisZ,
+	kAxisRx,
+	kAxisRy,
+	kAxisRz,
+	kAxisSlider0,
+	kAxisSlider1,
+	kAxisCount
+};
+
+struct FilterConfig {
+	// Bit (1 << AxisIndex) set for every axis reported as neutral.
+	unsigned suppressMask;
+	// Physical axis each of the game's axes reads from. Identity by default.
+	unsigned char remapSource[kAxisCount];
+	// Distance from neutral below which an axis reads as neutral, in hundredths of a percent
+	// of its half-range (0..10000, like DIPROP_DEADZONE). 0 disables.
+	long deadzone[kAxisCount];
+	// DIPROP_BUFFERSIZE the real device is given when the game asks for a smaller buffer, so
+	// filtered noise cannot overflow it between frames. 0 keeps the game's size.
+	unsigned long bufferSize;
+};
+
+enum DeviceMatchKind {
+	kDeviceMatchAll,
+	kDeviceMatchSixDof,
+	kDeviceMatchVidPid,
+	kDeviceMatchName
+};
+
+struct DeviceRule {
+	bool wrap;
+	DeviceMatchKind kind;
+	unsigned short vid;
+	unsigned short pid;
+	// Case-insensitive substring of the product name, UTF-8.
+	char name[64];
+};
+
+static const unsigned kMaxDeviceRules = 16;
+
+// MAX_PATH.
+static const size_t kMaxChainDllPath = 260;
+
+struct Config {
+	// Increases with every published snapshot.
+	unsigned long generation;
+	bool logEnabled;
+	FilterConfig filter;
+	unsigned ruleCount;
+	DeviceRule rules[kMaxDeviceRules];
+	// Next-in-chain proxy, empty for none.
+	char chainDll[kMaxChainDllPath];
+	// Raw input capture file (capture_format.h), empty for none. Read once at startup.
+	char captureFile[kMaxChainDllPath];
+	// Reacquire devices that lose their input on a background thread.
+	bool recoveryEnabled;
+	// While a device is being reacquired, give the game a neutral state instead of the error.
+	bool recoveryReportsNeutral;
+	// Name of the last [profile:...] section applied, empty for none.
+	char profile[64];
+};
+
+// Identifies the host executable for profile selection.
+struct ProfileKey {
+	// HashProfileName of the executable's file name.
+	unsigned long long nameHash;
+	// TimeDateStamp from its PE header.
+	unsigned long timestamp;
+};
+
+// FNV-1a over the ASCII-lowercased name, so "YS8.EXE" and "ys8.exe" select the same profile.
+unsigned long long HashProfileName(const char* name, size_t length);
+
+// Built-in behaviour: suppress Rx/Ry, wrap six-degrees-of-freedom controllers.
+extern const Config kDefaultConfig;
+
+// Copies kDefaultConfig.
+void SetConfigDefaults(Config* pConfig);
+
+// Parses INI text on top of the defaults, then applies the profile sections matching process.
+// Unknown sections and keys are ignored.
+void ParseConfig(const char* text, size_t length, const ProfileKey& process, Config* pConfig);
+
+// What CreateDevice knows about a device when it evaluates the [devices] rules.
+struct DeviceIdentity {
+	bool sixDof;
+	bool hasVidPid;
+	unsigned short vid;
+	unsigned short pid;
+	// Product name, UTF-8.
+	const char* name;
+};
+
+// Returns true if the first matching rule says to wrap the device. No match means pass-through.
+bool ShouldWrapDevice(const Config& config, const DeviceIdentity& device);
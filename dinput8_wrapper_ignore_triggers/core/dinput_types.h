@@ -0,0 +1,163 @@
+// dinput_types.h
+//
+// Plain mirrors of the DirectInput structures and constants the filter core works on, so the
+// core builds without <windows.h> or <dinput.h>. Each mirror has the same size and field
+// offsets as the real type on the same target; dllmain.cpp checks that with static_asserts
+// and passes the real structures straight through.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// --- Result codes ---
+static const int32_t kDiOk = 0;
+// DI_BUFFEROVERFLOW (S_FALSE): GetDeviceData lost events since the last call.
+static const int32_t kDiBufferOverflow = 1;
+// DIERR_INVALIDPARAM (E_INVALIDARG).
+static const int32_t kDiErrInvalidParam = static_cast<int32_t>(0x80070057);
+
+// --- GUID ---
+struct DiGuid {
+	uint32_t data1;
+	uint16_t data2;
+	uint16_t data3;
+	uint8_t data4[8];
+};
+
+inline bool operator==(const DiGuid& a, const DiGuid& b) {
+	if (a.data1 != b.data1 || a.data2 != b.data2 || a.data3 != b.data3) return false;
+	for (int i = 0; i < 8; ++i) {
+		if (a.data4[i] != b.data4[i]) return false;
+	}
+	return true;
+}
+
+// Object type GUIDs, same values as dinput.h.
+static const DiGuid kDiGuidXAxis = { 0xA36D02E0, 0xC9F3, 0x11CF, { 0xBF, 0xC7, 0x44, 0x45, 0x53, 0x54, 0x00, 0x00 } };
+static const DiGuid kDiGuidYAxis = { 0xA36D02E1, 0xC9F3, 0x11CF, { 0xBF, 0xC7, 0x44, 0x45, 0x53, 0x54, 0x00, 0x00 } };
+static const DiGuid kDiGuidZAxis = { 0xA36D02E2, 0xC9F3, 0x11CF, { 0xBF, 0xC7, 0x44, 0x45, 0x53, 0x54, 0x00, 0x00 } };
+static const DiGuid kDiGuidRxAxis = { 0xA36D02F4, 0xC9F3, 0x11CF, { 0xBF, 0xC7, 0x44, 0x45, 0x53, 0x54, 0x00, 0x00 } };
+static const DiGuid kDiGuidRyAxis = { 0xA36D02F5, 0xC9F3, 0x11CF, { 0xBF, 0xC7, 0x44, 0x45, 0x53, 0x54, 0x00, 0x00 } };
+static const DiGuid kDiGuidRzAxis = { 0xA36D02E3, 0xC9F3, 0x11CF, { 0xBF, 0xC7, 0x44, 0x45, 0x53, 0x54, 0x00, 0x00 } };
+static const DiGuid kDiGuidSlider = { 0xA36D02E4, 0xC9F3, 0x11CF, { 0xBF, 0xC7, 0x44, 0x45, 0x53, 0x54, 0x00, 0x00 } };
+
+// --- Data formats ---
+// DIDFT_AXIS, DIDFT_POV, DIDOI_ASPECTMASK and DIDOI_ASPECTPOSITION.
+static const uint32_t kDiDftAxis = 0x00000003;
+static const uint32_t kDiDftPov = 0x00000010;
+static const uint32_t kDiDoiAspectMask = 0x00000F00;
+static const uint32_t kDiDoiAspectPosition = 0x00000100;
+
+// DIOBJECTDATAFORMAT.
+struct DiObjectDataFormat {
+	const DiGuid* pguid;
+	uint32_t dwOfs;
+	uint32_t dwType;
+	uint32_t dwFlags;
+};
+
+// DIDATAFORMAT.
+struct DiDataFormat {
+	uint32_t dwSize;
+	uint32_t dwObjSize;
+	uint32_t dwFlags;
+	uint32_t dwDataSize;
+	uint32_t dwNumObjs;
+	const DiObjectDataFormat* rgodf;
+};
+
+// --- Device state ---
+// DIJOYSTATE.
+struct DiJoyState {
+	int32_t lX;
+	int32_t lY;
+	int32_t lZ;
+	int32_t lRx;
+	int32_t lRy;
+	int32_t lRz;
+	int32_t rglSlider[2];
+	uint32_t rgdwPOV[4];
+	uint8_t rgbButtons[32];
+};
+
+// DIJOYSTATE2.
+struct DiJoyState2 {
+	int32_t lX;
+	int32_t lY;
+	int32_t lZ;
+	int32_t lRx;
+	int32_t lRy;
+	int32_t lRz;
+	int32_t rglSlider[2];
+	uint32_t rgdwPOV[4];
+	uint8_t rgbButtons[128];
+	int32_t lVX;
+	int32_t lVY;
+	int32_t lVZ;
+	int32_t lVRx;
+	int32_t lVRy;
+	int32_t lVRz;
+	int32_t rglVSlider[2];
+	int32_t lAX;
+	int32_t lAY;
+	int32_t lAZ;
+	int32_t lARx;
+	int32_t lARy;
+	int32_t lARz;
+	int32_t rglASlider[2];
+	int32_t lFX;
+	int32_t lFY;
+	int32_t lFZ;
+	int32_t lFRx;
+	int32_t lFRy;
+	int32_t lFRz;
+	int32_t rglFSlider[2];
+};
+
+// DIJOFS_* for the position axes.
+static const uint32_t kDiJoyOfsX = offsetof(DiJoyState, lX);
+static const uint32_t kDiJoyOfsY = offsetof(DiJoyState, lY);
+static const uint32_t kDiJoyOfsZ = offsetof(DiJoyState, lZ);
+static const uint32_t kDiJoyOfsRx = offsetof(DiJoyState, lRx);
+static const uint32_t kDiJoyOfsRy = offsetof(DiJoyState, lRy);
+static const uint32_t kDiJoyOfsRz = offsetof(DiJoyState, lRz);
+static const uint32_t kDiJoyOfsSlider0 = offsetof(DiJoyState, rglSlider);
+static const uint32_t kDiJoyOfsSlider1 = offsetof(DiJoyState, rglSlider) + sizeof(int32_t);
+
+// --- Buffered data ---
+// DIDEVICEOBJECTDATA_DX3.
+struct DiDeviceObjectDataDx3 {
+	uint32_t dwOfs;
+	uint32_t dwData;
+	uint32_t dwTimeStamp;
+	uint32_t dwSequence;
+};
+
+// DIDEVICEOBJECTDATA.
+struct DiDeviceObjectData {
+	uint32_t dwOfs;
+	uint32_t dwData;
+	uint32_t dwTimeStamp;
+	uint32_t dwSequence;
+	uintptr_t uAppData;
+};
+
+// A centred POV hat reads as 0xFFFFFFFF.
+static const uint32_t kDiPovCentered = 0xFFFFFFFF;
+
+// DIGDD_PEEK.
+static const uint32_t kDiGddPeek = 0x00000001;
+
+// --- Properties ---
+// lMin and lMax of a DIPROPRANGE.
+struct DiAxisRange {
+	int32_t lMin;
+	int32_t lMax;
+};
+
+// DirectInput's range for joystick axes until the application sets one.
+static const DiAxisRange kDiDefaultAxisRange = { 0, 65535 };
+
+// DIPROP_DEADZONE and DIPROP_SATURATION are in hundredths of a percent of the range.
+static const uint32_t kDiPropScale = 10000;
@@ -0,0 +1,69 @@
+// event_sequence.cpp
+//
+// See event_sequence.h.
+
+#include <cstring>
+
+#include "event_sequence.h"
+#include "dinput_types.h"
+
+void ResetEventSequence(EventSequence* pSequence) {
+	pSequence->renumbering = false;
+	pSequence->started = false;
+	pSequence->nextSequence = 0;
+	pSequence->lastTimeStamp = 0;
+}
+
+static inline DiDeviceObjectDataDx3* RecordAt(void* rgdod, uint32_t index, uint32_t cbObjectData) {
+	return reinterpret_cast<DiDeviceObjectDataDx3*>(static_cast<uint8_t*>(rgdod) + index * cbObjectData);
+}
+
+void SequenceEvents(EventSequence* pSequence, void* rgdod, uint32_t synthesizedCount, uint32_t count, uint32_t cbObjectData, bool dropped, uint32_t nowMs) {
+	if (count == 0) {
+		return;
+	}
+
+	if (!pSequence->renumbering && synthesizedCount == 0 && !dropped) {
+		const DiDeviceObjectDataDx3* pLast = RecordAt(rgdod, count - 1, cbObjectData);
+		pSequence->started = true;
+		pSequence->nextSequence = pLast->dwSequence + 1;
+		pSequence->lastTimeStamp = pLast->dwTimeStamp;
+		return;
+	}
+
+	if (!pSequence->started) {
+		// Continue from the device's own numbering, as if the first record had passed through.
+		const DiDeviceObjectDataDx3* pFirstReal = synthesizedCount < count ? RecordAt(rgdod, synthesizedCount, cbObjectData) : nullptr;
+		pSequence->nextSequence = pFirstReal ? pFirstReal->dwSequence - synthesizedCount : 1;
+		pSequence->lastTimeStamp = pFirstReal ? pFirstReal->dwTimeStamp : nowMs;
+		pSequence->started = true;
+	}
+	pSequence->renumbering = true;
+
+	if (synthesizedCount > 0) {
+		uint32_t begin = pSequence->lastTimeStamp;
+		uint32_t end = synthesizedCount < count ? RecordAt(rgdod, synthesizedCount, cbObjectData)->dwTimeStamp : nowMs;
+		// Tick counts wrap; a span that looks negative means the clocks disagree, so the
+		// synthesized records take the earlier time instead of running backwards.
+		uint32_t span = end - begin;
+		if (span > 0x7FFFFFFFu) {
+			span = 0;
+		}
+		uint32_t step = span / (synthesizedCount + 1);
+		for (uint32_t i = 0; i < synthesizedCount; ++i) {
+			RecordAt(rgdod, i, cbObjectData)->dwTimeStamp = begin + step * (i + 1);
+		}
+	}
+
+	for (uint32_t i = 0; i < count; ++i) {
+		RecordAt(rgdod, i, cbObjectData)->dwSequence = pSequence->nextSequence++;
+	}
+	pSequence->lastTimeStamp = RecordAt(rgdod, count - 1, cbObjectData)->dwTimeStamp;
+}
+
+void WriteSynthesizedEvent(void* pRecord, uint32_t cbObjectData, uint32_t dwOfs, uint32_t dwData) {
+	memset(pRecord, 0, cbObjectData);
+	DiDeviceObjectDataDx3* pEvent = static_cast<DiDeviceObjectDataDx3*>(pRecord);
+	pEvent->dwOfs = dwOfs;
+	pEvent->dwData = dwData;
+}
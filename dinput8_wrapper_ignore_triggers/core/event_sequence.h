@@ -0,0 +1,34 @@
+// event_sequence.h
+//
+// Keeps buffered data consistent for games that diff dwSequence or time input with
+// dwTimeStamp. Once the wrapper has dropped or synthesized an event, every record handed to
+// the game is renumbered from a per-device counter, so sequence numbers stay monotonic and
+// gap-free across batches. Until then the device's own numbers pass through untouched.
+//
+// Records are DiDeviceObjectData or DiDeviceObjectDataDx3; both start with dwOfs, dwData,
+// dwTimeStamp and dwSequence.
+
+#pragma once
+
+#include <cstdint>
+
+struct EventSequence {
+	// Set by the first batch with a dropped or synthesized event.
+	bool renumbering;
+	// False until a record has been handed out.
+	bool started;
+	uint32_t nextSequence;
+	uint32_t lastTimeStamp;
+};
+
+void ResetEventSequence(EventSequence* pSequence);
+
+// Fixes up a batch about to be returned to the game. The first synthesizedCount of the count
+// records were made by the wrapper and go before the device's records; their timestamps are
+// spread evenly between the last record handed out and the first device record, or nowMs if
+// there is none. dropped says whether the filter removed any of the device's records.
+// O(1) per record. For a peek, pass a copy of the device's sequence so nothing is consumed.
+void SequenceEvents(EventSequence* pSequence, void* rgdod, uint32_t synthesizedCount, uint32_t count, uint32_t cbObjectData, bool dropped, uint32_t nowMs);
+
+// Fills a record the wrapper synthesizes. Timestamp and sequence are set by SequenceEvents.
+void WriteSynthesizedEvent(void* pRecord, uint32_t cbObjectData, uint32_t dwOfs, uint32_t dwData);
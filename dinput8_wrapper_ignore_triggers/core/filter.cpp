@@ -0,0 +1,324 @@
+// filter.cpp
+//
+// See filter.h.
+
+#include <algorithm>
+#include <cstring>
+
+#include "filter.h"
+
+static const DiGuid* const kAxisGuids[kAxisCount] = {
+	&kDiGuidXAxis, &kDiGuidYAxis, &kDiGuidZAxis, &kDiGuidRxAxis, &kDiGuidRyAxis, &kDiGuidRzAxis, &kDiGuidSlider, &kDiGuidSlider
+};
+
+static const uint32_t kJoyStateOffsets[kAxisCount] = {
+	kDiJoyOfsX, kDiJoyOfsY, kDiJoyOfsZ, kDiJoyOfsRx, kDiJoyOfsRy, kDiJoyOfsRz, kDiJoyOfsSlider0, kDiJoyOfsSlider1
+};
+
+int FindAxisByGuid(const DiGuid& guid) {
+	for (int axis = 0; axis < kAxisCount; ++axis) {
+		if (guid == *kAxisGuids[axis]) {
+			return axis;
+		}
+	}
+	return -1;
+}
+
+void SetDefaultFormatLayout(FormatLayout* pLayout) {
+	pLayout->known = false;
+	pLayout->dataSize = sizeof(DiJoyState);
+	pLayout->presentMask = (1u << kAxisCount) - 1;
+	for (int axis = 0; axis < kAxisCount; ++axis) {
+		pLayout->axisOffset[axis] = kJoyStateOffsets[axis];
+	}
+	pLayout->povCount = 4;
+	for (uint32_t pov = 0; pov < 4; ++pov) {
+		pLayout->povOffset[pov] = offsetof(DiJoyState, rgdwPOV) + pov * sizeof(uint32_t);
+	}
+}
+
+bool ValidateDataFormat(const DiDataFormat* lpdf) {
+	if (!lpdf || lpdf->dwSize != sizeof(DiDataFormat) || lpdf->dwObjSize != sizeof(DiObjectDataFormat)) {
+		return false;
+	}
+	if (lpdf->dwDataSize == 0 || lpdf->dwDataSize > kMaxDataFormatSize || lpdf->dwDataSize % sizeof(int32_t) != 0) {
+		return false;
+	}
+	return lpdf->dwNumObjs <= lpdf->dwDataSize && (lpdf->dwNumObjs == 0 || lpdf->rgodf);
+}
+
+void BuildFormatLayout(const DiDataFormat* lpdf, FormatLayout* pLayout) {
+	if (!ValidateDataFormat(lpdf)) {
+		SetDefaultFormatLayout(pLayout);
+		return;
+	}
+
+	pLayout->known = true;
+	pLayout->dataSize = lpdf->dwDataSize;
+	pLayout->presentMask = 0;
+	pLayout->povCount = 0;
+
+	for (uint32_t i = 0; i < lpdf->dwNumObjs; ++i) {
+		const DiObjectDataFormat& odf = lpdf->rgodf[i];
+		if (odf.dwOfs > lpdf->dwDataSize - sizeof(int32_t) || odf.dwOfs % sizeof(int32_t) != 0) continue;
+		if (odf.dwType & kDiDftPov) {
+			if (pLayout->povCount < 4) {
+				pLayout->povOffset[pLayout->povCount++] = odf.dwOfs;
+			}
+			continue;
+		}
+		if (!odf.pguid || !(odf.dwType & kDiDftAxis)) continue;
+		uint32_t aspect = odf.dwFlags & kDiDoiAspectMask;
+		if (aspect != 0 && aspect != kDiDoiAspectPosition) continue;
+
+		for (int axis = 0; axis < kAxisCount; ++axis) {
+			// The first two sliders fill slider0 and slider1; every other axis takes its
+			// first occurrence.
+			if (*odf.pguid == *kAxisGuids[axis] && !(pLayout->presentMask & (1u << axis))) {
+				pLayout->presentMask |= 1u << axis;
+				pLayout->axisOffset[axis] = odf.dwOfs;
+				break;
+			}
+		}
+	}
+}
+
+static bool IsZeroOnly(const FilterPlan& plan) {
+	for (uint32_t i = 0; i < plan.transformCount; ++i) {
+		const AxisTransform& t = plan.transforms[i];
+		if (!t.suppress) return false;
+	}
+	return true;
+}
+
+static bool IsStandardRxRy(const FilterPlan& plan) {
+	return plan.zeroCount == 2 &&
+		((plan.zeroOffsets[0] == kDiJoyOfsRx && plan.zeroOffsets[1] == kDiJoyOfsRy) ||
+		 (plan.zeroOffsets[0] == kDiJoyOfsRy && plan.zeroOffsets[1] == kDiJoyOfsRx));
+}
+
+void SetDefaultAxisRanges(DiAxisRange* pRanges) {
+	for (int axis = 0; axis < kAxisCount; ++axis) {
+		pRanges[axis] = kDiDefaultAxisRange;
+	}
+}
+
+static const int kAxisScaleShift = 30;
+
+static void BuildAxisScale(const DiAxisRange& src, const DiAxisRange& dst, AxisScale* pScale) {
+	pScale->srcMin = src.lMin;
+	pScale->srcMax = (std::max)(src.lMin, src.lMax);
+	pScale->dstMin = dst.lMin;
+	if (src.lMin == dst.lMin && src.lMax == dst.lMax) {
+		pScale->factor = 0;
+		return;
+	}
+	// Both spans fit in 32 bits, so the factor fits in 62 and, with the value clamped to the
+	// source range, so does the product in ScaleAxisValue.
+	int64_t srcSpan = (std::max)(static_cast<int64_t>(src.lMax) - src.lMin, static_cast<int64_t>(1));
+	int64_t dstSpan = (std::max)(static_cast<int64_t>(dst.lMax) - dst.lMin, static_cast<int64_t>(0));
+	pScale->factor = (std::max)((dstSpan << kAxisScaleShift) / srcSpan, static_cast<int64_t>(1));
+}
+
+// Deadzone in hundredths of a percent of the half-range, in the range's own units.
+static int32_t ScaleDeadzone(long deadzone, const DiAxisRange& range) {
+	if (deadzone <= 0) {
+		return 0;
+	}
+	int64_t halfSpan = ((static_cast<int64_t>(range.lMax) - range.lMin) / 2);
+	return static_cast<int32_t>((std::min)(static_cast<int64_t>(deadzone), static_cast<int64_t>(kDiPropScale)) * halfSpan / kDiPropScale);
+}
+
+void BuildFilterPlan(const FormatLayout& layout, const DiAxisRange* ranges, const FilterConfig& filter, FilterPlan* pPlan) {
+	pPlan->dataSize = layout.dataSize;
+	pPlan->zeroCount = 0;
+	pPlan->transformCount = 0;
+	pPlan->eventRuleCount = 0;
+	pPlan->suppressMask = filter.suppressMask;
+	for (int axis = 0; axis < kAxisCount; ++axis) {
+		pPlan->axisNeutral[axis] = GetAxisNeutral(ranges[axis]);
+	}
+
+	// State: one transform per game-visible axis that does not simply pass through.
+	for (int axis = 0; axis < kAxisCount; ++axis) {
+		if (!(layout.presentMask & (1u << axis))) continue;
+		int source = filter.remapSource[axis];
+		bool suppress = (filter.suppressMask & (1u << axis)) != 0;
+		if (!suppress && source == axis && filter.deadzone[axis] == 0) continue;
+
+		AxisTransform& t = pPlan->transforms[pPlan->transformCount++];
+		t.dstOffset = layout.axisOffset[axis];
+		t.srcOffset = (layout.presentMask & (1u << source)) ? layout.axisOffset[source] : kNoSourceAxis;
+		BuildAxisScale(ranges[source], ranges[axis], &t.scale);
+		t.neutral = pPlan->axisNeutral[axis];
+		t.deadzone = ScaleDeadzone(filter.deadzone[axis], ranges[axis]);
+		t.suppress = suppress;
+		if (suppress) {
+			pPlan->zeroOffsets[pPlan->zeroCount] = t.dstOffset;
+			pPlan->zeroValues[pPlan->zeroCount] = t.neutral;
+			++pPlan->zeroCount;
+		}
+	}
+
+	// Events: each physical axis feeds the first unsuppressed game axis that reads it, if any.
+	// An axis remapped to several game axes therefore only moves the first of them in
+	// buffered data.
+	if (layout.known) {
+		for (int source = 0; source < kAxisCount; ++source) {
+			if (!(layout.presentMask & (1u << source))) continue;
+			int target = -1;
+			for (int axis = 0; axis < kAxisCount; ++axis) {
+				if ((layout.presentMask & (1u << axis)) && filter.remapSource[axis] == source && !(filter.suppressMask & (1u << axis))) {
+					target = axis;
+					break;
+				}
+			}
+			if (target == source && filter.deadzone[target] == 0) continue;
+
+			EventRule& rule = pPlan->eventRules[pPlan->eventRuleCount++];
+			rule.srcOffset = layout.axisOffset[source];
+			rule.drop = target < 0;
+			if (target < 0) {
+				target = source;
+			}
+			rule.dstOffset = layout.axisOffset[target];
+			BuildAxisScale(ranges[source], ranges[target], &rule.scale);
+			rule.neutral = pPlan->axisNeutral[target];
+			rule.deadzone = rule.drop ? 0 : ScaleDeadzone(filter.deadzone[target], ranges[target]);
+		}
+	}
+
+	if (!layout.known) {
+		pPlan->stateKind = pPlan->transformCount ? kStatePolicySizeChecked : kStatePolicyPassThrough;
+	}
+	else if (pPlan->transformCount == 0) {
+		pPlan->stateKind = kStatePolicyPassThrough;
+	}
+	else if (!IsZeroOnly(*pPlan)) {
+		pPlan->stateKind = kStatePolicyGeneral;
+	}
+	else if (IsStandardRxRy(*pPlan) && layout.dataSize == sizeof(DiJoyState)) {
+		pPlan->stateKind = kStatePolicyJoyState;
+	}
+	else if (IsStandardRxRy(*pPlan) && layout.dataSize == sizeof(DiJoyState2)) {
+		pPlan->stateKind = kStatePolicyJoyState2;
+	}
+	else {
+		pPlan->stateKind = kStatePolicyZeroTable;
+	}
+}
+
+// An axis receives events if some rule delivers to it, or if no rule takes its own events
+// elsewhere.
+static bool ReceivesEvents(const FilterPlan& plan, uint32_t offset) {
+	bool ownEventsMoved = false;
+	for (uint32_t r = 0; r < plan.eventRuleCount; ++r) {
+		const EventRule& rule = plan.eventRules[r];
+		if (!rule.drop && rule.dstOffset == offset) {
+			return true;
+		}
+		if (rule.srcOffset == offset) {
+			ownEventsMoved = true;
+		}
+	}
+	return !ownEventsMoved;
+}
+
+uint32_t FindNewlySilencedAxes(const FormatLayout& layout, const FilterPlan& before, const FilterPlan& after, uint32_t* pAxes) {
+	uint32_t count = 0;
+	if (!layout.known) {
+		return 0;
+	}
+	for (int axis = 0; axis < kAxisCount; ++axis) {
+		if (!(layout.presentMask & (1u << axis))) continue;
+		uint32_t offset = layout.axisOffset[axis];
+		if (ReceivesEvents(before, offset) && !ReceivesEvents(after, offset)) {
+			pAxes[count++] = axis;
+		}
+	}
+	return count;
+}
+
+static inline int32_t ApplyDeadzone(int32_t value, int32_t neutral, int32_t deadzone) {
+	// In 64 bits: a device may report any LONG, and INT32_MIN - neutral overflows.
+	int64_t distance = static_cast<int64_t>(value) - neutral;
+	return (distance < deadzone && -distance < deadzone) ? neutral : value;
+}
+
+static inline int32_t ScaleAxisValue(const AxisScale& scale, int32_t value) {
+	if (scale.factor == 0) {
+		return value;
+	}
+	value = (std::min)((std::max)(value, scale.srcMin), scale.srcMax);
+	int64_t scaled = (static_cast<int64_t>(value) - scale.srcMin) * scale.factor + (static_cast<int64_t>(1) << (kAxisScaleShift - 1));
+	return static_cast<int32_t>(scale.dstMin + (scaled >> kAxisScaleShift));
+}
+
+void WriteNeutralState(const FormatLayout& layout, const FilterPlan& plan, uint32_t cbData, void* lpvData) {
+	uint8_t* pData = static_cast<uint8_t*>(lpvData);
+	memset(pData, 0, cbData);
+	if (cbData != layout.dataSize) {
+		return;
+	}
+	for (int axis = 0; axis < kAxisCount; ++axis) {
+		if (layout.presentMask & (1u << axis)) {
+			*reinterpret_cast<int32_t*>(pData + layout.axisOffset[axis]) = plan.axisNeutral[axis];
+		}
+	}
+	for (uint32_t pov = 0; pov < layout.povCount; ++pov) {
+		*reinterpret_cast<uint32_t*>(pData + layout.povOffset[pov]) = kDiPovCentered;
+	}
+}
+
+void ApplyZeroTable(const FilterPlan& plan, void* lpvData) {
+	uint8_t* pData = static_cast<uint8_t*>(lpvData);
+	for (uint32_t i = 0; i < plan.zeroCount; ++i) {
+		*reinterpret_cast<int32_t*>(pData + plan.zeroOffsets[i]) = plan.zeroValues[i];
+	}
+}
+
+void ApplyTransforms(const FilterPlan& plan, void* lpvData) {
+	uint8_t* pData = static_cast<uint8_t*>(lpvData);
+
+	// Read every source before writing anything, so swapped axes see the original values.
+	int32_t values[kAxisCount];
+	for (uint32_t i = 0; i < plan.transformCount; ++i) {
+		const AxisTransform& t = plan.transforms[i];
+		values[i] = t.srcOffset == kNoSourceAxis ? t.neutral : ScaleAxisValue(t.scale, *reinterpret_cast<const int32_t*>(pData + t.srcOffset));
+	}
+	for (uint32_t i = 0; i < plan.transformCount; ++i) {
+		const AxisTransform& t = plan.transforms[i];
+		int32_t value = t.suppress ? t.neutral : ApplyDeadzone(values[i], t.neutral, t.deadzone);
+		*reinterpret_cast<int32_t*>(pData + t.dstOffset) = value;
+	}
+}
+
+uint32_t CompactEvents(const FilterPlan& plan, void* rgdod, uint32_t count, uint32_t cbObjectData) {
+	uint8_t* pRead = static_cast<uint8_t*>(rgdod);
+	uint8_t* pWrite = pRead;
+	for (uint32_t i = 0; i < count; ++i, pRead += cbObjectData) {
+		// dwOfs and dwData are the first two fields of both the DX3 and the DX8 layout.
+		DiDeviceObjectDataDx3* pEvent = reinterpret_cast<DiDeviceObjectDataDx3*>(pRead);
+		const EventRule* pRule = nullptr;
+		for (uint32_t r = 0; r < plan.eventRuleCount; ++r) {
+			if (plan.eventRules[r].srcOffset == pEvent->dwOfs) {
+				pRule = &plan.eventRules[r];
+				break;
+			}
+		}
+		if (pRule && pRule->drop) {
+			continue;
+		}
+		if (pWrite != pRead) {
+			memmove(pWrite, pRead, cbObjectData);
+		}
+		if (pRule) {
+			DiDeviceObjectDataDx3* pOut = reinterpret_cast<DiDeviceObjectDataDx3*>(pWrite);
+			pOut->dwOfs = pRule->dstOffset;
+			int32_t value = ScaleAxisValue(pRule->scale, static_cast<int32_t>(pOut->dwData));
+			pOut->dwData = static_cast<uint32_t>(ApplyDeadzone(value, pRule->neutral, pRule->deadzone));
+		}
+		pWrite += cbObjectData;
+	}
+	return static_cast<uint32_t>((pWrite - static_cast<uint8_t*>(rgdod)) / cbObjectData);
+}
@@ -0,0 +1,150 @@
+// filter.h
+//
+// Axis filtering shared by GetDeviceState and GetDeviceData.
+// A FormatLayout records where each axis sits in the game's data format and is built once per
+// SetDataFormat. A FilterPlan combines a layout, the axes' DIPROP_RANGE and the current
+// FilterConfig, and is rebuilt only when one of them changes, so the per-poll work is a
+// handful of loads, stores and integer multiplies.
+
+#pragma once
+
+#include <cstdint>
+
+#include "config_parse.h"
+#include "dinput_types.h"
+
+struct FormatLayout {
+	// False until a data format has been seen through the wrapper.
+	bool known;
+	uint32_t dataSize;
+	// Bit (1 << AxisIndex) for every position axis the format carries.
+	unsigned presentMask;
+	uint32_t axisOffset[kAxisCount];
+	// POV hats, which only matter for WriteNeutralState.
+	uint32_t povCount;
+	uint32_t povOffset[4];
+};
+
+// Largest data format the filter will interpret. Real formats are at most a few hundred bytes.
+static const uint32_t kMaxDataFormatSize = 64 * 1024;
+
+// Checks the structural invariants the filter relies on: the header and object sizes match
+// this build's structures, dwDataSize is a non-zero multiple of 4 no larger than
+// kMaxDataFormatSize, and there are no more objects than bytes of data.
+bool ValidateDataFormat(const DiDataFormat* lpdf);
+
+// True for sizeof(DIDEVICEOBJECTDATA) and sizeof(DIDEVICEOBJECTDATA_DX3), the only record
+// sizes CompactEvents handles.
+inline bool IsValidObjectDataSize(uint32_t cbObjectData) {
+	return cbObjectData == sizeof(DiDeviceObjectData) || cbObjectData == sizeof(DiDeviceObjectDataDx3);
+}
+
+// Fills pLayout from a data format the real device has already accepted. A format that fails
+// ValidateDataFormat yields the default layout, which is filtered only by size check. Every
+// offset in a known layout is 4-byte aligned and leaves room for a LONG inside dataSize, so
+// the state kernels index the game's buffer without further checks.
+void BuildFormatLayout(const DiDataFormat* lpdf, FormatLayout* pLayout);
+
+// The AxisIndex whose position GUID is guid, or -1. Both sliders share GUID_Slider, which
+// yields kAxisSlider0.
+int FindAxisByGuid(const DiGuid& guid);
+
+// The standard DIJOYSTATE layout, marked unknown. Used until SetDataFormat is seen.
+void SetDefaultFormatLayout(FormatLayout* pLayout);
+
+// How GetDeviceState applies a plan. Each kind has its own compile-time policy in the
+// device wrapper.
+enum StatePolicyKind {
+	kStatePolicyPassThrough,
+	// Layout unknown: apply the general transform only if cbData is sizeof(DIJOYSTATE).
+	kStatePolicySizeChecked,
+	// Only lRx/lRy zeroed, in a DIJOYSTATE or DIJOYSTATE2 sized format.
+	kStatePolicyJoyState,
+	kStatePolicyJoyState2,
+	// Only whole axes zeroed, at arbitrary offsets.
+	kStatePolicyZeroTable,
+	// Remaps or deadzones involved.
+	kStatePolicyGeneral,
+};
+
+static const uint32_t kNoSourceAxis = 0xFFFFFFFF;
+
+// The centre of a range, which is what a suppressed axis reads.
+inline int32_t GetAxisNeutral(const DiAxisRange& range) {
+	return static_cast<int32_t>(range.lMin + (static_cast<int64_t>(range.lMax) - range.lMin) / 2);
+}
+
+// Maps a value in a physical axis's range onto the range of the game axis it is remapped to.
+struct AxisScale {
+	int32_t srcMin;
+	int32_t srcMax;
+	int32_t dstMin;
+	// dstSpan / srcSpan with 30 fractional bits, or 0 when the ranges are the same and values
+	// pass unchanged.
+	int64_t factor;
+};
+
+// One of the game's axes that does not simply pass through.
+struct AxisTransform {
+	uint32_t dstOffset;
+	// Offset to read from, or kNoSourceAxis if the remap source is not in the format.
+	uint32_t srcOffset;
+	AxisScale scale;
+	// Centre of the game axis's range, and the deadzone around it in the same units.
+	int32_t neutral;
+	int32_t deadzone;
+	bool suppress;
+};
+
+// What to do with a buffered event for one of the device's axes.
+struct EventRule {
+	uint32_t srcOffset;
+	uint32_t dstOffset;
+	AxisScale scale;
+	int32_t neutral;
+	int32_t deadzone;
+	bool drop;
+};
+
+struct FilterPlan {
+	StatePolicyKind stateKind;
+	uint32_t dataSize;
+	// Centre of each of the game's axes, by AxisIndex.
+	int32_t axisNeutral[kAxisCount];
+	uint32_t zeroCount;
+	uint32_t zeroOffsets[kAxisCount];
+	int32_t zeroValues[kAxisCount];
+	uint32_t transformCount;
+	AxisTransform transforms[kAxisCount];
+	uint32_t eventRuleCount;
+	EventRule eventRules[kAxisCount];
+	// The config's suppressed axes, by AxisIndex, for devices without a layout to apply them
+	// to (core/action_filter.h).
+	unsigned suppressMask;
+};
+
+// Every axis at DirectInput's default range. pRanges holds kAxisCount entries.
+void SetDefaultAxisRanges(DiAxisRange* pRanges);
+
+// ranges holds the DIPROP_RANGE of each axis by AxisIndex. Deadzones in filter are
+// hundredths of a percent of the game axis's half-range, like DIPROP_DEADZONE.
+void BuildFilterPlan(const FormatLayout& layout, const DiAxisRange* ranges, const FilterConfig& filter, FilterPlan* pPlan);
+
+// The game's axes (AxisIndex) that receive events under plan before but none under plan
+// after, both built from layout. The game last saw those axes wherever they were, so the
+// wrapper sends it one neutral event for each. pAxes must hold kAxisCount entries.
+// Returns the count.
+uint32_t FindNewlySilencedAxes(const FormatLayout& layout, const FilterPlan& before, const FilterPlan& after, uint32_t* pAxes);
+
+// What the device reads at rest in the game's format: every axis at its neutral value, POVs
+// centred, buttons up. Anything but a buffer of layout.dataSize is zeroed.
+void WriteNeutralState(const FormatLayout& layout, const FilterPlan& plan, uint32_t cbData, void* lpvData);
+
+// State kernels. lpvData must be at least plan.dataSize bytes.
+void ApplyZeroTable(const FilterPlan& plan, void* lpvData);
+void ApplyTransforms(const FilterPlan& plan, void* lpvData);
+
+// Rewrites a buffer of cbObjectData-sized DiDeviceObjectData(Dx3) records in place,
+// dropping suppressed axes and remapping the rest. Returns the number of records kept.
+// cbObjectData must pass IsValidObjectDataSize; the caller checks it once per batch.
+uint32_t CompactEvents(const FilterPlan& plan, void* rgdod, uint32_t count, uint32_t cbObjectData);
@@ -0,0 +1,59 @@
+// mock_device.cpp
+//
+// See mock_device.h.
+
+#include <algorithm>
+#include <cstring>
+
+#include "mock_device.h"
+
+MockDevice::MockDevice(uint32_t dataSize) : m_dataSize(dataSize), m_frameCount(0), m_nextFrame(0), m_nextSequence(1) {
+}
+
+void MockDevice::PushState(const void* pState) {
+	const uint8_t* pBytes = static_cast<const uint8_t*>(pState);
+	m_frames.insert(m_frames.end(), pBytes, pBytes + m_dataSize);
+	++m_frameCount;
+}
+
+void MockDevice::PushEvent(uint32_t dwOfs, uint32_t dwData, uint32_t dwTimeStamp) {
+	DiDeviceObjectData event = {};
+	event.dwOfs = dwOfs;
+	event.dwData = dwData;
+	event.dwTimeStamp = dwTimeStamp;
+	event.dwSequence = m_nextSequence++;
+	m_events.push_back(event);
+}
+
+int32_t MockDevice::GetDeviceState(uint32_t cbData, void* lpvData) {
+	if (cbData != m_dataSize || !lpvData) {
+		return kDiErrInvalidParam;
+	}
+	if (m_frameCount == 0) {
+		memset(lpvData, 0, cbData);
+		return kDiOk;
+	}
+	memcpy(lpvData, &m_frames[m_nextFrame * m_dataSize], cbData);
+	m_nextFrame = (m_nextFrame + 1) % m_frameCount;
+	return kDiOk;
+}
+
+int32_t MockDevice::GetDeviceData(uint32_t cbObjectData, void* rgdod, uint32_t* pdwInOut, uint32_t dwFlags) {
+	if (!pdwInOut || (cbObjectData != sizeof(DiDeviceObjectData) && cbObjectData != sizeof(DiDeviceObjectDataDx3))) {
+		return kDiErrInvalidParam;
+	}
+
+	uint32_t count = static_cast<uint32_t>((std::min)(static_cast<size_t>(*pdwInOut), m_events.size()));
+	if (rgdod) {
+		uint8_t* pOut = static_cast<uint8_t*>(rgdod);
+		for (uint32_t i = 0; i < count; ++i, pOut += cbObjectData) {
+			// The DX3 record is a prefix of the full one.
+			memcpy(pOut, &m_events[i], cbObjectData);
+		}
+	}
+	if (!(dwFlags & kDiGddPeek)) {
+		m_events.erase(m_events.begin(), m_events.begin() + count);
+	}
+	*pdwInOut = count;
+	return kDiOk;
+}
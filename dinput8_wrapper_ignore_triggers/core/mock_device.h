@@ -0,0 +1,44 @@
+// mock_device.h
+//
+// A scripted stand-in for the polling half of IDirectInputDevice8, so the filter core can be
+// driven off Windows (benchmarks, replay). GetDeviceState and GetDeviceData take the same
+// arguments and make the same size checks as the real methods, without any of the COM.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "dinput_types.h"
+
+class MockDevice {
+public:
+	// dataSize is the data format's dwDataSize. GetDeviceState rejects any other cbData.
+	explicit MockDevice(uint32_t dataSize);
+
+	// Appends a dataSize-byte state frame. GetDeviceState returns the frames in order and
+	// starts over after the last one. With no frames it returns all zeroes.
+	void PushState(const void* pState);
+
+	// Queues a buffered event. Sequence numbers are assigned in push order.
+	void PushEvent(uint32_t dwOfs, uint32_t dwData, uint32_t dwTimeStamp);
+
+	int32_t GetDeviceState(uint32_t cbData, void* lpvData);
+
+	// rgdod may be null to count (with kDiGddPeek) or flush events, as with the real method.
+	int32_t GetDeviceData(uint32_t cbObjectData, void* rgdod, uint32_t* pdwInOut, uint32_t dwFlags);
+
+	uint32_t GetDataSize() const { return m_dataSize; }
+	size_t GetFrameCount() const { return m_frameCount; }
+	size_t GetPendingEventCount() const { return m_events.size(); }
+
+private:
+	uint32_t m_dataSize;
+	std::vector<uint8_t> m_frames;
+	size_t m_frameCount;
+	size_t m_nextFrame;
+	std::deque<DiDeviceObjectData> m_events;
+	uint32_t m_nextSequence;
+};
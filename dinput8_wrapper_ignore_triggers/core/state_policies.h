@@ -0,0 +1,89 @@
+// state_policies.h
+//
+// GetDeviceState filter policies. The device's FilterPlan (filter.h) names one of these; the
+// device wrapper runs the chosen one through a per-plan function pointer (GetStateApplyFn).
+// The real GetDeviceState fails unless cbData matches the format's dwDataSize, so after a
+// successful call the policies can write straight into the buffer without checking sizes again.
+
+#pragma once
+
+#include <cstdint>
+
+#include "dinput_types.h"
+#include "filter.h"
+
+// Nothing filtered in this format.
+struct PassThroughStatePolicy {
+	static void Apply(const FilterPlan&, uint32_t, void*) {}
+};
+
+// Before any SetDataFormat went through this wrapper (the format may have been set through
+// the other character width's wrapper). Same size test the wrapper always used.
+struct SizeCheckedStatePolicy {
+	static void Apply(const FilterPlan& plan, uint32_t cbData, void* lpvData) {
+		if (cbData == sizeof(DiJoyState)) {
+			ApplyTransforms(plan, lpvData);
+		}
+	}
+};
+
+// c_dfDIJoystick or an equivalent layout, with only Rx/Ry suppressed.
+struct JoyStatePolicy {
+	static void Apply(const FilterPlan& plan, uint32_t, void* lpvData) {
+		DiJoyState* state = static_cast<DiJoyState*>(lpvData);
+		state->lRx = plan.axisNeutral[kAxisRx];
+		state->lRy = plan.axisNeutral[kAxisRy];
+	}
+};
+
+// c_dfDIJoystick2 or an equivalent layout. Velocity, acceleration and force Rx/Ry are left
+// alone; only the position axes are the ones games mistake for a stick.
+struct JoyState2Policy {
+	static void Apply(const FilterPlan& plan, uint32_t, void* lpvData) {
+		DiJoyState2* state = static_cast<DiJoyState2*>(lpvData);
+		state->lRx = plan.axisNeutral[kAxisRx];
+		state->lRy = plan.axisNeutral[kAxisRy];
+	}
+};
+
+// Any other format where axes are only suppressed: write each offset's neutral value.
+struct ZeroTableStatePolicy {
+	static void Apply(const FilterPlan& plan, uint32_t, void* lpvData) {
+		ApplyZeroTable(plan, lpvData);
+	}
+};
+
+// Remaps and deadzones.
+struct GeneralStatePolicy {
+	static void Apply(const FilterPlan& plan, uint32_t, void* lpvData) {
+		ApplyTransforms(plan, lpvData);
+	}
+};
+
+// Applies whichever policy the plan names. For paths that are not worth a specialised
+// function pointer, such as replay.
+inline void ApplyStatePolicy(const FilterPlan& plan, uint32_t cbData, void* lpvData) {
+	switch (plan.stateKind) {
+	case kStatePolicySizeChecked: SizeCheckedStatePolicy::Apply(plan, cbData, lpvData); break;
+	case kStatePolicyJoyState: JoyStatePolicy::Apply(plan, cbData, lpvData); break;
+	case kStatePolicyJoyState2: JoyState2Policy::Apply(plan, cbData, lpvData); break;
+	case kStatePolicyZeroTable: ZeroTableStatePolicy::Apply(plan, cbData, lpvData); break;
+	case kStatePolicyGeneral: GeneralStatePolicy::Apply(plan, cbData, lpvData); break;
+	default: PassThroughStatePolicy::Apply(plan, cbData, lpvData); break;
+	}
+}
+
+typedef void (*StateApplyFn)(const FilterPlan& plan, uint32_t cbData, void* lpvData);
+
+// The policy the plan names as a function pointer, looked up once per plan so each
+// GetDeviceState makes one indirect call instead of switching on the kind.
+inline StateApplyFn GetStateApplyFn(StatePolicyKind kind) {
+	switch (kind) {
+	case kStatePolicySizeChecked: return &SizeCheckedStatePolicy::Apply;
+	case kStatePolicyJoyState: return &JoyStatePolicy::Apply;
+	case kStatePolicyJoyState2: return &JoyState2Policy::Apply;
+	case kStatePolicyZeroTable: return &ZeroTableStatePolicy::Apply;
+	case kStatePolicyGeneral: return &GeneralStatePolicy::Apply;
+	default: return &PassThroughStatePolicy::Apply;
+	}
+}
@@ -0,0 +1,257 @@
+// device_metadata.h
+//
+// Per-device cache of what DirectInput reports about a device rather than its input:
+// capabilities, instance info, object info and enumeration, and identity properties. Menus
+// that draw button glyphs ask for these every frame; each answer is fetched from the real
+// device once and served from memory afterwards.
+//
+// Object data depends on the data format (dwOfs, and DIPH_BYOFFSET lookups), so it is dropped
+// whenever the format changes, along with the capabilities, whose DIDC_POLLEDDATAFORMAT does
+// too. Capabilities include DIDC_ATTACHED, so they are also dropped when the device loses its
+// input. Setting the product or instance name drops the instance info that carries it. Calls
+// with structure sizes other than the current ones, and failures other than "no such object",
+// are passed through every time.
+
+#pragma once
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <dinput.h>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Properties that only change when the game sets them.
+enum MetadataProperty {
+	kMetadataPropertyProductName,
+	kMetadataPropertyInstanceName,
+	kMetadataPropertyVidPid,
+	kMetadataPropertyGuidAndPath,
+	kMetadataPropertyCount,
+	kMetadataPropertyNone = kMetadataPropertyCount
+};
+
+// DIPROP_* values are small integers cast to GUID references, so they compare by address.
+// *pSize receives the property structure's size.
+inline MetadataProperty GetMetadataProperty(REFGUID rguidProp, DWORD* pSize) {
+	if (&rguidProp == &DIPROP_PRODUCTNAME) {
+		*pSize = sizeof(DIPROPSTRING);
+		return kMetadataPropertyProductName;
+	}
+	if (&rguidProp == &DIPROP_INSTANCENAME) {
+		*pSize = sizeof(DIPROPSTRING);
+		return kMetadataPropertyInstanceName;
+	}
+	if (&rguidProp == &DIPROP_VIDPID) {
+		*pSize = sizeof(DIPROPDWORD);
+		return kMetadataPropertyVidPid;
+	}
+	if (&rguidProp == &DIPROP_GUIDANDPATH) {
+		*pSize = sizeof(DIPROPGUIDANDPATH);
+		return kMetadataPropertyGuidAndPath;
+	}
+	return kMetadataPropertyNone;
+}
+
+// Traits is one of the character-width traits in dllmain.cpp. Each call takes the real device
+// it came through; the cache is shared by every wrapper of that width for the device.
+template <class Traits>
+class DeviceMetadataCache {
+public:
+	typedef typename Traits::Device Device;
+	typedef typename Traits::DeviceInstance DeviceInstance;
+	typedef typename Traits::DeviceObjectInstance ObjectInstance;
+	typedef typename Traits::EnumDeviceObjectsCallback EnumObjectsCallback;
+
+	DeviceMetadataCache() : m_hasCaps(false), m_caps(), m_hasDeviceInfo(false), m_deviceInfo() {
+	}
+
+	HRESULT GetCapabilities(Device* pDevice, LPDIDEVCAPS lpDIDevCaps) {
+		return GetFixed(lpDIDevCaps, &m_hasCaps, &m_caps, [pDevice](LPDIDEVCAPS pOut) { return pDevice->GetCapabilities(pOut); });
+	}
+
+	HRESULT GetDeviceInfo(Device* pDevice, DeviceInstance* pdidi) {
+		return GetFixed(pdidi, &m_hasDeviceInfo, &m_deviceInfo, [pDevice](DeviceInstance* pOut) { return pDevice->GetDeviceInfo(pOut); });
+	}
+
+	HRESULT GetObjectInfo(Device* pDevice, ObjectInstance* pdidoi, DWORD dwObj, DWORD dwHow) {
+		if (!pdidoi || pdidoi->dwSize != sizeof(ObjectInstance)) {
+			return pDevice->GetObjectInfo(pdidoi, dwObj, dwHow);
+		}
+		uint64_t key = (static_cast<uint64_t>(dwHow) << 32) | dwObj;
+		AcquireSRWLockShared(&m_lock);
+		auto it = m_objectInfo.find(key);
+		bool found = it != m_objectInfo.end();
+		HRESULT hr = found ? it->second.hr : DI_OK;
+		if (found && SUCCEEDED(hr)) {
+			*pdidoi = it->second.instance;
+		}
+		ReleaseSRWLockShared(&m_lock);
+		if (found) {
+			return hr;
+		}
+
+		hr = pDevice->GetObjectInfo(pdidoi, dwObj, dwHow);
+		// A missing object stays missing until the format changes; anything else may be
+		// transient.
+		if (SUCCEEDED(hr) || hr == DIERR_OBJECTNOTFOUND) {
+			ObjectInfoEntry entry = {};
+			entry.hr = hr;
+			if (SUCCEEDED(hr)) {
+				entry.instance = *pdidoi;
+			}
+			AcquireSRWLockExclusive(&m_lock);
+			m_objectInfo[key] = entry;
+			ReleaseSRWLockExclusive(&m_lock);
+		}
+		return hr;
+	}
+
+	// Replays the objects the real device enumerated for dwFlags. The list is held by
+	// reference while the game's callback runs, so the callback may call back into the
+	// device, even to change its format.
+	HRESULT EnumObjects(Device* pDevice, EnumObjectsCallback lpCallback, LPVOID pvRef, DWORD dwFlags) {
+		if (!lpCallback) {
+			return pDevice->EnumObjects(lpCallback, pvRef, dwFlags);
+		}
+		std::shared_ptr<const std::vector<ObjectInstance>> pObjects;
+		AcquireSRWLockShared(&m_lock);
+		auto it = m_enumerations.find(dwFlags);
+		if (it != m_enumerations.end()) {
+			pObjects = it->second;
+		}
+		ReleaseSRWLockShared(&m_lock);
+
+		if (!pObjects) {
+			std::shared_ptr<std::vector<ObjectInstance>> pCollected = std::make_shared<std::vector<ObjectInstance>>();
+			HRESULT hr = pDevice->EnumObjects(&CollectObject, pCollected.get(), dwFlags);
+			if (FAILED(hr)) {
+				return hr;
+			}
+			pObjects = pCollected;
+			AcquireSRWLockExclusive(&m_lock);
+			m_enumerations[dwFlags] = pObjects;
+			ReleaseSRWLockExclusive(&m_lock);
+		}
+
+		for (const ObjectInstance& object : *pObjects) {
+			if (lpCallback(&object, pvRef) == DIENUM_STOP) {
+				break;
+			}
+		}
+		return DI_OK;
+	}
+
+	// Serves a device-wide identity property. Returns false if the call has to go to the
+	// real device; *phr is the result otherwise.
+	bool GetProperty(Device* pDevice, REFGUID rguidProp, LPDIPROPHEADER pdiph, HRESULT* phr) {
+		DWORD size = 0;
+		MetadataProperty property = GetMetadataProperty(rguidProp, &size);
+		if (property == kMetadataPropertyNone || !pdiph || pdiph->dwSize != size || pdiph->dwHeaderSize != sizeof(DIPROPHEADER) || pdiph->dwHow != DIPH_DEVICE || pdiph->dwObj != 0) {
+			return false;
+		}
+		AcquireSRWLockShared(&m_lock);
+		const std::vector<BYTE>& cached = m_properties[property];
+		bool found = !cached.empty();
+		if (found) {
+			memcpy(pdiph, cached.data(), size);
+		}
+		ReleaseSRWLockShared(&m_lock);
+		if (found) {
+			*phr = DI_OK;
+			return true;
+		}
+
+		*phr = pDevice->GetProperty(rguidProp, pdiph);
+		if (SUCCEEDED(*phr)) {
+			const BYTE* pBytes = reinterpret_cast<const BYTE*>(pdiph);
+			AcquireSRWLockExclusive(&m_lock);
+			m_properties[property].assign(pBytes, pBytes + size);
+			ReleaseSRWLockExclusive(&m_lock);
+		}
+		return true;
+	}
+
+	// After a successful SetProperty, which may have changed one of the cached properties.
+	void OnSetProperty(REFGUID rguidProp) {
+		DWORD size = 0;
+		MetadataProperty property = GetMetadataProperty(rguidProp, &size);
+		if (property != kMetadataPropertyNone) {
+			AcquireSRWLockExclusive(&m_lock);
+			m_properties[property].clear();
+			// DIDEVICEINSTANCE carries both names.
+			if (property == kMetadataPropertyProductName || property == kMetadataPropertyInstanceName) {
+				m_hasDeviceInfo = false;
+			}
+			ReleaseSRWLockExclusive(&m_lock);
+		}
+	}
+
+	// After SetDataFormat or SetActionMap.
+	void InvalidateObjects() {
+		AcquireSRWLockExclusive(&m_lock);
+		m_objectInfo.clear();
+		m_enumerations.clear();
+		m_hasCaps = false;
+		ReleaseSRWLockExclusive(&m_lock);
+	}
+
+	// After the device loses its input.
+	void InvalidateCapabilities() {
+		AcquireSRWLockExclusive(&m_lock);
+		m_hasCaps = false;
+		ReleaseSRWLockExclusive(&m_lock);
+	}
+
+private:
+	struct ObjectInfoEntry {
+		HRESULT hr;
+		ObjectInstance instance;
+	};
+
+	// Structures whose dwSize must match this build's.
+	template <class T, class Fetch>
+	HRESULT GetFixed(T* pOut, bool* pHas, T* pCache, Fetch fetch) {
+		if (!pOut || pOut->dwSize != sizeof(T)) {
+			return fetch(pOut);
+		}
+		AcquireSRWLockShared(&m_lock);
+		bool has = *pHas;
+		if (has) {
+			*pOut = *pCache;
+		}
+		ReleaseSRWLockShared(&m_lock);
+		if (has) {
+			return DI_OK;
+		}
+		HRESULT hr = fetch(pOut);
+		if (SUCCEEDED(hr)) {
+			AcquireSRWLockExclusive(&m_lock);
+			*pCache = *pOut;
+			*pHas = true;
+			ReleaseSRWLockExclusive(&m_lock);
+		}
+		return hr;
+	}
+
+	static BOOL CALLBACK CollectObject(const ObjectInstance* lpddoi, LPVOID pvRef) {
+		static_cast<std::vector<ObjectInstance>*>(pvRef)->push_back(*lpddoi);
+		return DIENUM_CONTINUE;
+	}
+
+	SRWLOCK m_lock = SRWLOCK_INIT;
+	bool m_hasCaps;
+	DIDEVCAPS m_caps;
+	bool m_hasDeviceInfo;
+	DeviceInstance m_deviceInfo;
+	// Keyed by dwHow in the high half and dwObj in the low half.
+	std::unordered_map<uint64_t, ObjectInfoEntry> m_objectInfo;
+	// Keyed by the EnumObjects flags.
+	std::unordered_map<DWORD, std::shared_ptr<const std::vector<ObjectInstance>>> m_enumerations;
+	// Whole property structures, empty until fetched.
+	std::vector<BYTE> m_properties[kMetadataPropertyCount];
+};
@@ -12,7 +12,9 @@
 // 2. Create a new "Dynamic-Link Library (DLL)" project.
 // 3. Add this file (`dinput8_wrapper.cpp`) and the `dinput8.def` file to the project.
 // 4. Go to Project Properties -> Linker -> Input -> Module Definition File and enter "dinput8.def".
-// 5. Make sure to link against `dinput8.lib` and `dxguid.lib`.
+// 5. Make sure to link against `dxguid.lib` for the DirectInput GUIDs, and NOT against
+//    `dinput8.lib`: its imports name `dinput8.dll`, which is this DLL. Every real entry point
+//    is resolved at runtime from the system DLL instead, see LoadRealDInput8.
 //    (Project Properties -> Linker -> Input -> Additional Dependencies).
 // 6. Build the project for the target architecture (x86 for 32-bit games, x64 for 64-bit games).
 //
@@ -24,141 +26,1029 @@
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #include <dinput.h>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
 #include <vector>
-#include <string>
-#include <fstream>
-#include <chrono>
-#include <ctime>
-#include <sstream>
-#include <iostream>
-#include <iomanip>
-
-#pragma comment(lib, "dinput8.lib")
+
+#include "capture.h"
+#include "config.h"
+#include "core/action_filter.h"
+#include "core/buffered_events.h"
+#include "core/event_sequence.h"
+#include "core/filter.h"
+#include "core/state_policies.h"
+#include "device_metadata.h"
+#include "effect_wrapper.h"
+#include "epoch_snapshot.h"
+#include "log.h"
+#include "recovery.h"
+#include "slab_pool.h"
+#include "stats.h"
+#include "wrapper_registry.h"
+
 #pragma comment(lib, "dxguid.lib")
 
-// LOGGING: Simple function to write messages to a log file.
-void Log(const std::string& message) {
-	// Check environment variable DINPUT8_LOG_ENABLE
-	char envBuffer[16];
-	DWORD result = GetEnvironmentVariableA("DINPUT8_LOG_ENABLE", envBuffer, sizeof(envBuffer));
+// Forward declaration of our own export, so chain-loading can recognise it.
+extern "C" HRESULT WINAPI DirectInput8Create(HINSTANCE hinst, DWORD dwVersion, REFIID riid, LPVOID* ppvOut, LPUNKNOWN punkOuter);
+
+// --- Real dinput8.dll ---
+// The system DLL, the optional next-in-chain proxy and every export we forward to are
+// resolved exactly once, by whichever thread gets there first. InitOnceExecuteOnce makes
+// concurrent first callers wait for that thread; afterwards GetRealDInput8() is a single
+// acquire load of g_pRealDInput8.
+typedef HRESULT(WINAPI* DirectInput8Create_t)(HINSTANCE, DWORD, REFIID, LPVOID*, LPUNKNOWN);
+typedef HRESULT(WINAPI* DllCanUnloadNow_t)();
+typedef HRESULT(WINAPI* DllGetClassObject_t)(REFCLSID, REFIID, LPVOID*);
+typedef HRESULT(WINAPI* DllRegisterServer_t)();
+typedef HRESULT(WINAPI* DllUnregisterServer_t)();
+typedef LPCDIDATAFORMAT(WINAPI* GetdfDIJoystick_t)();
+
+// The exports besides DirectInput8Create, see "Forwarded exports". Each is null if the DLL it
+// was resolved from does not export it.
+struct ForwardedExports {
+	DllCanUnloadNow_t pfnDllCanUnloadNow;
+	DllGetClassObject_t pfnDllGetClassObject;
+	DllRegisterServer_t pfnDllRegisterServer;
+	DllUnregisterServer_t pfnDllUnregisterServer;
+	GetdfDIJoystick_t pfnGetdfDIJoystick;
+};
+
+struct RealDInput8 {
+	// Next DLL down the chain: the proxy named by DINPUT8_CHAIN_DLL, or the system DLL.
+	HMODULE hModule;
+	DirectInput8Create_t pfnDirectInput8Create;
+	// Always the system DLL. Used when the chained proxy calls back into us.
+	HMODULE hSystemModule;
+	DirectInput8Create_t pfnSystemDirectInput8Create;
+	// Taken from the chained proxy when it has them, otherwise from the system DLL.
+	ForwardedExports exports;
+	// Always from the system DLL, like pfnSystemDirectInput8Create.
+	ForwardedExports systemExports;
+};
+
+static HMODULE g_hThisModule = nullptr;
+static RealDInput8 g_realDInput8 = {};
+static std::atomic<const RealDInput8*> g_pRealDInput8(nullptr);
+static INIT_ONCE g_realDInput8InitOnce = INIT_ONCE_STATIC_INIT;
+
+// Set while this thread is inside the chained proxy's DirectInput8Create. A proxy that loads
+// "dinput8.dll" by name gets us back, so seeing this set on entry means the chain looped.
+static thread_local int t_chainDepth = 0;
+
+// Marks a call into the next DLL down the chain for the duration of the scope.
+struct ChainCallScope {
+	ChainCallScope() { ++t_chainDepth; }
+	~ChainCallScope() { --t_chainDepth; }
+};
 
-	if (result > 0 && (std::string(envBuffer) == "1" || _stricmp(envBuffer, "true") == 0)) {
-		std::ofstream log_file("dinput8-wrapper.log", std::ios_base::out | std::ios_base::app);
-		if (log_file.is_open()) {
-			auto now = std::chrono::system_clock::now();
-			std::time_t time = std::chrono::system_clock::to_time_t(now);
-			char time_str[26];
-			ctime_s(time_str, sizeof(time_str), &time);
-			time_str[strlen(time_str) - 1] = '\0'; // Remove newline
-			log_file << "[" << time_str << "] " << message << std::endl;
+// True if pfn is code in this wrapper. A chained proxy that forwards its exports to
+// "dinput8.<name>" resolves them back to us, since we are the dinput8.dll already loaded, and
+// calling such an export would recurse until the stack runs out.
+static bool IsOwnExport(FARPROC pfn) {
+	HMODULE hOwner = nullptr;
+	return GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT, reinterpret_cast<LPCWSTR>(pfn), &hOwner) && hOwner == g_hThisModule;
+}
+
+// Reads DINPUT8_CHAIN_DLL, falling back to [chain] dll in the config file. Relative paths are
+// taken relative to the directory this wrapper was loaded from, so "dinput8_next.dll" finds a
+// proxy sitting next to us.
+static bool GetChainDllPath(char* szPath, DWORD cchPath) {
+	char szEnv[MAX_PATH];
+	DWORD len = GetEnvironmentVariableA("DINPUT8_CHAIN_DLL", szEnv, sizeof(szEnv));
+	if (len >= sizeof(szEnv)) {
+		return false;
+	}
+	if (len == 0) {
+		ConfigReadGuard config;
+		if (config->chainDll[0] == '\0' || strcpy_s(szEnv, config->chainDll) != 0) {
+			return false;
 		}
 	}
+	return ResolveModulePath(szEnv, szPath, cchPath);
 }
 
-// Overload for wide strings (used in Unicode wrappers)
-void Log(const std::wstring& message) {
-	// Check environment variable DINPUT8_LOG_ENABLE
-	char envBuffer[16];
-	DWORD result = GetEnvironmentVariableA("DINPUT8_LOG_ENABLE", envBuffer, sizeof(envBuffer));
+// Loads the configured next-in-chain proxy. Returns false, leaving the system DLL in place,
+// if none is configured or the configured one is unusable.
+static bool LoadChainedDInput8(HMODULE* phMod, DirectInput8Create_t* ppfnCreate) {
+	char szChainPath[MAX_PATH];
+	if (!GetChainDllPath(szChainPath, MAX_PATH)) {
+		return false;
+	}
 
-	if (result > 0 && (std::string(envBuffer) == "1" || _stricmp(envBuffer, "true") == 0)) {
-		std::wofstream log_file("dinput8-wrapper.log", std::ios_base::out | std::ios_base::app);
-		if (log_file.is_open()) {
-			auto now = std::chrono::system_clock::now();
-			std::time_t time = std::chrono::system_clock::to_time_t(now);
-			char time_str[26];
-			ctime_s(time_str, sizeof(time_str), &time);
-			time_str[strlen(time_str) - 1] = '\0'; // Remove newline
-			log_file << L"[" << time_str << L"] " << message << std::endl;
-		}
+	HMODULE hMod = LoadLibraryA(szChainPath);
+	if (!hMod) {
+		Log("Failed to load chained dinput8 proxy: %s", szChainPath);
+		return false;
 	}
+	if (hMod == g_hThisModule) {
+		Log("DINPUT8_CHAIN_DLL points back at this wrapper. Ignoring it.");
+		FreeLibrary(hMod);
+		return false;
+	}
+
+	FARPROC pfnCreate = GetProcAddress(hMod, "DirectInput8Create");
+	if (!pfnCreate || pfnCreate == reinterpret_cast<FARPROC>(&DirectInput8Create) || IsOwnExport(pfnCreate)) {
+		Log("Chained dinput8 proxy has no usable DirectInput8Create: %s", szChainPath);
+		FreeLibrary(hMod);
+		return false;
+	}
+
+	*phMod = hMod;
+	*ppfnCreate = (DirectInput8Create_t)pfnCreate;
+	Log("Chain-loading dinput8 proxy: %s", szChainPath);
+	return true;
 }
 
-// Forward declarations for our wrapper classes
-class WrapperIDirectInput8A;
-class WrapperIDirectInputDevice8A;
+// Looks an export up on hModule, falling back to the system DLL if hModule lacks it or only
+// forwards it back to us.
+static FARPROC GetRealExport(HMODULE hModule, HMODULE hSystemModule, const char* name) {
+	FARPROC pfn = GetProcAddress(hModule, name);
+	if ((!pfn || IsOwnExport(pfn)) && hModule != hSystemModule) {
+		pfn = GetProcAddress(hSystemModule, name);
+	}
+	return (pfn && !IsOwnExport(pfn)) ? pfn : nullptr;
+}
 
-// Global pointer to the real DirectInput8Create function
-typedef HRESULT(WINAPI* DirectInput8Create_t)(HINSTANCE, DWORD, REFIID, LPVOID*, LPUNKNOWN);
-static DirectInput8Create_t g_pfnDirectInput8Create = nullptr;
+static void ResolveForwardedExports(HMODULE hModule, HMODULE hSystemModule, ForwardedExports* pExports) {
+	pExports->pfnDllCanUnloadNow = (DllCanUnloadNow_t)GetRealExport(hModule, hSystemModule, "DllCanUnloadNow");
+	pExports->pfnDllGetClassObject = (DllGetClassObject_t)GetRealExport(hModule, hSystemModule, "DllGetClassObject");
+	pExports->pfnDllRegisterServer = (DllRegisterServer_t)GetRealExport(hModule, hSystemModule, "DllRegisterServer");
+	pExports->pfnDllUnregisterServer = (DllUnregisterServer_t)GetRealExport(hModule, hSystemModule, "DllUnregisterServer");
+	pExports->pfnGetdfDIJoystick = (GetdfDIJoystick_t)GetRealExport(hModule, hSystemModule, "GetdfDIJoystick");
+}
+
+// InitOnce callback. Returning FALSE leaves the INIT_ONCE unsignaled so a later call retries.
+static BOOL CALLBACK LoadRealDInput8(PINIT_ONCE, PVOID, PVOID*) {
+	char szSystemPath[MAX_PATH];
+	UINT len = GetSystemDirectoryA(szSystemPath, MAX_PATH);
+	if (len == 0 || len >= MAX_PATH) {
+		Log("GetSystemDirectoryA failed.");
+		return FALSE;
+	}
+	strcat_s(szSystemPath, "\\dinput8.dll");
+
+	HMODULE hSystemMod = LoadLibraryA(szSystemPath);
+	if (!hSystemMod) {
+		Log("Failed to load the real dinput8.dll.");
+		return FALSE;
+	}
+
+	DirectInput8Create_t pfnSystemCreate = (DirectInput8Create_t)GetProcAddress(hSystemMod, "DirectInput8Create");
+	if (!pfnSystemCreate) {
+		Log("The real dinput8.dll does not export DirectInput8Create.");
+		FreeLibrary(hSystemMod);
+		return FALSE;
+	}
+
+	g_realDInput8.hSystemModule = hSystemMod;
+	g_realDInput8.pfnSystemDirectInput8Create = pfnSystemCreate;
+	if (!LoadChainedDInput8(&g_realDInput8.hModule, &g_realDInput8.pfnDirectInput8Create)) {
+		g_realDInput8.hModule = hSystemMod;
+		g_realDInput8.pfnDirectInput8Create = pfnSystemCreate;
+	}
+
+	ResolveForwardedExports(g_realDInput8.hModule, hSystemMod, &g_realDInput8.exports);
+	ResolveForwardedExports(hSystemMod, hSystemMod, &g_realDInput8.systemExports);
+
+	g_pRealDInput8.store(&g_realDInput8, std::memory_order_release);
+	Log("Real dinput8.dll loaded.");
+	return TRUE;
+}
+
+// Returns the resolved real DLL, or nullptr if it could not be loaded.
+static const RealDInput8* GetRealDInput8() {
+	const RealDInput8* pReal = g_pRealDInput8.load(std::memory_order_acquire);
+	if (pReal) {
+		return pReal;
+	}
+	InitOnceExecuteOnce(&g_realDInput8InitOnce, LoadRealDInput8, nullptr, nullptr);
+	return g_pRealDInput8.load(std::memory_order_acquire);
+}
+
+// --- Character-width traits ---
+// Everything that differs between the ANSI and Unicode interfaces. The wrappers below are
+// written once against these and instantiated for both, so a change to the filtering or
+// pass-through logic always lands in both variants.
+struct DInputTraitsW;
+
+struct DInputTraitsA {
+	typedef DInputTraitsW Other;
+	typedef IDirectInput8A DInput;
+	typedef IDirectInputDevice8A Device;
+	typedef LPCSTR String;
+	typedef DIDEVICEINSTANCEA DeviceInstance;
+	typedef DIDEVICEOBJECTINSTANCEA DeviceObjectInstance;
+	typedef DIEFFECTINFOA EffectInfo;
+	typedef DIACTIONFORMATA ActionFormat;
+	typedef DIDEVICEIMAGEINFOHEADERA DeviceImageInfoHeader;
+	typedef DICONFIGUREDEVICESPARAMSA ConfigureDevicesParams;
+	typedef LPDIENUMDEVICEOBJECTSCALLBACKA EnumDeviceObjectsCallback;
+	typedef LPDIENUMEFFECTSCALLBACKA EnumEffectsCallback;
+	typedef LPDIENUMDEVICESCALLBACKA EnumDevicesCallback;
+	typedef LPDIENUMDEVICESBYSEMANTICSCBA EnumDevicesBySemanticsCallback;
+
+	static const IID& DInputIID() { return IID_IDirectInput8A; }
+	static const IID& DeviceIID() { return IID_IDirectInputDevice8A; }
+	static const char* Suffix() { return "A"; }
+	// Index of this width's wrapper in DeviceState.
+	static int Width() { return 0; }
+};
+
+struct DInputTraitsW {
+	typedef DInputTraitsA Other;
+	typedef IDirectInput8W DInput;
+	typedef IDirectInputDevice8W Device;
+	typedef LPCWSTR String;
+	typedef DIDEVICEINSTANCEW DeviceInstance;
+	typedef DIDEVICEOBJECTINSTANCEW DeviceObjectInstance;
+	typedef DIEFFECTINFOW EffectInfo;
+	typedef DIACTIONFORMATW ActionFormat;
+	typedef DIDEVICEIMAGEINFOHEADERW DeviceImageInfoHeader;
+	typedef DICONFIGUREDEVICESPARAMSW ConfigureDevicesParams;
+	typedef LPDIENUMDEVICEOBJECTSCALLBACKW EnumDeviceObjectsCallback;
+	typedef LPDIENUMEFFECTSCALLBACKW EnumEffectsCallback;
+	typedef LPDIENUMDEVICESCALLBACKW EnumDevicesCallback;
+	typedef LPDIENUMDEVICESBYSEMANTICSCBW EnumDevicesBySemanticsCallback;
+
+	static const IID& DInputIID() { return IID_IDirectInput8W; }
+	static const IID& DeviceIID() { return IID_IDirectInputDevice8W; }
+	static const char* Suffix() { return "W"; }
+	static int Width() { return 1; }
+};
+
+// Product names come back as CHAR or WCHAR depending on the interface; the log is UTF-8.
+// Names that do not fit are cut short.
+template <size_t N>
+static void ToUtf8(const char* str, char (&szOut)[N]) {
+	strncpy_s(szOut, N, str, _TRUNCATE);
+}
+
+template <size_t N>
+static void ToUtf8(const wchar_t* str, char (&szOut)[N]) {
+	if (WideCharToMultiByte(CP_UTF8, 0, str, -1, szOut, static_cast<int>(N), nullptr, nullptr) == 0) {
+		szOut[0] = '\0';
+	}
+}
+
+// --- Filter core glue ---
+// The core (core/) works on plain mirrors of the DirectInput structures so it can build
+// without the Windows headers. These checks make sure the mirrors match the real layouts, so
+// the wrapper can hand the game's buffers to the core as they are.
+static_assert(sizeof(DiGuid) == sizeof(GUID), "DiGuid must mirror GUID");
+static_assert(sizeof(DiObjectDataFormat) == sizeof(DIOBJECTDATAFORMAT), "DiObjectDataFormat must mirror DIOBJECTDATAFORMAT");
+static_assert(offsetof(DiObjectDataFormat, dwFlags) == offsetof(DIOBJECTDATAFORMAT, dwFlags), "DiObjectDataFormat must mirror DIOBJECTDATAFORMAT");
+static_assert(sizeof(DiDataFormat) == sizeof(DIDATAFORMAT), "DiDataFormat must mirror DIDATAFORMAT");
+static_assert(offsetof(DiDataFormat, rgodf) == offsetof(DIDATAFORMAT, rgodf), "DiDataFormat must mirror DIDATAFORMAT");
+static_assert(sizeof(DiJoyState) == sizeof(DIJOYSTATE), "DiJoyState must mirror DIJOYSTATE");
+static_assert(sizeof(DiJoyState2) == sizeof(DIJOYSTATE2), "DiJoyState2 must mirror DIJOYSTATE2");
+static_assert(offsetof(DiJoyState2, rglFSlider) == offsetof(DIJOYSTATE2, rglFSlider), "DiJoyState2 must mirror DIJOYSTATE2");
+static_assert(kDiJoyOfsRx == DIJOFS_RX && kDiJoyOfsRy == DIJOFS_RY && kDiJoyOfsSlider1 == DIJOFS_SLIDER(1), "DIJOFS mirrors");
+static_assert(sizeof(DiDeviceObjectDataDx3) == sizeof(DIDEVICEOBJECTDATA_DX3), "DiDeviceObjectDataDx3 must mirror DIDEVICEOBJECTDATA_DX3");
+static_assert(sizeof(DiDeviceObjectData) == sizeof(DIDEVICEOBJECTDATA), "DiDeviceObjectData must mirror DIDEVICEOBJECTDATA");
+static_assert(offsetof(DiDeviceObjectData, uAppData) == offsetof(DIDEVICEOBJECTDATA, uAppData), "DiDeviceObjectData must mirror DIDEVICEOBJECTDATA");
+
+static inline const DiDataFormat* AsDiDataFormat(LPCDIDATAFORMAT lpdf) {
+	return reinterpret_cast<const DiDataFormat*>(lpdf);
+}
+
+// Axis properties the device wrapper caches, see DeviceState::ranges.
+enum AxisProperty {
+	kAxisPropertyNone,
+	kAxisPropertyRange,
+	kAxisPropertyDeadzone,
+	kAxisPropertySaturation
+};
+
+// DIPROP_* values are small integers cast to GUID references, so they compare by address.
+static AxisProperty GetAxisProperty(REFGUID rguidProp) {
+	if (&rguidProp == &DIPROP_RANGE) return kAxisPropertyRange;
+	if (&rguidProp == &DIPROP_DEADZONE) return kAxisPropertyDeadzone;
+	if (&rguidProp == &DIPROP_SATURATION) return kAxisPropertySaturation;
+	return kAxisPropertyNone;
+}
+
+// What the device wrapper knows about the real device's acquisition. Unknown whenever the
+// device may have changed state without the wrapper seeing it.
+enum AcquireState {
+	kAcquireStateUnknown,
+	kAcquireStateAcquired,
+	kAcquireStateUnacquired
+};
+
+// --- Shared device state ---
+template <class Traits>
+class WrapperIDirectInputDevice8T;
+
+// Everything the wrappers know about one real device. The ANSI and Unicode interfaces of a
+// device are separate COM objects, so the state is keyed by the device's canonical IUnknown
+// and shared by the wrapper of each width: a format set through one width filters the reads
+// made through the other, and both number their events from the same sequence.
+class DeviceState final : public RegisteredWrapper, public SlabAllocated<DeviceState> {
+public:
+	// What the reads filter by: the layout and the plan built from it, with the GetDeviceState
+	// policy the plan selected. Immutable once published.
+	struct StateFilter {
+		FormatLayout layout;
+		StateApplyFn pfnApply;
+		FilterPlan plan;
+	};
+
+	// Layout of the game's current data format, written by SetDataFormat.
+	FormatLayout layout;
+	// The current StateFilter. Rebuilt by the calls that change what it is built from and by
+	// the config reload thread, never on the read path, and freed once no read still uses it.
+	EpochSnapshot<StateFilter> filter;
+	// DIPROP_RANGE, DIPROP_DEADZONE and DIPROP_SATURATION of each axis, by AxisIndex. Read back
+	// from the real device when the format or one of the properties changes, so neither the
+	// filter nor the game's GetProperty calls have to ask it again.
+	DiAxisRange ranges[kAxisCount];
+	DWORD deadzones[kAxisCount];
+	DWORD saturations[kAxisCount];
+	// Config generation the current filter was built from.
+	std::atomic<unsigned long> planGeneration;
+	// Guards layout and the property cache, and serializes rebuilds.
+	SRWLOCK rebuildLock;
+	// Identifies this device's records in capture mode.
+	unsigned short captureId;
+	// DIPROP_BUFFERSIZE the game asked for when the real device was given a larger one, else 0.
+	std::atomic<DWORD> gameBufferSize;
+	// The buffered-data path's sequence, owed neutral events and action table, under its lock.
+	BufferedEventState events;
+	// Whether the game last acquired the device rather than unacquired it.
+	std::atomic<bool> gameAcquired;
+	// The real device's acquisition as of the last call that changed or revealed it, so
+	// redundant Acquire and Unacquire calls are answered without reaching dinput8.
+	std::atomic<AcquireState> acquireState;
+	// Set while the recovery thread owns reacquiring the device (recovery.h). Reads then
+	// answer from lostError, the read error that started it, and the game's Acquire from
+	// acquireError, the recovery thread's last Acquire result.
+	std::atomic<bool> recovering;
+	std::atomic<HRESULT> lostError;
+	std::atomic<HRESULT> acquireError;
+	// Capabilities, instance and object info, see device_metadata.h. The structures differ by
+	// width, so each width has its own cache.
+	DeviceMetadataCache<DInputTraitsA> metadataA;
+	DeviceMetadataCache<DInputTraitsW> metadataW;
+	// Force-feedback effects created through either wrapper, see effect_wrapper.h.
+	EffectSet effects;
+
+	// Returns the state of the device pRealDevice belongs to with a reference added, creating
+	// it on first use.
+	static DeviceState* Get(IUnknown* pRealDevice) {
+		IUnknown* pIdentity = nullptr;
+		if (FAILED(pRealDevice->QueryInterface(IID_IUnknown, reinterpret_cast<LPVOID*>(&pIdentity))) || !pIdentity) {
+			// Not a conforming COM object; the best identity left is the pointer itself.
+			pIdentity = pRealDevice;
+			pIdentity->AddRef();
+		}
+		bool created = false;
+		DeviceState* pState = s_registry.FindOrCreate(pIdentity, [pIdentity]() { return new DeviceState(pIdentity); }, &created);
+		if (!created) {
+			pIdentity->Release();
+		}
+		else if (pState->planGeneration.load(std::memory_order_relaxed) != GetConfigGeneration()) {
+			// A reload published while the state was being built, before RebuildAll could see it.
+			pState->RebuildFilter(false);
+		}
+		return pState;
+	}
+
+	void Release() {
+		if (InterlockedDecrement(&m_refCount) == 0) {
+			s_registry.Remove(m_pIdentity, this);
+			m_pIdentity->Release();
+			delete this;
+		}
+	}
+
+	// Returns the device's wrapper of Traits' width with a reference added, creating it with
+	// create() if there is none. *pCreated as for WrapperRegistry::FindOrCreate.
+	template <class Traits, class Create>
+	WrapperIDirectInputDevice8T<Traits>* FindOrCreateWrapper(Create create, bool* pCreated) {
+		AcquireSRWLockExclusive(&m_wrapperLock);
+		RegisteredWrapper*& pSlot = m_pWrappers[Traits::Width()];
+		*pCreated = !pSlot || !pSlot->TryAddRef();
+		if (*pCreated) {
+			pSlot = create();
+		}
+		RegisteredWrapper* pWrapper = pSlot;
+		ReleaseSRWLockExclusive(&m_wrapperLock);
+		return static_cast<WrapperIDirectInputDevice8T<Traits>*>(pWrapper);
+	}
+
+	// Called by a wrapper whose count reached zero. The slot may already hold a newer wrapper.
+	void RemoveWrapper(int width, RegisteredWrapper* pWrapper) {
+		AcquireSRWLockExclusive(&m_wrapperLock);
+		if (m_pWrappers[width] == pWrapper) {
+			m_pWrappers[width] = nullptr;
+		}
+		ReleaseSRWLockExclusive(&m_wrapperLock);
+	}
+
+	// True while the game holds the device through the other width's wrapper.
+	bool HasOtherWrapper(int width) {
+		AcquireSRWLockShared(&m_wrapperLock);
+		bool hasOther = m_pWrappers[1 - width] != nullptr;
+		ReleaseSRWLockShared(&m_wrapperLock);
+		return hasOther;
+	}
+
+	template <class Traits>
+	DeviceMetadataCache<Traits>& GetMetadata();
+
+	// Format changes, lost input and property changes apply to the device, not to the width
+	// they came through.
+	void InvalidateObjects() {
+		metadataA.InvalidateObjects();
+		metadataW.InvalidateObjects();
+	}
+
+	void InvalidateCapabilities() {
+		metadataA.InvalidateCapabilities();
+		metadataW.InvalidateCapabilities();
+	}
+
+	void OnSetProperty(REFGUID rguidProp) {
+		metadataA.OnSetProperty(rguidProp);
+		metadataW.OnSetProperty(rguidProp);
+	}
+
+	static void SetDefaultAxisProperties(DiAxisRange* pRanges, DWORD* pDeadzones, DWORD* pSaturations) {
+		SetDefaultAxisRanges(pRanges);
+		for (int axis = 0; axis < kAxisCount; ++axis) {
+			pDeadzones[axis] = 0;
+			pSaturations[axis] = kDiPropScale;
+		}
+	}
+
+	// Builds a new StateFilter from layout and the current config snapshot and publishes it.
+	// layoutChanged is true when layout was just replaced, so the old plan's offsets mean
+	// nothing for the new one. Must not be called while pinning filter.
+	void RebuildFilter(bool layoutChanged) {
+		AcquireSRWLockExclusive(&rebuildLock);
+		StateFilter* pNext = new StateFilter;
+		pNext->layout = layout;
+		unsigned long generation;
+		{
+			ConfigReadGuard config;
+			BuildFilterPlan(layout, ranges, config->filter, &pNext->plan);
+			generation = config->generation;
+		}
+		pNext->pfnApply = GetStateApplyFn(pNext->plan.stateKind);
+		const StateFilter* pCurrent = filter.GetPublished();
+		uint32_t silenced[kAxisCount];
+		uint32_t silencedCount = (pCurrent && !layoutChanged) ? FindNewlySilencedAxes(layout, pCurrent->plan, pNext->plan, silenced) : 0;
+		delete filter.Publish(pNext);
+		planGeneration.store(generation, std::memory_order_relaxed);
+		if (layoutChanged || silencedCount > 0) {
+			uint32_t offsets[kAxisCount];
+			int32_t values[kAxisCount];
+			for (uint32_t i = 0; i < silencedCount; ++i) {
+				offsets[i] = layout.axisOffset[silenced[i]];
+				values[i] = pNext->plan.axisNeutral[silenced[i]];
+			}
+			QueueNeutralEvents(&events, layoutChanged, offsets, values, silencedCount);
+		}
+		ReleaseSRWLockExclusive(&rebuildLock);
+	}
+
+	// Config reload thread: rebuild every device's filter from the new snapshot.
+	static void RebuildAll() {
+		s_registry.ForEach([](DeviceState* pState) { pState->RebuildFilter(false); });
+	}
+
+	// A whole-device DIPROP_RANGE set before any data format: there are no offsets to read it
+	// back by, so take the game's values for every axis.
+	void SetDeviceRange(LPCDIPROPRANGE pdiprg) {
+		AcquireSRWLockExclusive(&rebuildLock);
+		for (int axis = 0; axis < kAxisCount; ++axis) {
+			ranges[axis].lMin = pdiprg->lMin;
+			ranges[axis].lMax = pdiprg->lMax;
+		}
+		ReleaseSRWLockExclusive(&rebuildLock);
+	}
+
+	// Answers GetProperty for a cached axis property. Returns false if the request is not one
+	// the cache covers: only DIPH_BYOFFSET for an axis of the current format is.
+	bool GetCachedAxisProperty(AxisProperty property, LPDIPROPHEADER pdiph) {
+		DWORD expectedSize = property == kAxisPropertyRange ? sizeof(DIPROPRANGE) : sizeof(DIPROPDWORD);
+		if (!pdiph || pdiph->dwSize != expectedSize || pdiph->dwHeaderSize != sizeof(DIPROPHEADER) || pdiph->dwHow != DIPH_BYOFFSET) {
+			return false;
+		}
+		bool found = false;
+		AcquireSRWLockShared(&rebuildLock);
+		for (int axis = 0; axis < kAxisCount && layout.known && !found; ++axis) {
+			if (!(layout.presentMask & (1u << axis)) || layout.axisOffset[axis] != pdiph->dwObj) continue;
+			found = true;
+			if (property == kAxisPropertyRange) {
+				reinterpret_cast<LPDIPROPRANGE>(pdiph)->lMin = ranges[axis].lMin;
+				reinterpret_cast<LPDIPROPRANGE>(pdiph)->lMax = ranges[axis].lMax;
+			}
+			else {
+				reinterpret_cast<LPDIPROPDWORD>(pdiph)->dwData = property == kAxisPropertyDeadzone ? deadzones[axis] : saturations[axis];
+			}
+		}
+		ReleaseSRWLockShared(&rebuildLock);
+		return found;
+	}
 
-// --- Wrapper for IDirectInputDevice8A ---
-// This class intercepts the device-specific calls. Note the explicit 'A' for ANSI.
-class WrapperIDirectInputDevice8A : public IDirectInputDevice8A {
 private:
-	IDirectInputDevice8A* m_pRealDevice;
+	explicit DeviceState(IUnknown* pIdentity) : layout(), filter(nullptr), ranges(), deadzones(), saturations(), planGeneration(0), rebuildLock(SRWLOCK_INIT), captureId(AllocateCaptureDeviceId()), gameBufferSize(0), events(), gameAcquired(false), acquireState(kAcquireStateUnknown), recovering(false), lostError(DI_OK), acquireError(DI_OK), metadataA(), metadataW(), effects(), m_pIdentity(pIdentity), m_wrapperLock(SRWLOCK_INIT), m_pWrappers() {
+		InitBufferedEventState(&events);
+		SetDefaultFormatLayout(&layout);
+		SetDefaultAxisProperties(ranges, deadzones, saturations);
+		RebuildFilter(true);
+	}
+
+	~DeviceState() {
+		delete filter.GetPublished();
+	}
+
+	// The real device's canonical IUnknown, with a reference held so the address cannot be
+	// reused by another object while it keys the registry.
+	IUnknown* m_pIdentity;
+	// Guards m_pWrappers. The wrappers hold references on the state, not the other way round.
+	SRWLOCK m_wrapperLock;
+	RegisteredWrapper* m_pWrappers[2];
+
+	// One state per real device, see wrapper_registry.h.
+	static WrapperRegistry<DeviceState> s_registry;
+};
+
+WrapperRegistry<DeviceState> DeviceState::s_registry;
+
+template <>
+DeviceMetadataCache<DInputTraitsA>& DeviceState::GetMetadata<DInputTraitsA>() {
+	return metadataA;
+}
+
+template <>
+DeviceMetadataCache<DInputTraitsW>& DeviceState::GetMetadata<DInputTraitsW>() {
+	return metadataW;
+}
+
+// --- Wrapper for IDirectInputDevice8A/W ---
+// This class intercepts the device-specific calls.
+template <class Traits>
+class WrapperIDirectInputDevice8T final : public Traits::Device, public RegisteredWrapper, public RecoverableDevice, public SlabAllocated<WrapperIDirectInputDevice8T<Traits>> {
+private:
+	typedef typename Traits::Device Device;
+	typedef DeviceState::StateFilter StateFilter;
+
+	Device* m_pRealDevice;
+	// Shared with the other width's wrapper for the same device. The wrapper holds a reference.
+	DeviceState& m_state;
+	DeviceMetadataCache<Traits>& m_metadata;
+
+	WrapperIDirectInputDevice8T(Device* pRealDevice, DeviceState& state) : m_pRealDevice(pRealDevice), m_state(state), m_metadata(state.GetMetadata<Traits>()) {
+		Log("WrapperIDirectInputDevice8%s created.", Traits::Suffix());
+	}
+
+	// Reads the cached axis properties back from the real device for every axis in the
+	// current format. Called after SetDataFormat and after the game sets one of them.
+	void RefreshAxisProperties() {
+		AcquireSRWLockShared(&m_state.rebuildLock);
+		FormatLayout layout = m_state.layout;
+		ReleaseSRWLockShared(&m_state.rebuildLock);
+
+		DiAxisRange ranges[kAxisCount];
+		DWORD deadzones[kAxisCount];
+		DWORD saturations[kAxisCount];
+		DeviceState::SetDefaultAxisProperties(ranges, deadzones, saturations);
+		if (!layout.known) {
+			// Without a format there are no offsets to ask about; keep what the game set for
+			// the whole device.
+			AcquireSRWLockShared(&m_state.rebuildLock);
+			std::copy(m_state.ranges, m_state.ranges + kAxisCount, ranges);
+			ReleaseSRWLockShared(&m_state.rebuildLock);
+		}
+		for (int axis = 0; axis < kAxisCount && layout.known; ++axis) {
+			if (!(layout.presentMask & (1u << axis))) continue;
+			DIPROPRANGE range = {};
+			range.diph.dwSize = sizeof(DIPROPRANGE);
+			range.diph.dwHeaderSize = sizeof(DIPROPHEADER);
+			range.diph.dwObj = layout.axisOffset[axis];
+			range.diph.dwHow = DIPH_BYOFFSET;
+			if (SUCCEEDED(m_pRealDevice->GetProperty(DIPROP_RANGE, &range.diph)) && range.lMin <= range.lMax) {
+				ranges[axis].lMin = range.lMin;
+				ranges[axis].lMax = range.lMax;
+			}
+			DIPROPDWORD value = {};
+			value.diph.dwSize = sizeof(DIPROPDWORD);
+			value.diph.dwHeaderSize = sizeof(DIPROPHEADER);
+			value.diph.dwObj = layout.axisOffset[axis];
+			value.diph.dwHow = DIPH_BYOFFSET;
+			if (SUCCEEDED(m_pRealDevice->GetProperty(DIPROP_DEADZONE, &value.diph))) {
+				deadzones[axis] = value.dwData;
+			}
+			if (SUCCEEDED(m_pRealDevice->GetProperty(DIPROP_SATURATION, &value.diph))) {
+				saturations[axis] = value.dwData;
+			}
+		}
+
+		AcquireSRWLockExclusive(&m_state.rebuildLock);
+		std::copy(ranges, ranges + kAxisCount, m_state.ranges);
+		std::copy(deadzones, deadzones + kAxisCount, m_state.deadzones);
+		std::copy(saturations, saturations + kAxisCount, m_state.saturations);
+		ReleaseSRWLockExclusive(&m_state.rebuildLock);
+		if (IsCaptureActive()) {
+			CaptureRanges(m_state.captureId, ranges, kAxisCount);
+		}
+	}
+
+	// Gives the real device at least the configured buffer, so events the filter drops cannot
+	// overflow the size the game asked for. GetProperty keeps reporting the game's size.
+	HRESULT SetBufferSize(LPCDIPROPDWORD pdipdw) {
+		DWORD requested = pdipdw->dwData;
+		DWORD configured;
+		{
+			ConfigReadGuard config;
+			configured = config->filter.bufferSize;
+		}
+		if (requested != 0 && configured > requested) {
+			DIPROPDWORD enlarged = *pdipdw;
+			enlarged.dwData = configured;
+			HRESULT hr = m_pRealDevice->SetProperty(DIPROP_BUFFERSIZE, &enlarged.diph);
+			if (SUCCEEDED(hr)) {
+				m_state.gameBufferSize.store(requested, std::memory_order_relaxed);
+				Log("SetProperty(DIPROP_BUFFERSIZE): %lu requested, %lu set.", requested, configured);
+				return hr;
+			}
+		}
+		HRESULT hr = m_pRealDevice->SetProperty(DIPROP_BUFFERSIZE, &pdipdw->diph);
+		if (SUCCEEDED(hr)) {
+			m_state.gameBufferSize.store(0, std::memory_order_relaxed);
+		}
+		return hr;
+	}
+
+	// Bookkeeping for every call to the real GetDeviceData.
+	void OnRealDeviceData(HRESULT hr, DWORD cbObjectData, const void* rgdod, DWORD count, DWORD dwFlags) {
+		if (IsCaptureActive() && rgdod) {
+			CaptureEvents(m_state.captureId, hr, cbObjectData, rgdod, SUCCEEDED(hr) ? count : 0, dwFlags);
+		}
+		if (hr == DI_BUFFEROVERFLOW) {
+			AddStat(kStatBufferOverflow);
+		}
+	}
+
+	// Fills the game's buffer with filtered events read from the real device
+	// (core/buffered_events.h). The record size was checked by the caller, so the core needs
+	// no per-event checks.
+	HRESULT GetFilteredDeviceData(const FilterPlan& plan, DWORD cbObjectData, LPDIDEVICEOBJECTDATA rgdod, LPDWORD pdwInOut, DWORD dwFlags) {
+		auto read = [&](uint8_t* pBatch, uint32_t* pCount) -> int32_t {
+			DWORD count = *pCount;
+			HRESULT hr = m_pRealDevice->GetDeviceData(cbObjectData, reinterpret_cast<LPDIDEVICEOBJECTDATA>(pBatch), &count, dwFlags);
+			OnRealDeviceData(hr, cbObjectData, pBatch, count, dwFlags);
+			*pCount = count;
+			return hr;
+		};
+		uint32_t count = *pdwInOut;
+		BufferedReadStats stats;
+		HRESULT hr = ReadFilteredEvents(&m_state.events, plan, cbObjectData, rgdod, &count, (dwFlags & DIGDD_PEEK) != 0, GetTickCount(), read, &stats);
+		*pdwInOut = count;
+		if (stats.eventsFiltered > 0) {
+			AddStat(kStatEventsFiltered, stats.eventsFiltered);
+		}
+		if (stats.refills > 0) {
+			AddStat(kStatEventRefills, stats.refills);
+		}
+		return hr;
+	}
+
+	// --- Action maps ---
+	// After a successful SetActionMap. Collects the actions lpdiaf maps to this device's axes
+	// into the table GetDeviceData filters by (core/action_filter.h). The state the device now
+	// reports is in DirectInput's format for the map, which the state filter leaves alone.
+	void OnActionMapSet(const typename Traits::ActionFormat* lpdiaf) {
+		std::vector<ActionBinding> bindings;
+		typename Traits::DeviceInstance device = {};
+		device.dwSize = sizeof(device);
+		if (lpdiaf->rgoAction && lpdiaf->dwActionSize == sizeof(*lpdiaf->rgoAction) && SUCCEEDED(m_metadata.GetDeviceInfo(m_pRealDevice, &device))) {
+			for (DWORD i = 0; i < lpdiaf->dwNumActions; ++i) {
+				const auto& action = lpdiaf->rgoAction[i];
+				if (action.dwHow == DIAH_UNMAPPED || (action.dwHow & DIAH_ERROR) || action.guidInstance != device.guidInstance) continue;
+				typename Traits::DeviceObjectInstance object = {};
+				object.dwSize = sizeof(object);
+				if (FAILED(m_metadata.GetObjectInfo(m_pRealDevice, &object, action.dwObjID, DIPH_BYID))) continue;
+				ActionBinding binding;
+				binding.appData = action.uAppData;
+				memcpy(&binding.guidType, &object.guidType, sizeof(binding.guidType));
+				binding.objId = object.dwType;
+				bindings.push_back(binding);
+			}
+		}
+		ActionTable table;
+		if (!BuildActionTable(bindings.data(), static_cast<uint32_t>(bindings.size()), &table)) {
+			Log("SetActionMap(): too many axis actions to filter.");
+		}
+
+		AcquireSRWLockExclusive(&m_state.rebuildLock);
+		SetActionMapLayout(lpdiaf->dwDataSize, &m_state.layout);
+		ReleaseSRWLockExclusive(&m_state.rebuildLock);
+		m_state.events.lock.Lock();
+		m_state.events.actionMapActive = true;
+		m_state.events.actionTable = table;
+		m_state.events.lock.Unlock();
+		RefreshAxisProperties();
+		m_state.RebuildFilter(true);
+		Log("SetActionMap(): %u axis actions, axis mask %u.", table.count, table.axisMask);
+	}
+
+	// --- Recovery ---
+	// Called when a read from the real device fails. Returns true if the device is now being
+	// recovered and the read should be answered by ReadWhileRecovering instead.
+	bool OnReadFailed(HRESULT hr) {
+		if (hr != DIERR_INPUTLOST && hr != DIERR_NOTACQUIRED) {
+			return false;
+		}
+		m_state.acquireState.store(kAcquireStateUnacquired, std::memory_order_relaxed);
+		// DIDC_ATTACHED may be about to change, and effects do not survive.
+		m_state.InvalidateCapabilities();
+		m_state.effects.OnAllStopped();
+		if (!m_state.gameAcquired.load(std::memory_order_relaxed)) {
+			return false;
+		}
+		{
+			ConfigReadGuard config;
+			if (!config->recoveryEnabled) {
+				return false;
+			}
+		}
+		if (!m_state.recovering.exchange(true)) {
+			m_state.lostError.store(hr, std::memory_order_relaxed);
+			m_state.acquireError.store(hr, std::memory_order_relaxed);
+			// The queue's reference, dropped when TryRecover finishes.
+			AddRef();
+			if (!QueueRecovery(this)) {
+				m_state.recovering.store(false);
+				Release();
+				return false;
+			}
+			Log("Device input lost. Reacquiring in the background.");
+		}
+		return true;
+	}
+
+	static bool ReportsNeutralWhileRecovering() {
+		ConfigReadGuard config;
+		return config->recoveryReportsNeutral;
+	}
+
+	// GetDeviceState while recovering: the device at rest, or the error that started recovery.
+	HRESULT ReadStateWhileRecovering(DWORD cbData, LPVOID lpvData) {
+		if (!ReportsNeutralWhileRecovering()) {
+			return m_state.lostError.load(std::memory_order_relaxed);
+		}
+		if (lpvData) {
+			EpochSnapshot<StateFilter>::ReadGuard filter(m_state.filter);
+			WriteNeutralState(filter->layout, filter->plan, cbData, lpvData);
+		}
+		return DI_OK;
+	}
+
+	// GetDeviceData and Poll while recovering: no events, or the error that started recovery.
+	HRESULT ReadWhileRecovering(LPDWORD pdwInOut) {
+		if (!ReportsNeutralWhileRecovering()) {
+			return m_state.lostError.load(std::memory_order_relaxed);
+		}
+		if (pdwInOut) {
+			*pdwInOut = 0;
+		}
+		return DI_OK;
+	}
 
 public:
-	WrapperIDirectInputDevice8A(IDirectInputDevice8A* pRealDevice) : m_pRealDevice(pRealDevice) {
-		Log("WrapperIDirectInputDevice8A created.");
+	// Returns this width's wrapper for a real device, creating it on first use. The caller's
+	// reference on pRealDevice is consumed either way.
+	static Device* Wrap(Device* pRealDevice) {
+		DeviceState* pState = DeviceState::Get(pRealDevice);
+		bool created = false;
+		WrapperIDirectInputDevice8T* pWrapper = pState->FindOrCreateWrapper<Traits>(
+			[pRealDevice, pState]() { return new WrapperIDirectInputDevice8T(pRealDevice, *pState); }, &created);
+		if (!created) {
+			pRealDevice->Release();
+			pState->Release();
+		}
+		return pWrapper;
 	}
 
 	// --- IUnknown methods ---
 	HRESULT __stdcall QueryInterface(REFIID riid, LPVOID* ppvObj) override {
-		if (riid == IID_IUnknown || riid == IID_IDirectInputDevice8A) {
+		if (riid == IID_IUnknown || riid == Traits::DeviceIID()) {
 			*ppvObj = this;
 			AddRef();
 			return S_OK;
 		}
-		return m_pRealDevice->QueryInterface(riid, ppvObj);
+		HRESULT hr = m_pRealDevice->QueryInterface(riid, ppvObj);
+		if (SUCCEEDED(hr) && riid == Traits::Other::DeviceIID()) {
+			// Hand out the other character width's wrapper for this device, not the
+			// unfiltered real object.
+			typedef typename Traits::Other::Device OtherDevice;
+			*ppvObj = WrapperIDirectInputDevice8T<typename Traits::Other>::Wrap(static_cast<OtherDevice*>(*ppvObj));
+		}
+		return hr;
 	}
 
+	// The wrapper keeps its own count and holds one reference on the real device and one on
+	// the shared state, so a lookup never has to touch the real object's count.
 	ULONG __stdcall AddRef() override {
-		return m_pRealDevice->AddRef();
+		return InterlockedIncrement(&m_refCount);
 	}
 
 	ULONG __stdcall Release() override {
-		ULONG uRet = m_pRealDevice->Release();
+		ULONG uRet = InterlockedDecrement(&m_refCount);
 		if (uRet == 0) {
+			DeviceState& state = m_state;
+			state.RemoveWrapper(Traits::Width(), this);
+			m_pRealDevice->Release();
 			delete this;
+			state.Release();
 		}
 		return uRet;
 	}
 
-	// --- IDirectInputDevice8A methods ---
+	// --- IDirectInputDevice8 methods ---
 	HRESULT __stdcall GetCapabilities(LPDIDEVCAPS lpDIDevCaps) override {
-		return m_pRealDevice->GetCapabilities(lpDIDevCaps);
+		return m_metadata.GetCapabilities(m_pRealDevice, lpDIDevCaps);
 	}
 
-	HRESULT __stdcall EnumObjects(LPDIENUMDEVICEOBJECTSCALLBACKA lpCallback, LPVOID pvRef, DWORD dwFlags) override {
-		return m_pRealDevice->EnumObjects(lpCallback, pvRef, dwFlags);
+	HRESULT __stdcall EnumObjects(typename Traits::EnumDeviceObjectsCallback lpCallback, LPVOID pvRef, DWORD dwFlags) override {
+		return m_metadata.EnumObjects(m_pRealDevice, lpCallback, pvRef, dwFlags);
 	}
 
 	HRESULT __stdcall GetProperty(REFGUID rguidProp, LPDIPROPHEADER pdiph) override {
-		return m_pRealDevice->GetProperty(rguidProp, pdiph);
+		AxisProperty property = GetAxisProperty(rguidProp);
+		if (property != kAxisPropertyNone && m_state.GetCachedAxisProperty(property, pdiph)) {
+			return DI_OK;
+		}
+		HRESULT hr;
+		if (m_metadata.GetProperty(m_pRealDevice, rguidProp, pdiph, &hr)) {
+			return hr;
+		}
+		hr = m_pRealDevice->GetProperty(rguidProp, pdiph);
+		if (SUCCEEDED(hr) && &rguidProp == &DIPROP_BUFFERSIZE && pdiph->dwSize == sizeof(DIPROPDWORD)) {
+			DWORD gameBufferSize = m_state.gameBufferSize.load(std::memory_order_relaxed);
+			if (gameBufferSize != 0) {
+				reinterpret_cast<LPDIPROPDWORD>(pdiph)->dwData = gameBufferSize;
+			}
+		}
+		return hr;
 	}
 
 	HRESULT __stdcall SetProperty(REFGUID rguidProp, LPCDIPROPHEADER pdiph) override {
-		return m_pRealDevice->SetProperty(rguidProp, pdiph);
+		if (&rguidProp == &DIPROP_BUFFERSIZE && pdiph && pdiph->dwSize == sizeof(DIPROPDWORD) && pdiph->dwHow == DIPH_DEVICE) {
+			return SetBufferSize(reinterpret_cast<LPCDIPROPDWORD>(pdiph));
+		}
+		HRESULT hr = m_pRealDevice->SetProperty(rguidProp, pdiph);
+		if (SUCCEEDED(hr)) {
+			m_state.OnSetProperty(rguidProp);
+		}
+		AxisProperty property = GetAxisProperty(rguidProp);
+		if (SUCCEEDED(hr) && property != kAxisPropertyNone) {
+			// The game may have addressed the axis by ID or usage, so read every axis back
+			// rather than work out which one it meant.
+			AcquireSRWLockShared(&m_state.rebuildLock);
+			bool formatKnown = m_state.layout.known;
+			ReleaseSRWLockShared(&m_state.rebuildLock);
+			if (!formatKnown && property == kAxisPropertyRange && pdiph->dwHow == DIPH_DEVICE && pdiph->dwSize == sizeof(DIPROPRANGE)) {
+				m_state.SetDeviceRange(reinterpret_cast<LPCDIPROPRANGE>(pdiph));
+			}
+			RefreshAxisProperties();
+			m_state.RebuildFilter(false);
+		}
+		return hr;
 	}
 
 	HRESULT __stdcall Acquire() override {
+		// Some games acquire before every poll. The real Acquire answers S_FALSE then too.
+		if (m_state.acquireState.load(std::memory_order_relaxed) == kAcquireStateAcquired) {
+			return S_FALSE;
+		}
+		if (m_state.recovering.load(std::memory_order_acquire)) {
+			// The recovery thread is already retrying, so do not block the game in the HID
+			// stack. Losing focus is not a driver problem; that Acquire is cheap and goes through.
+			HRESULT hrAcquire = m_state.acquireError.load(std::memory_order_relaxed);
+			if (hrAcquire != DIERR_OTHERAPPHASPRIO) {
+				m_state.gameAcquired.store(true, std::memory_order_relaxed);
+				return ReportsNeutralWhileRecovering() ? DI_OK : hrAcquire;
+			}
+		}
 		Log("Acquire() called.");
-		return m_pRealDevice->Acquire();
+		HRESULT hr = m_pRealDevice->Acquire();
+		if (SUCCEEDED(hr)) {
+			m_state.acquireState.store(kAcquireStateAcquired, std::memory_order_relaxed);
+			m_state.gameAcquired.store(true, std::memory_order_relaxed);
+			m_state.recovering.store(false, std::memory_order_release);
+		}
+		else {
+			m_state.acquireState.store(kAcquireStateUnknown, std::memory_order_relaxed);
+		}
+		return hr;
 	}
 
 	HRESULT __stdcall Unacquire() override {
+		m_state.gameAcquired.store(false, std::memory_order_relaxed);
+		if (m_state.acquireState.load(std::memory_order_relaxed) == kAcquireStateUnacquired) {
+			return DI_NOEFFECT;
+		}
 		Log("Unacquire() called.");
-		return m_pRealDevice->Unacquire();
+		// Unacquiring stops every effect; apply what the game set before that.
+		m_state.effects.FlushPending();
+		HRESULT hr = m_pRealDevice->Unacquire();
+		m_state.effects.OnAllStopped();
+		m_state.acquireState.store(SUCCEEDED(hr) ? kAcquireStateUnacquired : kAcquireStateUnknown, std::memory_order_relaxed);
+		return hr;
 	}
 
+	// GetDeviceState, GetDeviceData and Poll mark the game's frame, where deferred effect
+	// updates are applied.
 	HRESULT STDMETHODCALLTYPE GetDeviceState(DWORD cbData, LPVOID lpvData) override {
-		HRESULT hr = m_pRealDevice->GetDeviceState(cbData, lpvData);
-		if (SUCCEEDED(hr) && cbData == sizeof(DIJOYSTATE)) {
-			// Zero out rotational X and Y (Rx and Ry) for 6DOF device
-			DIJOYSTATE* state = static_cast<DIJOYSTATE*>(lpvData);
-			state->lRx = 0;
-			state->lRy = 0;
+		m_state.effects.OnFrame();
+		if (!m_state.recovering.load(std::memory_order_acquire)) {
+			HRESULT hr = m_pRealDevice->GetDeviceState(cbData, lpvData);
+			if (IsCaptureActive()) {
+				// Record the unfiltered result, then filter as usual.
+				CaptureState(m_state.captureId, hr, cbData, lpvData);
+			}
+			if (SUCCEEDED(hr)) {
+				EpochSnapshot<StateFilter>::ReadGuard filter(m_state.filter);
+				filter->pfnApply(filter->plan, cbData, lpvData);
+				return hr;
+			}
+			if (!OnReadFailed(hr)) {
+				return hr;
+			}
 		}
-		return hr;
+		return ReadStateWhileRecovering(cbData, lpvData);
 	}
 
 	HRESULT __stdcall GetDeviceData(DWORD cbObjectData, LPDIDEVICEOBJECTDATA rgdod, LPDWORD pdwInOut, DWORD dwFlags) override {
-		return m_pRealDevice->GetDeviceData(cbObjectData, rgdod, pdwInOut, dwFlags);
+		// A null rgdod only counts or flushes events, so there is nothing to rewrite. Everything
+		// else goes through the filtered path, even with no event rules, so sequence numbers
+		// stay consistent when a config reload adds or removes rules.
+		m_state.effects.OnFrame();
+		if (m_state.recovering.load(std::memory_order_acquire)) {
+			return ReadWhileRecovering(pdwInOut);
+		}
+		HRESULT hr;
+		if (rgdod && pdwInOut && IsValidObjectDataSize(cbObjectData)) {
+			// The plan is copied out rather than pinned, so the guard does not span the real
+			// GetDeviceData calls, which a publisher would otherwise wait on.
+			FilterPlan plan;
+			{
+				EpochSnapshot<StateFilter>::ReadGuard filter(m_state.filter);
+				plan = filter->plan;
+			}
+			hr = GetFilteredDeviceData(plan, cbObjectData, rgdod, pdwInOut, dwFlags);
+		}
+		else {
+			hr = m_pRealDevice->GetDeviceData(cbObjectData, rgdod, pdwInOut, dwFlags);
+			OnRealDeviceData(hr, cbObjectData, rgdod, pdwInOut ? *pdwInOut : 0, dwFlags);
+		}
+		if (FAILED(hr) && OnReadFailed(hr)) {
+			return ReadWhileRecovering(pdwInOut);
+		}
+		return hr;
 	}
 
 	HRESULT __stdcall SetDataFormat(LPCDIDATAFORMAT lpdf) override {
-		return m_pRealDevice->SetDataFormat(lpdf);
+		HRESULT hr = m_pRealDevice->SetDataFormat(lpdf);
+		m_state.acquireState.store(kAcquireStateUnknown, std::memory_order_relaxed);
+		if (SUCCEEDED(hr)) {
+			m_state.InvalidateObjects();
+			// The real device accepted it, but a chained proxy may be less strict than
+			// DirectInput. A format the filter cannot trust falls back to the size-checked
+			// default instead of being indexed into.
+			bool valid = ValidateDataFormat(AsDiDataFormat(lpdf));
+			if (!valid) {
+				Log("SetDataFormat(): malformed data format. Using the size-checked filter.");
+			}
+			AcquireSRWLockExclusive(&m_state.rebuildLock);
+			BuildFormatLayout(AsDiDataFormat(lpdf), &m_state.layout);
+			ReleaseSRWLockExclusive(&m_state.rebuildLock);
+			m_state.events.lock.Lock();
+			m_state.events.actionMapActive = false;
+			m_state.events.lock.Unlock();
+			if (valid && IsCaptureActive()) {
+				CaptureFormat(m_state.captureId, AsDiDataFormat(lpdf));
+			}
+			RefreshAxisProperties();
+			m_state.RebuildFilter(true);
+			unsigned presentMask;
+			int stateKind;
+			unsigned eventRuleCount;
+			{
+				EpochSnapshot<StateFilter>::ReadGuard filter(m_state.filter);
+				presentMask = filter->layout.presentMask;
+				stateKind = static_cast<int>(filter->plan.stateKind);
+				eventRuleCount = static_cast<unsigned>(filter->plan.eventRuleCount);
+			}
+			Log("SetDataFormat(): axis mask %u, state policy %d, %u event rules.", presentMask, stateKind, eventRuleCount);
+		}
+		return hr;
 	}
 
 	HRESULT __stdcall SetEventNotification(HANDLE hEvent) override {
@@ -166,15 +1056,17 @@ public:
 	}
 
 	HRESULT __stdcall SetCooperativeLevel(HWND hwnd, DWORD dwFlags) override {
+		// A new window or exclusivity changes when DirectInput unacquires behind our back.
+		m_state.acquireState.store(kAcquireStateUnknown, std::memory_order_relaxed);
 		return m_pRealDevice->SetCooperativeLevel(hwnd, dwFlags);
 	}
 
-	HRESULT __stdcall GetObjectInfo(LPDIDEVICEOBJECTINSTANCEA pdidoi, DWORD dwObj, DWORD dwHow) override {
-		return m_pRealDevice->GetObjectInfo(pdidoi, dwObj, dwHow);
+	HRESULT __stdcall GetObjectInfo(typename Traits::DeviceObjectInstance* pdidoi, DWORD dwObj, DWORD dwHow) override {
+		return m_metadata.GetObjectInfo(m_pRealDevice, pdidoi, dwObj, dwHow);
 	}
 
-	HRESULT __stdcall GetDeviceInfo(LPDIDEVICEINSTANCEA pdidi) override {
-		return m_pRealDevice->GetDeviceInfo(pdidi);
+	HRESULT __stdcall GetDeviceInfo(typename Traits::DeviceInstance* pdidi) override {
+		return m_metadata.GetDeviceInfo(m_pRealDevice, pdidi);
 	}
 
 	HRESULT __stdcall RunControlPanel(HWND hwndOwner, DWORD dwFlags) override {
@@ -186,14 +1078,18 @@ public:
 	}
 
 	HRESULT __stdcall CreateEffect(REFGUID rguid, LPCDIEFFECT lpeff, LPDIRECTINPUTEFFECT* ppdeff, LPUNKNOWN punkOuter) override {
-		return m_pRealDevice->CreateEffect(rguid, lpeff, ppdeff, punkOuter);
+		HRESULT hr = m_pRealDevice->CreateEffect(rguid, lpeff, ppdeff, punkOuter);
+		if (SUCCEEDED(hr) && ppdeff && *ppdeff && !punkOuter) {
+			*ppdeff = new WrapperIDirectInputEffect(*ppdeff, static_cast<Device*>(this), &m_state.effects, rguid, lpeff, hr);
+		}
+		return hr;
 	}
 
-	HRESULT __stdcall EnumEffects(LPDIENUMEFFECTSCALLBACKA lpCallback, LPVOID pvRef, DWORD dwEffType) override {
+	HRESULT __stdcall EnumEffects(typename Traits::EnumEffectsCallback lpCallback, LPVOID pvRef, DWORD dwEffType) override {
 		return m_pRealDevice->EnumEffects(lpCallback, pvRef, dwEffType);
 	}
 
-	HRESULT __stdcall GetEffectInfo(LPDIEFFECTINFOA pdei, REFGUID rguid) override {
+	HRESULT __stdcall GetEffectInfo(typename Traits::EffectInfo* pdei, REFGUID rguid) override {
 		return m_pRealDevice->GetEffectInfo(pdei, rguid);
 	}
 
@@ -202,11 +1098,16 @@ public:
 	}
 
 	HRESULT __stdcall SendForceFeedbackCommand(DWORD dwFlags) override {
-		return m_pRealDevice->SendForceFeedbackCommand(dwFlags);
+		m_state.effects.FlushPending();
+		HRESULT hr = m_pRealDevice->SendForceFeedbackCommand(dwFlags);
+		if (SUCCEEDED(hr) && (dwFlags & (DISFFC_RESET | DISFFC_STOPALL))) {
+			m_state.effects.OnAllStopped();
+		}
+		return hr;
 	}
 
 	HRESULT __stdcall EnumCreatedEffectObjects(LPDIENUMCREATEDEFFECTOBJECTSCALLBACK lpCallback, LPVOID pvRef, DWORD fl) override {
-		return m_pRealDevice->EnumCreatedEffectObjects(lpCallback, pvRef, fl);
+		return m_state.effects.EnumCreatedEffects(m_pRealDevice, lpCallback, pvRef, fl);
 	}
 
 	HRESULT __stdcall Escape(LPDIEFFESCAPE pesc) override {
@@ -214,83 +1115,162 @@ public:
 	}
 
 	HRESULT __stdcall Poll() override {
-		return m_pRealDevice->Poll();
+		m_state.effects.OnFrame();
+		if (m_state.recovering.load(std::memory_order_acquire)) {
+			return ReadWhileRecovering(nullptr);
+		}
+		HRESULT hr = m_pRealDevice->Poll();
+		if (FAILED(hr) && OnReadFailed(hr)) {
+			return ReadWhileRecovering(nullptr);
+		}
+		return hr;
+	}
+
+	// --- RecoverableDevice ---
+	bool TryRecover() override {
+		// Nothing to do if the game reacquired the device itself, unacquired it, or released
+		// every reference to both widths but the queue's.
+		if (m_state.recovering.load(std::memory_order_acquire) && m_state.gameAcquired.load(std::memory_order_relaxed) && (m_refCount > 1 || m_state.HasOtherWrapper(Traits::Width()))) {
+			HRESULT hr = m_pRealDevice->Acquire();
+			if (FAILED(hr)) {
+				m_state.acquireError.store(hr, std::memory_order_relaxed);
+				return false;
+			}
+			// The game may have unacquired while this Acquire was in the HID stack.
+			if (m_state.gameAcquired.load(std::memory_order_relaxed)) {
+				m_state.acquireState.store(kAcquireStateAcquired, std::memory_order_relaxed);
+			}
+			else {
+				m_pRealDevice->Unacquire();
+				m_state.acquireState.store(kAcquireStateUnacquired, std::memory_order_relaxed);
+			}
+			Log("Device reacquired.");
+		}
+		m_state.recovering.store(false, std::memory_order_release);
+		Release();
+		return true;
 	}
 
 	HRESULT __stdcall SendDeviceData(DWORD cbObjectData, LPCDIDEVICEOBJECTDATA rgdod, LPDWORD pdwInOut, DWORD fl) override {
 		return m_pRealDevice->SendDeviceData(cbObjectData, rgdod, pdwInOut, fl);
 	}
 
-	HRESULT __stdcall EnumEffectsInFile(LPCSTR lpszFileName, LPDIENUMEFFECTSINFILECALLBACK pec, LPVOID pvRef, DWORD dwFlags) override {
+	HRESULT __stdcall EnumEffectsInFile(typename Traits::String lpszFileName, LPDIENUMEFFECTSINFILECALLBACK pec, LPVOID pvRef, DWORD dwFlags) override {
 		return m_pRealDevice->EnumEffectsInFile(lpszFileName, pec, pvRef, dwFlags);
 	}
 
-	HRESULT __stdcall WriteEffectToFile(LPCSTR lpszFileName, DWORD dwEntries, LPDIFILEEFFECT rgDiFileEft, DWORD dwFlags) override {
+	HRESULT __stdcall WriteEffectToFile(typename Traits::String lpszFileName, DWORD dwEntries, LPDIFILEEFFECT rgDiFileEft, DWORD dwFlags) override {
 		return m_pRealDevice->WriteEffectToFile(lpszFileName, dwEntries, rgDiFileEft, dwFlags);
 	}
 
-	HRESULT __stdcall BuildActionMap(LPDIACTIONFORMATA lpdiaf, LPCSTR lpszUserName, DWORD dwFlags) override {
+	HRESULT __stdcall BuildActionMap(typename Traits::ActionFormat* lpdiaf, typename Traits::String lpszUserName, DWORD dwFlags) override {
 		return m_pRealDevice->BuildActionMap(lpdiaf, lpszUserName, dwFlags);
 	}
 
-	HRESULT __stdcall SetActionMap(LPDIACTIONFORMATA lpdiaf, LPCSTR lpszUserName, DWORD dwFlags) override {
-		return m_pRealDevice->SetActionMap(lpdiaf, lpszUserName, dwFlags);
+	HRESULT __stdcall SetActionMap(typename Traits::ActionFormat* lpdiaf, typename Traits::String lpszUserName, DWORD dwFlags) override {
+		HRESULT hr = m_pRealDevice->SetActionMap(lpdiaf, lpszUserName, dwFlags);
+		if (SUCCEEDED(hr) && lpdiaf) {
+			// An action map replaces the data format.
+			m_state.InvalidateObjects();
+			OnActionMapSet(lpdiaf);
+		}
+		return hr;
 	}
 
-	HRESULT __stdcall GetImageInfo(LPDIDEVICEIMAGEINFOHEADERA lpdiDevImageInfoHeader) override {
+	HRESULT __stdcall GetImageInfo(typename Traits::DeviceImageInfoHeader* lpdiDevImageInfoHeader) override {
 		return m_pRealDevice->GetImageInfo(lpdiDevImageInfoHeader);
 	}
 };
 
-// --- Wrapper for IDirectInput8A ---
-class WrapperIDirectInput8A : public IDirectInput8A {
+typedef WrapperIDirectInputDevice8T<DInputTraitsA> WrapperIDirectInputDevice8A;
+typedef WrapperIDirectInputDevice8T<DInputTraitsW> WrapperIDirectInputDevice8W;
+
+// --- Wrapper for IDirectInput8A/W ---
+// See "Reused DirectInput objects".
+static void ForgetCachedDirectInput(const RegisteredWrapper* pWrapper);
+
+template <class Traits>
+class WrapperIDirectInput8T final : public Traits::DInput, public RegisteredWrapper, public SlabAllocated<WrapperIDirectInput8T<Traits>> {
 private:
-	IDirectInput8A* m_pRealDInput;
+	typedef typename Traits::DInput DInput;
+	typedef typename Traits::Device Device;
+
+	DInput* m_pRealDInput;
 
 public:
-	WrapperIDirectInput8A(IDirectInput8A* pRealDInput) : m_pRealDInput(pRealDInput) {}
+	// Takes over the caller's reference on pRealDInput.
+	WrapperIDirectInput8T(DInput* pRealDInput) : m_pRealDInput(pRealDInput) {}
 
 	HRESULT __stdcall QueryInterface(REFIID riid, LPVOID* ppvObj) override {
-		if (riid == IID_IUnknown || riid == IID_IDirectInput8A) {
+		if (riid == IID_IUnknown || riid == Traits::DInputIID()) {
 			*ppvObj = this;
 			AddRef();
 			return S_OK;
 		}
-		return m_pRealDInput->QueryInterface(riid, ppvObj);
+		HRESULT hr = m_pRealDInput->QueryInterface(riid, ppvObj);
+		if (SUCCEEDED(hr) && riid == Traits::Other::DInputIID()) {
+			// The other character width goes through a wrapper too, or devices created
+			// through it would reach the game unfiltered.
+			typedef typename Traits::Other::DInput OtherDInput;
+			*ppvObj = static_cast<OtherDInput*>(new WrapperIDirectInput8T<typename Traits::Other>(static_cast<OtherDInput*>(*ppvObj)));
+		}
+		return hr;
 	}
 
+	// Like the device wrappers, the wrapper keeps its own count and holds one reference on
+	// the real object, so wrappers of both widths for the same object each go away with
+	// their own last Release.
 	ULONG __stdcall AddRef() override {
-		return m_pRealDInput->AddRef();
+		return InterlockedIncrement(&m_refCount);
 	}
 
 	ULONG __stdcall Release() override {
-		ULONG uRet = m_pRealDInput->Release();
+		ULONG uRet = InterlockedDecrement(&m_refCount);
 		if (uRet == 0) {
+			ForgetCachedDirectInput(this);
+			m_pRealDInput->Release();
 			delete this;
 		}
 		return uRet;
 	}
 
-	HRESULT __stdcall CreateDevice(REFGUID rguid, LPDIRECTINPUTDEVICE8A* lplpDirectInputDevice, LPUNKNOWN pUnkOuter) override {
+	HRESULT __stdcall CreateDevice(REFGUID rguid, Device** lplpDirectInputDevice, LPUNKNOWN pUnkOuter) override {
 		Log("CreateDevice() called.");
-		IDirectInputDevice8A* pRealDevice = nullptr;
+		Device* pRealDevice = nullptr;
 		HRESULT hr = m_pRealDInput->CreateDevice(rguid, &pRealDevice, pUnkOuter);
 		if (SUCCEEDED(hr)) {
-			DIDEVICEINSTANCEA didi;
+			typename Traits::DeviceInstance didi;
 			didi.dwSize = sizeof(didi);
 			if (SUCCEEDED(pRealDevice->GetDeviceInfo(&didi))) {
-				Log("Device Info: " + std::string(didi.tszProductName));
-
-				std::stringstream ss;
-				ss << std::hex << std::setw(8) << std::setfill('0') << didi.dwDevType;
-				Log("Device Type: 0x" + ss.str());
+				char productName[MAX_PATH * 3];
+				ToUtf8(didi.tszProductName, productName);
+				Log("Device Info: %s", productName);
+				Log("Device Type: 0x%08lx", didi.dwDevType);
+
+				DeviceIdentity identity = {};
+				identity.sixDof = GET_DIDEVICE_TYPE(didi.dwDevType) == DI8DEVTYPE_1STPERSON && GET_DIDEVICE_SUBTYPE(didi.dwDevType) == DI8DEVTYPE1STPERSON_SIXDOF;
+				identity.name = productName;
+				DIPROPDWORD vidPid = {};
+				vidPid.diph.dwSize = sizeof(vidPid);
+				vidPid.diph.dwHeaderSize = sizeof(vidPid.diph);
+				vidPid.diph.dwHow = DIPH_DEVICE;
+				if (SUCCEEDED(pRealDevice->GetProperty(DIPROP_VIDPID, &vidPid.diph))) {
+					identity.hasVidPid = true;
+					identity.vid = LOWORD(vidPid.dwData);
+					identity.pid = HIWORD(vidPid.dwData);
+				}
 
-				if (GET_DIDEVICE_TYPE(didi.dwDevType) == DI8DEVTYPE_1STPERSON && GET_DIDEVICE_SUBTYPE(didi.dwDevType) == DI8DEVTYPE1STPERSON_SIXDOF) {
-					Log("Device is a six degrees of freedom, first-person controller. Wrapping it.");
-					*lplpDirectInputDevice = new WrapperIDirectInputDevice8A(pRealDevice);
+				bool wrap;
+				{
+					ConfigReadGuard config;
+					wrap = ShouldWrapDevice(config.Get(), identity);
+				}
+				if (wrap) {
+					Log("Device matches a wrap rule. Wrapping it.");
+					*lplpDirectInputDevice = WrapperIDirectInputDevice8T<Traits>::Wrap(pRealDevice);
 				}
 				else {
-					Log("Device is not a six degrees of freedom, first-person controller. Passing it through.");
+					Log("Device does not match a wrap rule. Passing it through.");
 					*lplpDirectInputDevice = pRealDevice;
 				}
 			}
@@ -302,7 +1282,7 @@ public:
 		return hr;
 	}
 
-	HRESULT __stdcall EnumDevices(DWORD dwDevType, LPDIENUMDEVICESCALLBACKA lpCallback, LPVOID pvRef, DWORD dwFlags) override {
+	HRESULT __stdcall EnumDevices(DWORD dwDevType, typename Traits::EnumDevicesCallback lpCallback, LPVOID pvRef, DWORD dwFlags) override {
 		return m_pRealDInput->EnumDevices(dwDevType, lpCallback, pvRef, dwFlags);
 	}
 
@@ -318,170 +1298,329 @@ public:
 		return m_pRealDInput->Initialize(hinst, dwVersion);
 	}
 
-	HRESULT __stdcall FindDevice(REFGUID rguidClass, LPCSTR ptszName, LPGUID pguidInstance) override {
+	HRESULT __stdcall FindDevice(REFGUID rguidClass, typename Traits::String ptszName, LPGUID pguidInstance) override {
 		return m_pRealDInput->FindDevice(rguidClass, ptszName, pguidInstance);
 	}
 
-	HRESULT __stdcall EnumDevicesBySemantics(LPCSTR ptszUserName, LPDIACTIONFORMATA lpdiActionFormat, LPDIENUMDEVICESBYSEMANTICSCBA lpCallback, LPVOID pvRef, DWORD dwFlags) override {
+	HRESULT __stdcall EnumDevicesBySemantics(typename Traits::String ptszUserName, typename Traits::ActionFormat* lpdiActionFormat, typename Traits::EnumDevicesBySemanticsCallback lpCallback, LPVOID pvRef, DWORD dwFlags) override {
 		return m_pRealDInput->EnumDevicesBySemantics(ptszUserName, lpdiActionFormat, lpCallback, pvRef, dwFlags);
 	}
 
-	HRESULT __stdcall ConfigureDevices(LPDICONFIGUREDEVICESCALLBACK lpdiCallback, LPDICONFIGUREDEVICESPARAMSA lpdiCDParams, DWORD dwFlags, LPVOID pvRefData) override {
+	HRESULT __stdcall ConfigureDevices(LPDICONFIGUREDEVICESCALLBACK lpdiCallback, typename Traits::ConfigureDevicesParams* lpdiCDParams, DWORD dwFlags, LPVOID pvRefData) override {
 		return m_pRealDInput->ConfigureDevices(lpdiCallback, lpdiCDParams, dwFlags, pvRefData);
 	}
 };
 
-// --- Unicode Wrapper ---
-class WrapperIDirectInputDevice8W : public IDirectInputDevice8W {
+typedef WrapperIDirectInput8T<DInputTraitsA> WrapperIDirectInput8A;
+typedef WrapperIDirectInput8T<DInputTraitsW> WrapperIDirectInput8W;
+
+// Wraps a real IDirectInput8A/W that was just created for riid, whichever way the game asked
+// for it, taking over the creation reference. Anything else is returned as is.
+static LPVOID WrapRealDirectInput8(REFIID riid, LPVOID pRealDInput) {
+	if (riid == IID_IDirectInput8A) {
+		return static_cast<IDirectInput8A*>(new WrapperIDirectInput8A(static_cast<IDirectInput8A*>(pRealDInput)));
+	}
+	if (riid == IID_IDirectInput8W) {
+		return static_cast<IDirectInput8W*>(new WrapperIDirectInput8W(static_cast<IDirectInput8W*>(pRealDInput)));
+	}
+	return pRealDInput;
+}
+
+// --- Reused DirectInput objects ---
+// Some engines call DirectInput8Create again on every controller rescan. While the game still
+// holds the object created for a (hinst, version, interface), the same object is handed out
+// again, so DirectInput's device lists stay warm instead of being rebuilt. The cache holds no
+// reference: like a WrapperRegistry, a lookup revives an entry only through TryAddRef, and the
+// wrapper's final Release removes it. Only the wrapped interfaces created by
+// DirectInput8Create without aggregation are reused; COM creation goes through Initialize,
+// which the game expects to act on a fresh object.
+struct CachedDirectInput {
+	HINSTANCE hinst;
+	DWORD dwVersion;
+	IID iid;
+	// The wrapper, as the interface the game asked for and as its reference count.
+	IUnknown* pObject;
+	RegisteredWrapper* pWrapper;
+};
+
+static SRWLOCK g_directInputCacheLock = SRWLOCK_INIT;
+// Never freed, like the wrapper registries, so wrappers released during process teardown can
+// still remove themselves. Never more than a handful of entries.
+static std::vector<CachedDirectInput>* g_pDirectInputCache = new std::vector<CachedDirectInput>();
+
+// Returns the cached object with a reference added for the caller, or nullptr if there is
+// none or the game has already released it.
+static IUnknown* FindCachedDirectInput(HINSTANCE hinst, DWORD dwVersion, REFIID riid) {
+	IUnknown* pObject = nullptr;
+	AcquireSRWLockShared(&g_directInputCacheLock);
+	for (const CachedDirectInput& entry : *g_pDirectInputCache) {
+		if (entry.hinst == hinst && entry.dwVersion == dwVersion && entry.iid == riid) {
+			if (entry.pWrapper->TryAddRef()) {
+				pObject = entry.pObject;
+			}
+			break;
+		}
+	}
+	ReleaseSRWLockShared(&g_directInputCacheLock);
+	return pObject;
+}
+
+// Keeps pWrapper for reuse unless another thread cached a live one first. An entry whose
+// wrapper is on its way out is replaced.
+template <class Traits>
+static void CacheDirectInput(HINSTANCE hinst, DWORD dwVersion, REFIID riid, WrapperIDirectInput8T<Traits>* pWrapper) {
+	CachedDirectInput newEntry = { hinst, dwVersion, riid, static_cast<typename Traits::DInput*>(pWrapper), pWrapper };
+	AcquireSRWLockExclusive(&g_directInputCacheLock);
+	for (CachedDirectInput& entry : *g_pDirectInputCache) {
+		if (entry.hinst == hinst && entry.dwVersion == dwVersion && entry.iid == riid) {
+			if (entry.pWrapper->TryAddRef()) {
+				// Only checking it is alive. Its Release may be the final one, which takes
+				// the lock to remove the entry.
+				IUnknown* pLive = entry.pObject;
+				ReleaseSRWLockExclusive(&g_directInputCacheLock);
+				pLive->Release();
+				return;
+			}
+			entry = newEntry;
+			ReleaseSRWLockExclusive(&g_directInputCacheLock);
+			return;
+		}
+	}
+	g_pDirectInputCache->push_back(newEntry);
+	ReleaseSRWLockExclusive(&g_directInputCacheLock);
+}
+
+// Called by a DirectInput wrapper whose count reached zero.
+static void ForgetCachedDirectInput(const RegisteredWrapper* pWrapper) {
+	AcquireSRWLockExclusive(&g_directInputCacheLock);
+	std::vector<CachedDirectInput>& cache = *g_pDirectInputCache;
+	for (size_t i = 0; i < cache.size(); ++i) {
+		if (cache[i].pWrapper == pWrapper) {
+			cache.erase(cache.begin() + i);
+			break;
+		}
+	}
+	ReleaseSRWLockExclusive(&g_directInputCacheLock);
+}
+
+// --- Class factory for CLSID_DirectInput8 ---
+// DllGetClassObject hands out this factory instead of the real one, so objects it creates go
+// through the same wrappers as DirectInput8Create's. It only runs when this DLL itself is
+// asked: by a game or another proxy that loads dinput8.dll from the game folder and calls
+// DllGetClassObject on it. CoCreateInstance(CLSID_DirectInput8, ...) is not covered; COM loads
+// the registered dinput8.dll from System32 by full path and never sees this one.
+
+// Live factories plus LockServer(TRUE) calls. DllCanUnloadNow must refuse while any exist.
+static std::atomic<LONG> g_cServerLocks(0);
+
+class WrapperClassFactory : public IClassFactory {
 private:
-	IDirectInputDevice8W* m_pRealDevice;
+	IClassFactory* m_pRealFactory;
+	LONG m_refCount;
 
 public:
-	WrapperIDirectInputDevice8W(IDirectInputDevice8W* pRealDevice) : m_pRealDevice(pRealDevice) { Log(L"WrapperIDirectInputDevice8W created."); }
+	WrapperClassFactory(IClassFactory* pRealFactory) : m_pRealFactory(pRealFactory), m_refCount(1) {
+		++g_cServerLocks;
+	}
 
-	// IUnknown
-	HRESULT __stdcall QueryInterface(REFIID riid, LPVOID* ppvObj) override { if (riid == IID_IUnknown || riid == IID_IDirectInputDevice8W) { *ppvObj = this; AddRef(); return S_OK; } return m_pRealDevice->QueryInterface(riid, ppvObj); }
-	ULONG __stdcall AddRef() override { return m_pRealDevice->AddRef(); }
-	ULONG __stdcall Release() override { ULONG uRet = m_pRealDevice->Release(); if (uRet == 0) delete this; return uRet; }
+	~WrapperClassFactory() {
+		m_pRealFactory->Release();
+		--g_cServerLocks;
+	}
 
-	// Core Logic
-	HRESULT STDMETHODCALLTYPE GetDeviceState(DWORD cbData, LPVOID lpvData) override {
-		HRESULT hr = m_pRealDevice->GetDeviceState(cbData, lpvData);
-		if (SUCCEEDED(hr) && cbData == sizeof(DIJOYSTATE)) {
-			// Zero out rotational X and Y (Rx and Ry) for 6DOF device
-			DIJOYSTATE* state = static_cast<DIJOYSTATE*>(lpvData);
-			state->lRx = 0;
-			state->lRy = 0;
+	HRESULT __stdcall QueryInterface(REFIID riid, LPVOID* ppvObj) override {
+		if (!ppvObj) return E_POINTER;
+		if (riid == IID_IUnknown || riid == IID_IClassFactory) {
+			*ppvObj = this;
+			AddRef();
+			return S_OK;
 		}
-		return hr;
+		*ppvObj = nullptr;
+		return E_NOINTERFACE;
 	}
-	HRESULT __stdcall GetDeviceData(DWORD cbObjectData, LPDIDEVICEOBJECTDATA rgdod, LPDWORD pdwInOut, DWORD dwFlags) override { return m_pRealDevice->GetDeviceData(cbObjectData, rgdod, pdwInOut, dwFlags); }
-	HRESULT __stdcall SetDataFormat(LPCDIDATAFORMAT lpdf) override { return m_pRealDevice->SetDataFormat(lpdf); }
-
-	// Passthrough methods
-	HRESULT __stdcall GetCapabilities(LPDIDEVCAPS lpDIDevCaps) override { return m_pRealDevice->GetCapabilities(lpDIDevCaps); }
-	HRESULT __stdcall EnumObjects(LPDIENUMDEVICEOBJECTSCALLBACKW cb, LPVOID pv, DWORD fl) override { return m_pRealDevice->EnumObjects(cb, pv, fl); }
-	HRESULT __stdcall GetProperty(REFGUID r, LPDIPROPHEADER p) override { return m_pRealDevice->GetProperty(r, p); }
-	HRESULT __stdcall SetProperty(REFGUID r, LPCDIPROPHEADER p) override { return m_pRealDevice->SetProperty(r, p); }
-	HRESULT __stdcall Acquire() override { return m_pRealDevice->Acquire(); }
-	HRESULT __stdcall Unacquire() override { return m_pRealDevice->Unacquire(); }
-	HRESULT __stdcall SetEventNotification(HANDLE h) override { return m_pRealDevice->SetEventNotification(h); }
-	HRESULT __stdcall SetCooperativeLevel(HWND h, DWORD d) override { return m_pRealDevice->SetCooperativeLevel(h, d); }
-	HRESULT __stdcall GetObjectInfo(LPDIDEVICEOBJECTINSTANCEW p, DWORD d1, DWORD d2) override { return m_pRealDevice->GetObjectInfo(p, d1, d2); }
-	HRESULT __stdcall GetDeviceInfo(LPDIDEVICEINSTANCEW p) override { return m_pRealDevice->GetDeviceInfo(p); }
-	HRESULT __stdcall RunControlPanel(HWND h, DWORD d) override { return m_pRealDevice->RunControlPanel(h, d); }
-	HRESULT __stdcall Initialize(HINSTANCE h, DWORD d, REFGUID r) override { return m_pRealDevice->Initialize(h, d, r); }
-	HRESULT __stdcall CreateEffect(REFGUID r, LPCDIEFFECT e, LPDIRECTINPUTEFFECT* eff, LPUNKNOWN u) override { return m_pRealDevice->CreateEffect(r, e, eff, u); }
-	HRESULT __stdcall EnumEffects(LPDIENUMEFFECTSCALLBACKW cb, LPVOID pv, DWORD d) override { return m_pRealDevice->EnumEffects(cb, pv, d); }
-	HRESULT __stdcall GetEffectInfo(LPDIEFFECTINFOW p, REFGUID r) override { return m_pRealDevice->GetEffectInfo(p, r); }
-	HRESULT __stdcall GetForceFeedbackState(LPDWORD p) override { return m_pRealDevice->GetForceFeedbackState(p); }
-	HRESULT __stdcall SendForceFeedbackCommand(DWORD d) override { return m_pRealDevice->SendForceFeedbackCommand(d); }
-	HRESULT __stdcall EnumCreatedEffectObjects(LPDIENUMCREATEDEFFECTOBJECTSCALLBACK cb, LPVOID pv, DWORD d) override { return m_pRealDevice->EnumCreatedEffectObjects(cb, pv, d); }
-	HRESULT __stdcall Escape(LPDIEFFESCAPE p) override { return m_pRealDevice->Escape(p); }
-	HRESULT __stdcall Poll() override { return m_pRealDevice->Poll(); }
-	HRESULT __stdcall SendDeviceData(DWORD d1, LPCDIDEVICEOBJECTDATA d2, LPDWORD d3, DWORD d4) override { return m_pRealDevice->SendDeviceData(d1, d2, d3, d4); }
-	HRESULT __stdcall EnumEffectsInFile(LPCWSTR s, LPDIENUMEFFECTSINFILECALLBACK cb, LPVOID pv, DWORD d) override { return m_pRealDevice->EnumEffectsInFile(s, cb, pv, d); }
-	HRESULT __stdcall WriteEffectToFile(LPCWSTR s, DWORD d1, LPDIFILEEFFECT d2, DWORD d3) override { return m_pRealDevice->WriteEffectToFile(s, d1, d2, d3); }
-	HRESULT __stdcall BuildActionMap(LPDIACTIONFORMATW p, LPCWSTR s, DWORD d) override { return m_pRealDevice->BuildActionMap(p, s, d); }
-	HRESULT __stdcall SetActionMap(LPDIACTIONFORMATW p, LPCWSTR s, DWORD d) override { return m_pRealDevice->SetActionMap(p, s, d); }
-	HRESULT __stdcall GetImageInfo(LPDIDEVICEIMAGEINFOHEADERW p) override { return m_pRealDevice->GetImageInfo(p); }
-};
 
-class WrapperIDirectInput8W : public IDirectInput8W {
-private: IDirectInput8W* m_pRealDInput;
-public:
-	WrapperIDirectInput8W(IDirectInput8W* pRealDInput) : m_pRealDInput(pRealDInput) {}
-	HRESULT __stdcall QueryInterface(REFIID riid, LPVOID* ppvObj) override { if (riid == IID_IUnknown || riid == IID_IDirectInput8W) { *ppvObj = this; AddRef(); return S_OK; } return m_pRealDInput->QueryInterface(riid, ppvObj); }
-	ULONG __stdcall AddRef() override { return m_pRealDInput->AddRef(); }
-	ULONG __stdcall Release() override { ULONG uRet = m_pRealDInput->Release(); if (uRet == 0) delete this; return uRet; }
-	HRESULT __stdcall CreateDevice(REFGUID rguid, LPDIRECTINPUTDEVICE8W* lplpDirectInputDevice, LPUNKNOWN pUnkOuter) override {
-		Log("CreateDevice() called.");
-		IDirectInputDevice8W* pRealDevice = nullptr;
-		HRESULT hr = m_pRealDInput->CreateDevice(rguid, &pRealDevice, pUnkOuter);
-		if (SUCCEEDED(hr)) {
-			DIDEVICEINSTANCEW didi;
-			didi.dwSize = sizeof(didi);
-			if (SUCCEEDED(pRealDevice->GetDeviceInfo(&didi))) {
-				Log(L"Device Info: " + std::wstring(didi.tszProductName));
+	ULONG __stdcall AddRef() override {
+		return InterlockedIncrement(&m_refCount);
+	}
 
-				std::stringstream ss;
-				ss << std::hex << std::setw(8) << std::setfill('0') << didi.dwDevType;
-				Log("Device Type: 0x" + ss.str());
+	ULONG __stdcall Release() override {
+		ULONG uRet = InterlockedDecrement(&m_refCount);
+		if (uRet == 0) {
+			delete this;
+		}
+		return uRet;
+	}
 
-				if (GET_DIDEVICE_TYPE(didi.dwDevType) == DI8DEVTYPE_1STPERSON && GET_DIDEVICE_SUBTYPE(didi.dwDevType) == DI8DEVTYPE1STPERSON_SIXDOF) {
-					Log("Device is a six degrees of freedom, first-person controller. Wrapping it.");
-					*lplpDirectInputDevice = new WrapperIDirectInputDevice8W(pRealDevice);
-				}
-				else {
-					Log("Device is not a six degrees of freedom, first-person controller. Passing it through.");
-					*lplpDirectInputDevice = pRealDevice;
-				}
-			}
-			else {
-				Log("Could not get device info. Passing it through.");
-				*lplpDirectInputDevice = pRealDevice;
+	HRESULT __stdcall CreateInstance(LPUNKNOWN pUnkOuter, REFIID riid, LPVOID* ppvObject) override {
+		Log("Class factory CreateInstance() called.");
+		if (pUnkOuter || riid == IID_IDirectInput8A || riid == IID_IDirectInput8W) {
+			HRESULT hr = m_pRealFactory->CreateInstance(pUnkOuter, riid, ppvObject);
+			if (SUCCEEDED(hr) && !pUnkOuter) {
+				*ppvObject = WrapRealDirectInput8(riid, *ppvObject);
 			}
+			return hr;
 		}
+
+		// Any other interface (usually IID_IUnknown) would be the raw object, and everything
+		// the game queried from it unfiltered. Create the object as IDirectInput8W and answer
+		// from the wrapper, which wraps a later query for either width.
+		if (!ppvObject) return E_POINTER;
+		*ppvObject = nullptr;
+		LPVOID pReal = nullptr;
+		HRESULT hr = m_pRealFactory->CreateInstance(nullptr, IID_IDirectInput8W, &pReal);
+		if (FAILED(hr)) return hr;
+		IUnknown* pWrapper = static_cast<IUnknown*>(WrapRealDirectInput8(IID_IDirectInput8W, pReal));
+		hr = pWrapper->QueryInterface(riid, ppvObject);
+		pWrapper->Release();
 		return hr;
 	}
-	HRESULT __stdcall EnumDevices(DWORD d, LPDIENUMDEVICESCALLBACKW cb, LPVOID pv, DWORD f) override { return m_pRealDInput->EnumDevices(d, cb, pv, f); }
-	HRESULT __stdcall GetDeviceStatus(REFGUID rguid) override { return m_pRealDInput->GetDeviceStatus(rguid); }
-	HRESULT __stdcall RunControlPanel(HWND h, DWORD d) override { return m_pRealDInput->RunControlPanel(h, d); }
-	HRESULT __stdcall Initialize(HINSTANCE h, DWORD d) override { return m_pRealDInput->Initialize(h, d); }
-	HRESULT __stdcall FindDevice(REFGUID r, LPCWSTR s, LPGUID g) override { return m_pRealDInput->FindDevice(r, s, g); }
-	HRESULT __stdcall EnumDevicesBySemantics(LPCWSTR s, LPDIACTIONFORMATW a, LPDIENUMDEVICESBYSEMANTICSCBW cb, LPVOID pv, DWORD d) override { return m_pRealDInput->EnumDevicesBySemantics(s, a, cb, pv, d); }
-	HRESULT __stdcall ConfigureDevices(LPDICONFIGUREDEVICESCALLBACK cb, LPDICONFIGUREDEVICESPARAMSW p, DWORD d, LPVOID pv) override { return m_pRealDInput->ConfigureDevices(cb, p, d, pv); }
+
+	HRESULT __stdcall LockServer(BOOL fLock) override {
+		if (fLock) {
+			++g_cServerLocks;
+		}
+		else {
+			--g_cServerLocks;
+		}
+		return m_pRealFactory->LockServer(fLock);
+	}
 };
 
 // --- DLL Export ---
 extern "C" HRESULT WINAPI DirectInput8Create(HINSTANCE hinst, DWORD dwVersion, REFIID riid, LPVOID* ppvOut, LPUNKNOWN punkOuter) {
-	if (!g_pfnDirectInput8Create) {
-		char szSystemPath[MAX_PATH];
-		GetSystemDirectoryA(szSystemPath, MAX_PATH);
-		strcat_s(szSystemPath, "\\dinput8.dll");
-		HMODULE hMod = LoadLibraryA(szSystemPath);
-		if (!hMod) return E_FAIL;
-		g_pfnDirectInput8Create = (DirectInput8Create_t)GetProcAddress(hMod, "DirectInput8Create");
-		if (!g_pfnDirectInput8Create) return E_FAIL;
+	const RealDInput8* pReal = GetRealDInput8();
+	if (!pReal) return E_FAIL;
+
+	if (t_chainDepth > 0) {
+		// The chained proxy called back into us. The outer call wraps whatever it returns,
+		// so go straight to the system DLL and hand back the raw object.
+		Log("DirectInput8Create() re-entered from the chained proxy. Calling the system DLL.");
+		return pReal->pfnSystemDirectInput8Create(hinst, dwVersion, riid, ppvOut, punkOuter);
 	}
 
 	Log("DirectInput8Create() export called by the game.");
+	StartConfigWatcher();
+	StartCapture();
+
+	ChainCallScope chainCallScope;
+
+	bool reusable = !punkOuter && ppvOut && (riid == IID_IDirectInput8A || riid == IID_IDirectInput8W);
+	if (reusable) {
+		IUnknown* pCached = FindCachedDirectInput(hinst, dwVersion, riid);
+		if (pCached) {
+			Log("DirectInput8Create(): reusing the existing DirectInput object.");
+			*ppvOut = pCached;
+			return DI_OK;
+		}
+	}
 
-	HRESULT hr;
 	if (riid == IID_IDirectInput8A) {
 		Log("Game requested ANSI interface (IDirectInput8A).");
-		IDirectInput8A* pRealDInputA = nullptr;
-		hr = g_pfnDirectInput8Create(hinst, dwVersion, IID_IDirectInput8A, (LPVOID*)&pRealDInputA, punkOuter);
-		if (SUCCEEDED(hr)) {
-			*ppvOut = new WrapperIDirectInput8A(pRealDInputA);
-		}
 	}
 	else if (riid == IID_IDirectInput8W) {
 		Log("Game requested Unicode interface (IDirectInput8W).");
-		IDirectInput8W* pRealDInputW = nullptr;
-		hr = g_pfnDirectInput8Create(hinst, dwVersion, IID_IDirectInput8W, (LPVOID*)&pRealDInputW, punkOuter);
-		if (SUCCEEDED(hr)) {
-			*ppvOut = new WrapperIDirectInput8W(pRealDInputW);
-		}
 	}
 	else {
 		Log("Game requested an unknown interface. Passing call to real DLL.");
-		hr = g_pfnDirectInput8Create(hinst, dwVersion, riid, ppvOut, punkOuter);
 	}
 
+	HRESULT hr = pReal->pfnDirectInput8Create(hinst, dwVersion, riid, ppvOut, punkOuter);
+	if (SUCCEEDED(hr)) {
+		*ppvOut = WrapRealDirectInput8(riid, *ppvOut);
+		if (riid == IID_IDirectInput8A && reusable) {
+			CacheDirectInput(hinst, dwVersion, riid, static_cast<WrapperIDirectInput8A*>(static_cast<IDirectInput8A*>(*ppvOut)));
+		}
+		else if (riid == IID_IDirectInput8W && reusable) {
+			CacheDirectInput(hinst, dwVersion, riid, static_cast<WrapperIDirectInput8W*>(static_cast<IDirectInput8W*>(*ppvOut)));
+		}
+	}
+	return hr;
+}
+
+// --- Forwarded exports ---
+// The rest of the real dinput8.dll export surface. These go through the function pointers
+// cached at init, so a forwarded call costs one indirect call and no GetProcAddress. Calls are
+// made under a ChainCallScope like DirectInput8Create, and one that arrives back here from
+// inside the chained proxy goes to the system DLL.
+static const ForwardedExports* GetForwardedExports() {
+	const RealDInput8* pReal = GetRealDInput8();
+	if (!pReal) return nullptr;
+	return t_chainDepth > 0 ? &pReal->systemExports : &pReal->exports;
+}
+
+STDAPI DllCanUnloadNow() {
+	if (g_cServerLocks.load() > 0) return S_FALSE;
+	const ForwardedExports* pExports = GetForwardedExports();
+	if (!pExports || !pExports->pfnDllCanUnloadNow) return S_FALSE;
+	ChainCallScope chainCallScope;
+	return pExports->pfnDllCanUnloadNow();
+}
+
+STDAPI DllGetClassObject(REFCLSID rclsid, REFIID riid, LPVOID* ppv) {
+	const ForwardedExports* pExports = GetForwardedExports();
+	if (!pExports || !pExports->pfnDllGetClassObject) return CLASS_E_CLASSNOTAVAILABLE;
+	// A re-entered call hands back the raw factory; the outer call wraps it.
+	if (rclsid != CLSID_DirectInput8 || t_chainDepth > 0) {
+		ChainCallScope chainCallScope;
+		return pExports->pfnDllGetClassObject(rclsid, riid, ppv);
+	}
+
+	Log("DllGetClassObject(CLSID_DirectInput8) called. Returning wrapping class factory.");
+	StartConfigWatcher();
+	StartCapture();
+	if (!ppv) return E_POINTER;
+	*ppv = nullptr;
+	IClassFactory* pRealFactory = nullptr;
+	HRESULT hr;
+	{
+		ChainCallScope chainCallScope;
+		hr = pExports->pfnDllGetClassObject(rclsid, IID_IClassFactory, (LPVOID*)&pRealFactory);
+	}
+	if (FAILED(hr)) return hr;
+
+	WrapperClassFactory* pFactory = new WrapperClassFactory(pRealFactory);
+	hr = pFactory->QueryInterface(riid, ppv);
+	pFactory->Release();
 	return hr;
 }
 
+STDAPI DllRegisterServer() {
+	const ForwardedExports* pExports = GetForwardedExports();
+	if (!pExports || !pExports->pfnDllRegisterServer) return E_FAIL;
+	ChainCallScope chainCallScope;
+	return pExports->pfnDllRegisterServer();
+}
+
+STDAPI DllUnregisterServer() {
+	const ForwardedExports* pExports = GetForwardedExports();
+	if (!pExports || !pExports->pfnDllUnregisterServer) return E_FAIL;
+	ChainCallScope chainCallScope;
+	return pExports->pfnDllUnregisterServer();
+}
+
+extern "C" LPCDIDATAFORMAT WINAPI GetdfDIJoystick() {
+	const ForwardedExports* pExports = GetForwardedExports();
+	if (!pExports || !pExports->pfnGetdfDIJoystick) return nullptr;
+	ChainCallScope chainCallScope;
+	return pExports->pfnGetdfDIJoystick();
+}
+
 // --- DllMain ---
 BOOL APIENTRY DllMain(HMODULE hModule, DWORD ul_reason_for_call, LPVOID lpReserved) {
 	switch (ul_reason_for_call) {
 	case DLL_PROCESS_ATTACH:
+		g_hThisModule = hModule;
+		LoadConfig(hModule);
+		SetConfigReloadListener(&DeviceState::RebuildAll);
 		// LOGGING: Log when the DLL is first loaded into the game process.
 		Log("DLL attached to process.");
 		break;
+	case DLL_PROCESS_DETACH:
+		LogStats();
+		StopCapture();
+		break;
 	case DLL_THREAD_ATTACH:
 	case DLL_THREAD_DETACH:
-	case DLL_PROCESS_DETACH:
 		break;
 	}
 	return TRUE;
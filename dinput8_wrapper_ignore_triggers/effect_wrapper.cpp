@@ -0,0 +1,500 @@
+// effect_wrapper.cpp
+//
+// See effect_wrapper.h.
+
+#include <algorithm>
+#include <cstring>
+
+#include "effect_wrapper.h"
+#include "log.h"
+#include "stats.h"
+
+// --- Parameter copies ---
+static const DWORD kEffectModifiers = DIEP_START | DIEP_NORESTART | DIEP_NODOWNLOAD;
+static const DWORD kObjectFlags = DIEFF_OBJECTIDS | DIEFF_OBJECTOFFSETS;
+static const DWORD kCoordinateFlags = DIEFF_CARTESIAN | DIEFF_POLAR | DIEFF_SPHERICAL;
+
+// The parameters a DIEFFECT of this size can carry.
+static DWORD GetParamsForSize(DWORD dwSize) {
+	if (dwSize == sizeof(DIEFFECT)) return DIEP_ALLPARAMS;
+	if (dwSize == sizeof(DIEFFECT_DX5)) return DIEP_ALLPARAMS_DX5;
+	return 0;
+}
+
+// The size of the type-specific parameters for an effect created with guid, or 0 if the type
+// is not one of the standard ones and the driver decides. Conditions take one DICONDITION per
+// axis or a single one for all of them, which CheckDeferredUpdate accepts as any multiple.
+static DWORD GetTypeSpecificSize(REFGUID guid) {
+	if (guid == GUID_ConstantForce) return sizeof(DICONSTANTFORCE);
+	if (guid == GUID_RampForce) return sizeof(DIRAMPFORCE);
+	if (guid == GUID_Square || guid == GUID_Sine || guid == GUID_Triangle || guid == GUID_SawtoothUp || guid == GUID_SawtoothDown) return sizeof(DIPERIODIC);
+	if (guid == GUID_Spring || guid == GUID_Damper || guid == GUID_Inertia || guid == GUID_Friction) return sizeof(DICONDITION);
+	if (guid == GUID_CustomForce) return sizeof(DICUSTOMFORCE);
+	return 0;
+}
+
+// Whether exactly one bit of mask is set in flags.
+static bool HasOneFlagOf(DWORD flags, DWORD mask) {
+	DWORD set = flags & mask;
+	return set != 0 && (set & (set - 1)) == 0;
+}
+
+// What the real SetParameters would reject outright, checked before an update is deferred
+// because the game is told DI_OK straight away. A DIEFFECT of an unknown size is left to the
+// real effect, which sees it undeferred.
+static HRESULT CheckDeferredUpdate(LPCDIEFFECT peff, DWORD params, DWORD typeSpecificSize) {
+	if (GetParamsForSize(peff->dwSize) == 0) {
+		return DI_OK;
+	}
+	if ((params & (DIEP_AXES | DIEP_TRIGGERBUTTON)) && !HasOneFlagOf(peff->dwFlags, kObjectFlags)) {
+		return DIERR_INVALIDPARAM;
+	}
+	if ((params & DIEP_DIRECTION) && !HasOneFlagOf(peff->dwFlags, kCoordinateFlags)) {
+		return DIERR_INVALIDPARAM;
+	}
+	if ((params & DIEP_TYPESPECIFICPARAMS) && typeSpecificSize != 0) {
+		DWORD cb = peff->cbTypeSpecificParams;
+		bool valid = typeSpecificSize == sizeof(DICONDITION) ? cb != 0 && cb % typeSpecificSize == 0 : cb == typeSpecificSize;
+		if (!valid) {
+			return DIERR_INVALIDPARAM;
+		}
+	}
+	return DI_OK;
+}
+
+// Copies the parameters in mask out of peff. Returns false if peff is malformed for them, in
+// which case the real effect should see the call as it is.
+static bool ReadEffect(LPCDIEFFECT peff, DWORD mask, EffectParams* pOut) {
+	if ((mask & ~GetParamsForSize(peff->dwSize)) != 0) {
+		return false;
+	}
+	if ((mask & (DIEP_AXES | DIEP_DIRECTION)) && peff->cAxes > 0 && (((mask & DIEP_AXES) && !peff->rgdwAxes) || ((mask & DIEP_DIRECTION) && !peff->rglDirection))) {
+		return false;
+	}
+	if ((mask & DIEP_ENVELOPE) && peff->lpEnvelope && peff->lpEnvelope->dwSize != sizeof(DIENVELOPE)) {
+		return false;
+	}
+	if ((mask & DIEP_TYPESPECIFICPARAMS) && peff->cbTypeSpecificParams > 0 && !peff->lpvTypeSpecificParams) {
+		return false;
+	}
+
+	if (mask & DIEP_DURATION) pOut->dwDuration = peff->dwDuration;
+	if (mask & DIEP_SAMPLEPERIOD) pOut->dwSamplePeriod = peff->dwSamplePeriod;
+	if (mask & DIEP_GAIN) pOut->dwGain = peff->dwGain;
+	if (mask & DIEP_TRIGGERBUTTON) {
+		pOut->dwTriggerButton = peff->dwTriggerButton;
+		pOut->triggerObjectFlags = peff->dwFlags & kObjectFlags;
+	}
+	if (mask & DIEP_TRIGGERREPEATINTERVAL) pOut->dwTriggerRepeatInterval = peff->dwTriggerRepeatInterval;
+	if (mask & DIEP_STARTDELAY) pOut->dwStartDelay = peff->dwStartDelay;
+	if (mask & DIEP_AXES) {
+		pOut->axes.assign(peff->rgdwAxes, peff->rgdwAxes + peff->cAxes);
+		pOut->axesObjectFlags = peff->dwFlags & kObjectFlags;
+	}
+	if (mask & DIEP_DIRECTION) {
+		pOut->direction.assign(peff->rglDirection, peff->rglDirection + peff->cAxes);
+		pOut->coordinateFlags = peff->dwFlags & kCoordinateFlags;
+	}
+	if (mask & DIEP_ENVELOPE) {
+		pOut->hasEnvelope = peff->lpEnvelope != nullptr;
+		if (pOut->hasEnvelope) {
+			pOut->envelope = *peff->lpEnvelope;
+		}
+	}
+	if (mask & DIEP_TYPESPECIFICPARAMS) {
+		const BYTE* pParams = static_cast<const BYTE*>(peff->lpvTypeSpecificParams);
+		pOut->typeSpecific.assign(pParams, pParams + peff->cbTypeSpecificParams);
+	}
+	return true;
+}
+
+static void CopyParams(const EffectParams& source, DWORD mask, EffectParams* pDest) {
+	if (mask & DIEP_DURATION) pDest->dwDuration = source.dwDuration;
+	if (mask & DIEP_SAMPLEPERIOD) pDest->dwSamplePeriod = source.dwSamplePeriod;
+	if (mask & DIEP_GAIN) pDest->dwGain = source.dwGain;
+	if (mask & DIEP_TRIGGERBUTTON) {
+		pDest->dwTriggerButton = source.dwTriggerButton;
+		pDest->triggerObjectFlags = source.triggerObjectFlags;
+	}
+	if (mask & DIEP_TRIGGERREPEATINTERVAL) pDest->dwTriggerRepeatInterval = source.dwTriggerRepeatInterval;
+	if (mask & DIEP_STARTDELAY) pDest->dwStartDelay = source.dwStartDelay;
+	if (mask & DIEP_AXES) {
+		pDest->axes = source.axes;
+		pDest->axesObjectFlags = source.axesObjectFlags;
+	}
+	if (mask & DIEP_DIRECTION) {
+		pDest->direction = source.direction;
+		pDest->coordinateFlags = source.coordinateFlags;
+	}
+	if (mask & DIEP_ENVELOPE) {
+		pDest->hasEnvelope = source.hasEnvelope;
+		pDest->envelope = source.envelope;
+	}
+	if (mask & DIEP_TYPESPECIFICPARAMS) pDest->typeSpecific = source.typeSpecific;
+}
+
+// The parameters in mask whose values differ between a and b.
+static DWORD DiffParams(const EffectParams& a, const EffectParams& b, DWORD mask) {
+	DWORD changed = 0;
+	if (a.dwDuration != b.dwDuration) changed |= DIEP_DURATION;
+	if (a.dwSamplePeriod != b.dwSamplePeriod) changed |= DIEP_SAMPLEPERIOD;
+	if (a.dwGain != b.dwGain) changed |= DIEP_GAIN;
+	if (a.dwTriggerButton != b.dwTriggerButton || a.triggerObjectFlags != b.triggerObjectFlags) changed |= DIEP_TRIGGERBUTTON;
+	if (a.dwTriggerRepeatInterval != b.dwTriggerRepeatInterval) changed |= DIEP_TRIGGERREPEATINTERVAL;
+	if (a.dwStartDelay != b.dwStartDelay) changed |= DIEP_STARTDELAY;
+	if (a.axes != b.axes || a.axesObjectFlags != b.axesObjectFlags) changed |= DIEP_AXES;
+	if (a.direction != b.direction || a.coordinateFlags != b.coordinateFlags) changed |= DIEP_DIRECTION;
+	if (a.hasEnvelope != b.hasEnvelope || (a.hasEnvelope && memcmp(&a.envelope, &b.envelope, sizeof(a.envelope)) != 0)) changed |= DIEP_ENVELOPE;
+	if (a.typeSpecific != b.typeSpecific) changed |= DIEP_TYPESPECIFICPARAMS;
+	return changed & mask;
+}
+
+// A DIEFFECT carrying the parameters in mask, pointing into params' arrays.
+static void BuildEffect(EffectParams& params, DWORD mask, DIEFFECT* pOut) {
+	memset(pOut, 0, sizeof(*pOut));
+	pOut->dwSize = sizeof(DIEFFECT);
+	if (mask & (DIEP_AXES | DIEP_TRIGGERBUTTON)) {
+		pOut->dwFlags |= (mask & DIEP_AXES) ? params.axesObjectFlags : params.triggerObjectFlags;
+	}
+	if (mask & DIEP_DIRECTION) {
+		pOut->dwFlags |= params.coordinateFlags;
+	}
+	pOut->dwDuration = params.dwDuration;
+	pOut->dwSamplePeriod = params.dwSamplePeriod;
+	pOut->dwGain = params.dwGain;
+	pOut->dwTriggerButton = params.dwTriggerButton;
+	pOut->dwTriggerRepeatInterval = params.dwTriggerRepeatInterval;
+	pOut->dwStartDelay = params.dwStartDelay;
+	if (mask & DIEP_AXES) {
+		pOut->cAxes = static_cast<DWORD>(params.axes.size());
+		pOut->rgdwAxes = params.axes.empty() ? nullptr : params.axes.data();
+	}
+	if (mask & DIEP_DIRECTION) {
+		pOut->cAxes = static_cast<DWORD>(params.direction.size());
+		pOut->rglDirection = params.direction.empty() ? nullptr : params.direction.data();
+	}
+	pOut->lpEnvelope = params.hasEnvelope ? &params.envelope : nullptr;
+	pOut->cbTypeSpecificParams = static_cast<DWORD>(params.typeSpecific.size());
+	pOut->lpvTypeSpecificParams = params.typeSpecific.empty() ? nullptr : params.typeSpecific.data();
+}
+
+// --- EffectSet ---
+void EffectSet::Add(WrapperIDirectInputEffect* pEffect) {
+	AcquireSRWLockExclusive(&m_lock);
+	m_effects.push_back(pEffect);
+	ReleaseSRWLockExclusive(&m_lock);
+}
+
+void EffectSet::Remove(WrapperIDirectInputEffect* pEffect) {
+	AcquireSRWLockExclusive(&m_lock);
+	m_effects.erase(std::remove(m_effects.begin(), m_effects.end(), pEffect), m_effects.end());
+	ReleaseSRWLockExclusive(&m_lock);
+}
+
+// Effects only take their own lock inside these calls, never the set's, so holding the set
+// shared across them cannot deadlock.
+void EffectSet::FlushAll() {
+	// Cleared first: an update deferred while the loop runs sets it again and is applied at
+	// the next boundary at the latest.
+	m_hasPending.store(false, std::memory_order_release);
+	AcquireSRWLockShared(&m_lock);
+	for (WrapperIDirectInputEffect* pEffect : m_effects) {
+		pEffect->Flush();
+	}
+	ReleaseSRWLockShared(&m_lock);
+}
+
+void EffectSet::OnAllStopped(WrapperIDirectInputEffect* pExcept) {
+	AcquireSRWLockShared(&m_lock);
+	for (WrapperIDirectInputEffect* pEffect : m_effects) {
+		if (pEffect != pExcept) {
+			pEffect->OnStopped();
+		}
+	}
+	ReleaseSRWLockShared(&m_lock);
+}
+
+IDirectInputEffect* EffectSet::FindWrapper(IDirectInputEffect* pRealEffect) {
+	IDirectInputEffect* pWrapper = nullptr;
+	AcquireSRWLockShared(&m_lock);
+	for (WrapperIDirectInputEffect* pEffect : m_effects) {
+		if (pEffect->GetRealEffect() == pRealEffect) {
+			pWrapper = pEffect;
+			break;
+		}
+	}
+	ReleaseSRWLockShared(&m_lock);
+	return pWrapper;
+}
+
+BOOL CALLBACK EffectSet::EnumCreatedEffect(LPDIRECTINPUTEFFECT peff, LPVOID pvRef) {
+	EnumContext* pContext = static_cast<EnumContext*>(pvRef);
+	IDirectInputEffect* pWrapper = pContext->pSet->FindWrapper(peff);
+	return pContext->lpCallback(pWrapper ? pWrapper : peff, pContext->pvRef);
+}
+
+// --- WrapperIDirectInputEffect ---
+WrapperIDirectInputEffect::WrapperIDirectInputEffect(IDirectInputEffect* pRealEffect, IUnknown* pDevice, EffectSet* pSet, REFGUID rguid, LPCDIEFFECT lpeff, HRESULT hr)
+	: m_pRealEffect(pRealEffect), m_pDevice(pDevice), m_pSet(pSet), m_refCount(1), m_lock(SRWLOCK_INIT), m_applied(), m_appliedMask(0), m_pending(), m_pendingMask(0), m_playingInfinite(false), m_startIterations(0), m_startFlags(0), m_typeSpecificSize(GetTypeSpecificSize(rguid)) {
+	m_pDevice->AddRef();
+	// CreateEffect applies every parameter in lpeff. DI_TRUNCATED means the device adjusted
+	// some, so only an exact success tells us what the effect holds.
+	if (lpeff && hr == DI_OK) {
+		DWORD mask = GetParamsForSize(lpeff->dwSize);
+		if (mask != 0 && ReadEffect(lpeff, mask, &m_applied)) {
+			m_appliedMask = mask;
+		}
+	}
+	m_pSet->Add(this);
+}
+
+WrapperIDirectInputEffect::~WrapperIDirectInputEffect() {
+	m_pSet->Remove(this);
+	m_pRealEffect->Release();
+	m_pDevice->Release();
+}
+
+void WrapperIDirectInputEffect::ForgetLocked() {
+	m_appliedMask = 0;
+	m_pendingMask = 0;
+	m_playingInfinite = false;
+}
+
+// Restarting an effect replays its start delay and its envelope's attack, so it is only
+// skipped when the effect plays forever, has neither, and would be started exactly as it was.
+// DIES_SOLO also stops the device's other effects and is never skipped.
+bool WrapperIDirectInputEffect::RestartIsNoOpLocked(DWORD dwIterations, DWORD dwFlags) const {
+	const DWORD needed = DIEP_DURATION | DIEP_STARTDELAY | DIEP_ENVELOPE;
+	return m_playingInfinite && (m_appliedMask & needed) == needed && m_applied.dwStartDelay == 0 && !m_applied.hasEnvelope
+		&& !(dwFlags & DIES_SOLO) && dwIterations == m_startIterations && dwFlags == m_startFlags;
+}
+
+void WrapperIDirectInputEffect::OnStartedLocked(DWORD dwIterations, DWORD dwFlags) {
+	m_playingInfinite = (m_appliedMask & DIEP_DURATION) && m_applied.dwDuration == INFINITE;
+	m_startIterations = dwIterations;
+	m_startFlags = dwFlags;
+}
+
+HRESULT WrapperIDirectInputEffect::ApplyLocked(DWORD modifiers) {
+	// Parameters not known to be applied always go out; known ones only if they changed.
+	DWORD changed = (m_pendingMask & ~m_appliedMask) | DiffParams(m_pending, m_applied, m_pendingMask & m_appliedMask);
+	m_pendingMask = 0;
+	if (changed == 0 && modifiers == 0) {
+		return DI_OK;
+	}
+	if (changed == 0 && modifiers == DIEP_START && RestartIsNoOpLocked(1, 0)) {
+		return DI_OK;
+	}
+
+	DIEFFECT effect;
+	BuildEffect(m_pending, changed, &effect);
+	HRESULT hr = m_pRealEffect->SetParameters(&effect, changed | modifiers);
+	// Truncated values are not what we asked for, so they are not known either.
+	if (SUCCEEDED(hr) && hr != DI_TRUNCATED && hr != DI_TRUNCATEDANDRESTARTED) {
+		CopyParams(m_pending, changed, &m_applied);
+		m_appliedMask |= changed;
+	}
+	else {
+		m_appliedMask &= ~changed;
+	}
+	if (changed & DIEP_DURATION) {
+		m_playingInfinite = false;
+	}
+	if ((modifiers & DIEP_START) && SUCCEEDED(hr)) {
+		OnStartedLocked(1, 0);
+	}
+	return hr;
+}
+
+// Applies deferred updates, if any. The game was told DI_OK when it made them, so a failure
+// is logged and counted here; the caller decides whether it can still report it.
+HRESULT WrapperIDirectInputEffect::FlushLocked() {
+	if (m_pendingMask == 0) {
+		return DI_OK;
+	}
+	HRESULT hr = ApplyLocked(0);
+	if (FAILED(hr)) {
+		Log("Applying a deferred effect update failed (0x%08lx).", static_cast<unsigned long>(hr));
+		AddStat(kStatEffectUpdateFailures);
+	}
+	return hr;
+}
+
+void WrapperIDirectInputEffect::Flush() {
+	AcquireSRWLockExclusive(&m_lock);
+	FlushLocked();
+	ReleaseSRWLockExclusive(&m_lock);
+}
+
+void WrapperIDirectInputEffect::OnStopped() {
+	AcquireSRWLockExclusive(&m_lock);
+	m_playingInfinite = false;
+	ReleaseSRWLockExclusive(&m_lock);
+}
+
+// --- IUnknown methods ---
+HRESULT __stdcall WrapperIDirectInputEffect::QueryInterface(REFIID riid, LPVOID* ppvObj) {
+	if (riid == IID_IUnknown || riid == IID_IDirectInputEffect) {
+		*ppvObj = this;
+		AddRef();
+		return S_OK;
+	}
+	return m_pRealEffect->QueryInterface(riid, ppvObj);
+}
+
+ULONG __stdcall WrapperIDirectInputEffect::AddRef() {
+	return InterlockedIncrement(&m_refCount);
+}
+
+ULONG __stdcall WrapperIDirectInputEffect::Release() {
+	ULONG uRet = InterlockedDecrement(&m_refCount);
+	if (uRet == 0) {
+		delete this;
+	}
+	return uRet;
+}
+
+// --- IDirectInputEffect methods ---
+HRESULT __stdcall WrapperIDirectInputEffect::Initialize(HINSTANCE hinst, DWORD dwVersion, REFGUID rguid) {
+	AcquireSRWLockExclusive(&m_lock);
+	HRESULT hr = m_pRealEffect->Initialize(hinst, dwVersion, rguid);
+	ForgetLocked();
+	m_typeSpecificSize = GetTypeSpecificSize(rguid);
+	ReleaseSRWLockExclusive(&m_lock);
+	return hr;
+}
+
+HRESULT __stdcall WrapperIDirectInputEffect::GetEffectGuid(LPGUID pguid) {
+	return m_pRealEffect->GetEffectGuid(pguid);
+}
+
+HRESULT __stdcall WrapperIDirectInputEffect::GetParameters(LPDIEFFECT peff, DWORD dwFlags) {
+	m_pSet->FlushExpired();
+	Flush();
+	return m_pRealEffect->GetParameters(peff, dwFlags);
+}
+
+HRESULT __stdcall WrapperIDirectInputEffect::SetParameters(LPCDIEFFECT peff, DWORD dwFlags) {
+	m_pSet->FlushExpired();
+	if (!peff) {
+		return m_pRealEffect->SetParameters(peff, dwFlags);
+	}
+	DWORD params = dwFlags & DIEP_ALLPARAMS;
+	DWORD modifiers = dwFlags & kEffectModifiers;
+	bool understood = (dwFlags & ~(DIEP_ALLPARAMS | kEffectModifiers)) == 0;
+	bool defer = understood && modifiers == 0 && m_pSet->CanDefer();
+	bool deferred = false;
+	HRESULT hr;
+	AcquireSRWLockExclusive(&m_lock);
+	if (defer) {
+		// Rejected before anything below changes.
+		hr = CheckDeferredUpdate(peff, params, m_typeSpecificSize);
+		if (FAILED(hr)) {
+			ReleaseSRWLockExclusive(&m_lock);
+			return hr;
+		}
+	}
+	// One DIEFFECT has a single object-flag for rgdwAxes and dwTriggerButton. If this update
+	// addresses one of them differently from a pending update to the other, apply the pending
+	// one first.
+	DWORD objectFlags = peff->dwFlags & kObjectFlags;
+	bool objectConflict = ((params & DIEP_AXES) && (m_pendingMask & DIEP_TRIGGERBUTTON) && !(params & DIEP_TRIGGERBUTTON) && m_pending.triggerObjectFlags != objectFlags)
+		|| ((params & DIEP_TRIGGERBUTTON) && (m_pendingMask & DIEP_AXES) && !(params & DIEP_AXES) && m_pending.axesObjectFlags != objectFlags);
+	// Pending updates were made without DIEP_NORESTART or DIEP_NODOWNLOAD, so they must not be
+	// sent with them.
+	if (objectConflict || (modifiers & (DIEP_NORESTART | DIEP_NODOWNLOAD))) {
+		FlushLocked();
+	}
+
+	if (!understood || !ReadEffect(peff, params, &m_pending)) {
+		// Something this wrapper does not understand: apply what is pending, then let the real
+		// effect judge the call and forget what it may have changed.
+		FlushLocked();
+		hr = m_pRealEffect->SetParameters(peff, dwFlags);
+		m_appliedMask &= ~params;
+		m_playingInfinite = false;
+	}
+	else {
+		m_pendingMask |= params;
+		if (!defer) {
+			hr = ApplyLocked(modifiers);
+		}
+		else {
+			hr = DI_OK;
+			deferred = m_pendingMask != 0;
+		}
+	}
+	ReleaseSRWLockExclusive(&m_lock);
+	if (deferred) {
+		m_pSet->MarkPending();
+	}
+	return hr;
+}
+
+HRESULT __stdcall WrapperIDirectInputEffect::Start(DWORD dwIterations, DWORD dwFlags) {
+	// This effect's own deferred update goes first, so its result is not lost in the flush of
+	// the whole set. It was reported to the game as DI_OK; starting would play the effect
+	// with parameters the game did not ask for, so a failure is reported instead.
+	AcquireSRWLockExclusive(&m_lock);
+	HRESULT hr = FlushLocked();
+	ReleaseSRWLockExclusive(&m_lock);
+	m_pSet->FlushPending();
+	AcquireSRWLockExclusive(&m_lock);
+	if (SUCCEEDED(hr)) {
+		hr = FlushLocked();
+	}
+	bool skip = FAILED(hr) || RestartIsNoOpLocked(dwIterations, dwFlags);
+	if (!skip) {
+		hr = m_pRealEffect->Start(dwIterations, dwFlags);
+		if (SUCCEEDED(hr)) {
+			OnStartedLocked(dwIterations, dwFlags);
+		}
+	}
+	ReleaseSRWLockExclusive(&m_lock);
+	if (!skip && SUCCEEDED(hr) && (dwFlags & DIES_SOLO)) {
+		m_pSet->OnAllStopped(this);
+	}
+	return hr;
+}
+
+HRESULT __stdcall WrapperIDirectInputEffect::Stop() {
+	m_pSet->FlushPending();
+	AcquireSRWLockExclusive(&m_lock);
+	FlushLocked();
+	HRESULT hr = m_pRealEffect->Stop();
+	m_playingInfinite = false;
+	ReleaseSRWLockExclusive(&m_lock);
+	return hr;
+}
+
+HRESULT __stdcall WrapperIDirectInputEffect::GetEffectStatus(LPDWORD pdwFlags) {
+	m_pSet->FlushExpired();
+	return m_pRealEffect->GetEffectStatus(pdwFlags);
+}
+
+HRESULT __stdcall WrapperIDirectInputEffect::Download() {
+	m_pSet->FlushPending();
+	Flush();
+	return m_pRealEffect->Download();
+}
+
+HRESULT __stdcall WrapperIDirectInputEffect::Unload() {
+	m_pSet->FlushExpired();
+	AcquireSRWLockExclusive(&m_lock);
+	FlushLocked();
+	HRESULT hr = m_pRealEffect->Unload();
+	m_playingInfinite = false;
+	ReleaseSRWLockExclusive(&m_lock);
+	return hr;
+}
+
+HRESULT __stdcall WrapperIDirectInputEffect::Escape(LPDIEFFESCAPE pesc) {
+	m_pSet->FlushExpired();
+	AcquireSRWLockExclusive(&m_lock);
+	FlushLocked();
+	// A driver-specific command may change anything.
+	HRESULT hr = m_pRealEffect->Escape(pesc);
+	ForgetLocked();
+	ReleaseSRWLockExclusive(&m_lock);
+	return hr;
+}
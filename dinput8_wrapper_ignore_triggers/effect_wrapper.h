@@ -0,0 +1,202 @@
+// effect_wrapper.h
+//
+// Force-feedback effects created through a wrapped device. Games that call SetParameters or
+// Start every frame with unchanged values flood the HID output path, and on Bluetooth
+// controllers every output report competes with input reports. WrapperIDirectInputEffect keeps
+// the parameters last applied to the real effect and collects the game's updates until the
+// device's next frame boundary (its GetDeviceState, GetDeviceData or Poll). Only the parameters
+// that actually changed are then applied, in one SetParameters call with the merged DIEP_*
+// flags.
+//
+// Updates are only deferred while the game is polling the device; otherwise there may be no
+// next frame. One that is still waiting after kEffectDeferMs is applied by the next call on
+// any of the device's effects, and Start, Stop and Download apply every pending update first.
+//
+// Updates that carry DIEP_START, DIEP_NORESTART or DIEP_NODOWNLOAD are applied straight away,
+// since the game expects their result. Pending updates are merged into a DIEP_START call, but
+// applied on their own before DIEP_NORESTART or DIEP_NODOWNLOAD, which would otherwise change
+// what happens to them. A deferred update is reported as DI_OK, so it is first checked for
+// what the real effect would reject outright (object and coordinate flags, the size of the
+// type-specific parameters). If applying it still fails, the failure is logged and counted
+// (kStatEffectUpdateFailures) and the parameters are re-sent on the next update.
+
+#pragma once
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <dinput.h>
+#include <atomic>
+#include <vector>
+
+#include "slab_pool.h"
+
+class WrapperIDirectInputEffect;
+
+// How long a deferred update may wait for the device's next frame, and how recently the device
+// must have been polled for updates to be deferred at all.
+static const DWORD kEffectDeferMs = 50;
+
+// The effects created through one device wrapper, which owns the set. Every effect holds a
+// reference on its device, so the set outlives its members.
+class EffectSet {
+public:
+	EffectSet() : m_lock(SRWLOCK_INIT), m_hasPending(false), m_pendingSinceMs(0), m_sawFrame(false), m_lastFrameMs(0) {}
+
+	void Add(WrapperIDirectInputEffect* pEffect);
+	void Remove(WrapperIDirectInputEffect* pEffect);
+
+	// Whether an update may wait for the next frame: the device was polled within the last
+	// kEffectDeferMs.
+	bool CanDefer() const {
+		return m_sawFrame.load(std::memory_order_relaxed) && GetTickCount() - m_lastFrameMs.load(std::memory_order_relaxed) < kEffectDeferMs;
+	}
+
+	// Called by an effect that deferred an update.
+	void MarkPending() {
+		if (!m_hasPending.load(std::memory_order_relaxed)) {
+			m_pendingSinceMs.store(GetTickCount(), std::memory_order_relaxed);
+		}
+		m_hasPending.store(true, std::memory_order_release);
+	}
+
+	// The frame boundary: GetDeviceState, GetDeviceData or Poll.
+	void OnFrame() {
+		m_lastFrameMs.store(GetTickCount(), std::memory_order_relaxed);
+		m_sawFrame.store(true, std::memory_order_relaxed);
+		FlushPending();
+	}
+
+	// Applies every effect's deferred updates. A single load when there are none.
+	void FlushPending() {
+		if (m_hasPending.load(std::memory_order_acquire)) {
+			FlushAll();
+		}
+	}
+
+	// Called on every effect call: applies deferred updates that have waited kEffectDeferMs,
+	// in case the frame they were waiting for never comes.
+	void FlushExpired() {
+		if (m_hasPending.load(std::memory_order_acquire) && GetTickCount() - m_pendingSinceMs.load(std::memory_order_relaxed) >= kEffectDeferMs) {
+			FlushAll();
+		}
+	}
+
+	// After something stopped every effect on the device: Unacquire, a stop or reset command,
+	// lost input, or another effect started with DIES_SOLO (pExcept).
+	void OnAllStopped(WrapperIDirectInputEffect* pExcept = nullptr);
+
+	// Calls lpCallback with the wrapper of each effect the real device enumerates, or the real
+	// effect if it was not created through the wrapper.
+	template <class Device>
+	HRESULT EnumCreatedEffects(Device* pRealDevice, LPDIENUMCREATEDEFFECTOBJECTSCALLBACK lpCallback, LPVOID pvRef, DWORD fl) {
+		if (!lpCallback) {
+			return pRealDevice->EnumCreatedEffectObjects(lpCallback, pvRef, fl);
+		}
+		EnumContext context = { this, lpCallback, pvRef };
+		return pRealDevice->EnumCreatedEffectObjects(&EnumCreatedEffect, &context, fl);
+	}
+
+private:
+	struct EnumContext {
+		EffectSet* pSet;
+		LPDIENUMCREATEDEFFECTOBJECTSCALLBACK lpCallback;
+		LPVOID pvRef;
+	};
+
+	static BOOL CALLBACK EnumCreatedEffect(LPDIRECTINPUTEFFECT peff, LPVOID pvRef);
+	void FlushAll();
+	// No reference is added.
+	IDirectInputEffect* FindWrapper(IDirectInputEffect* pRealEffect);
+
+	SRWLOCK m_lock;
+	std::vector<WrapperIDirectInputEffect*> m_effects;
+	std::atomic<bool> m_hasPending;
+	// When the oldest pending update was deferred, by GetTickCount.
+	std::atomic<DWORD> m_pendingSinceMs;
+	// Whether the device has been polled, and when it last was.
+	std::atomic<bool> m_sawFrame;
+	std::atomic<DWORD> m_lastFrameMs;
+};
+
+// A copy of the parameters in a DIEFFECT, with its own arrays.
+struct EffectParams {
+	// DIEFF_OBJECTIDS or DIEFF_OBJECTOFFSETS, for rgdwAxes and dwTriggerButton respectively.
+	DWORD axesObjectFlags;
+	DWORD triggerObjectFlags;
+	// DIEFF_CARTESIAN, DIEFF_POLAR or DIEFF_SPHERICAL.
+	DWORD coordinateFlags;
+	DWORD dwDuration;
+	DWORD dwSamplePeriod;
+	DWORD dwGain;
+	DWORD dwTriggerButton;
+	DWORD dwTriggerRepeatInterval;
+	DWORD dwStartDelay;
+	std::vector<DWORD> axes;
+	std::vector<LONG> direction;
+	bool hasEnvelope;
+	DIENVELOPE envelope;
+	std::vector<BYTE> typeSpecific;
+};
+
+class WrapperIDirectInputEffect final : public IDirectInputEffect, public SlabAllocated<WrapperIDirectInputEffect> {
+public:
+	// Takes over the caller's reference on pRealEffect and adds one on pDevice. rguid, lpeff
+	// and hr are what CreateEffect was given and returned.
+	WrapperIDirectInputEffect(IDirectInputEffect* pRealEffect, IUnknown* pDevice, EffectSet* pSet, REFGUID rguid, LPCDIEFFECT lpeff, HRESULT hr);
+
+	IDirectInputEffect* GetRealEffect() const { return m_pRealEffect; }
+
+	// Applies deferred updates, if any.
+	void Flush();
+	// The real effect is known to have stopped.
+	void OnStopped();
+
+	// --- IUnknown methods ---
+	HRESULT __stdcall QueryInterface(REFIID riid, LPVOID* ppvObj) override;
+	ULONG __stdcall AddRef() override;
+	ULONG __stdcall Release() override;
+
+	// --- IDirectInputEffect methods ---
+	HRESULT __stdcall Initialize(HINSTANCE hinst, DWORD dwVersion, REFGUID rguid) override;
+	HRESULT __stdcall GetEffectGuid(LPGUID pguid) override;
+	HRESULT __stdcall GetParameters(LPDIEFFECT peff, DWORD dwFlags) override;
+	HRESULT __stdcall SetParameters(LPCDIEFFECT peff, DWORD dwFlags) override;
+	HRESULT __stdcall Start(DWORD dwIterations, DWORD dwFlags) override;
+	HRESULT __stdcall Stop() override;
+	HRESULT __stdcall GetEffectStatus(LPDWORD pdwFlags) override;
+	HRESULT __stdcall Download() override;
+	HRESULT __stdcall Unload() override;
+	HRESULT __stdcall Escape(LPDIEFFESCAPE pesc) override;
+
+private:
+	~WrapperIDirectInputEffect();
+
+	// All expect m_lock held exclusively.
+	HRESULT ApplyLocked(DWORD modifiers);
+	HRESULT FlushLocked();
+	void ForgetLocked();
+	bool RestartIsNoOpLocked(DWORD dwIterations, DWORD dwFlags) const;
+	void OnStartedLocked(DWORD dwIterations, DWORD dwFlags);
+
+	IDirectInputEffect* m_pRealEffect;
+	IUnknown* m_pDevice;
+	EffectSet* m_pSet;
+	LONG m_refCount;
+	// Guards everything below.
+	SRWLOCK m_lock;
+	// What the real effect holds, for the DIEP_* parameters in m_appliedMask.
+	EffectParams m_applied;
+	DWORD m_appliedMask;
+	// Updates not yet applied, for the DIEP_* parameters in m_pendingMask.
+	EffectParams m_pending;
+	DWORD m_pendingMask;
+	// Started with an infinite duration and not stopped since, and the dwIterations and
+	// dwFlags it was last started with (1 and 0 for DIEP_START).
+	bool m_playingInfinite;
+	DWORD m_startIterations;
+	DWORD m_startFlags;
+	// The type-specific parameter size the effect's type takes, see GetTypeSpecificSize.
+	DWORD m_typeSpecificSize;
+};
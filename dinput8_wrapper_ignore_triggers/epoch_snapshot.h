@@ -0,0 +1,92 @@
+// epoch_snapshot.h
+//
+// An immutable object published by pointer and freed only once no reader can still see it
+// (epoch-based reclamation). Used for the config snapshot and for each device's filter plan,
+// so the GetDeviceState path reads them without locking or allocating.
+//
+// Readers announce themselves in one of two counters, chosen by the parity of the current
+// epoch. A publisher swaps the pointer, advances the epoch so new readers count in the other
+// counter, then waits for the old counter to drain before handing the old object back to be
+// freed. Any reader that could have loaded the old pointer registered before the swap and is
+// therefore counted under the old epoch.
+//
+// Readers hold a guard only for the pointer load and the work on the object itself: a filter
+// kernel or a copy of a few hundred bytes, never a call into the real device, a lock or the
+// log. A publisher therefore waits for at most one such run per reader, microseconds, unless a
+// reader is preempted inside its guard; then it waits until that thread runs again, polling
+// once per scheduler tick (1 to 16 ms). Publishers are the config reload thread and the
+// device calls that change what a filter is built from (SetDataFormat, SetProperty,
+// SetActionMap), never the read path.
+
+#pragma once
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <atomic>
+
+template <class T>
+class EpochSnapshot {
+public:
+	constexpr explicit EpochSnapshot(const T* pInitial) : m_pCurrent(pInitial), m_epoch(0), m_readers{ {0}, {0} } {}
+
+	// Pins the current object for the guard's lifetime. Holding a guard while taking a lock a
+	// publisher may hold deadlocks, since Publish waits for every guard of the old epoch, and
+	// holding one across a blocking call makes Publish wait as long; keep guards short.
+	class ReadGuard {
+	public:
+		explicit ReadGuard(EpochSnapshot& owner) : m_owner(owner) {
+			for (;;) {
+				unsigned epoch = owner.m_epoch.load();
+				m_slot = epoch & 1;
+				owner.m_readers[m_slot].fetch_add(1);
+				if (owner.m_epoch.load() == epoch) {
+					break;
+				}
+				// A publisher flipped the epoch in between; register under the new one instead.
+				owner.m_readers[m_slot].fetch_sub(1);
+			}
+			m_pObject = owner.m_pCurrent.load();
+		}
+
+		~ReadGuard() {
+			m_owner.m_readers[m_slot].fetch_sub(1, std::memory_order_release);
+		}
+
+		const T& Get() const { return *m_pObject; }
+		const T* operator->() const { return m_pObject; }
+
+	private:
+		ReadGuard(const ReadGuard&) = delete;
+		ReadGuard& operator=(const ReadGuard&) = delete;
+
+		EpochSnapshot& m_owner;
+		unsigned m_slot;
+		const T* m_pObject;
+	};
+
+	// The current object, for publishers, which are the only ones that may replace it.
+	const T* GetPublished() const {
+		return m_pCurrent.load(std::memory_order_relaxed);
+	}
+
+	// Publishes pNew and returns the previous object once no reader holds it; the caller frees
+	// it. Publishers must be serialized by the caller.
+	const T* Publish(const T* pNew) {
+		const T* pOld = m_pCurrent.exchange(pNew);
+		unsigned oldEpoch = m_epoch.fetch_add(1);
+		while (m_readers[oldEpoch & 1].load(std::memory_order_acquire) != 0) {
+			Sleep(1);
+		}
+		return pOld;
+	}
+
+private:
+	EpochSnapshot(const EpochSnapshot&) = delete;
+	EpochSnapshot& operator=(const EpochSnapshot&) = delete;
+
+	std::atomic<const T*> m_pCurrent;
+	std::atomic<unsigned> m_epoch;
+	std::atomic<long> m_readers[2];
+};
@@ -0,0 +1,88 @@
+// log.cpp
+//
+// See log.h. The file is opened on the first line written and kept open, shared with readers,
+// until the process exits.
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+#include "log.h"
+
+static const size_t kMaxLogLine = 1024;
+
+static std::atomic<bool> g_logEnabledByConfig(false);
+static std::atomic<HANDLE> g_hLogFile(INVALID_HANDLE_VALUE);
+
+// The environment does not change under us, so DINPUT8_LOG_ENABLE is only read once.
+static bool IsLogEnabledByEnvironment() {
+	static const bool s_enabled = []() {
+		char envBuffer[16];
+		DWORD result = GetEnvironmentVariableA("DINPUT8_LOG_ENABLE", envBuffer, sizeof(envBuffer));
+		return result > 0 && result < sizeof(envBuffer) && (strcmp(envBuffer, "1") == 0 || _stricmp(envBuffer, "true") == 0);
+	}();
+	return s_enabled;
+}
+
+void SetLogEnabledByConfig(bool enabled) {
+	g_logEnabledByConfig.store(enabled, std::memory_order_relaxed);
+}
+
+// Two threads logging their first line may both open the file; the loser closes its handle.
+static HANDLE GetLogFile() {
+	HANDLE hFile = g_hLogFile.load(std::memory_order_acquire);
+	if (hFile != INVALID_HANDLE_VALUE) {
+		return hFile;
+	}
+	// FILE_APPEND_DATA makes every WriteFile an atomic append, so lines from different
+	// threads never interleave.
+	HANDLE hOpened = CreateFileA("dinput8-wrapper.log", FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hOpened == INVALID_HANDLE_VALUE) {
+		return INVALID_HANDLE_VALUE;
+	}
+	if (!g_hLogFile.compare_exchange_strong(hFile, hOpened, std::memory_order_acq_rel)) {
+		CloseHandle(hOpened);
+		return hFile;
+	}
+	return hOpened;
+}
+
+// "[Thu Oct 16 09:41:07 2026] ", the ctime layout earlier versions wrote.
+static int FormatTimestamp(char* pOut, size_t size) {
+	static const char* const kDays[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+	static const char* const kMonths[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+	SYSTEMTIME now;
+	GetLocalTime(&now);
+	return _snprintf_s(pOut, size, _TRUNCATE, "[%s %s %2u %02u:%02u:%02u %u] ",
+		kDays[now.wDayOfWeek % 7], kMonths[(now.wMonth + 11) % 12], now.wDay, now.wHour, now.wMinute, now.wSecond, now.wYear);
+}
+
+void Log(const char* format, ...) {
+	if (!g_logEnabledByConfig.load(std::memory_order_relaxed) && !IsLogEnabledByEnvironment()) {
+		return;
+	}
+	HANDLE hFile = GetLogFile();
+	if (hFile == INVALID_HANDLE_VALUE) {
+		return;
+	}
+
+	char line[kMaxLogLine];
+	int length = FormatTimestamp(line, sizeof(line));
+	if (length < 0) {
+		length = 0;
+	}
+	va_list args;
+	va_start(args, format);
+	int written = _vsnprintf_s(line + length, sizeof(line) - length - 2, _TRUNCATE, format, args);
+	va_end(args);
+	// _TRUNCATE reports -1 for a line that did not fit, which is still written, cut short.
+	length = written < 0 ? static_cast<int>(strlen(line)) : length + written;
+	line[length++] = '\r';
+	line[length++] = '\n';
+
+	DWORD bytesWritten;
+	WriteFile(hFile, line, static_cast<DWORD>(length), &bytesWritten, nullptr);
+}
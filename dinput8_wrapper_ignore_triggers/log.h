@@ -0,0 +1,16 @@
+// log.h
+//
+// Optional log file (dinput8-wrapper.log in the game's working directory).
+// Logging is on when the DINPUT8_LOG_ENABLE environment variable is "1" or "true", or when
+// the config file enables it.
+
+#pragma once
+
+// LOGGING: Writes one timestamped line. format takes printf conversions; the line is built in
+// a fixed stack buffer (longer lines are truncated) and appended with a single WriteFile, so
+// logging allocates nothing and pulls in no iostreams. Arguments are only formatted when
+// logging is on.
+void Log(const char* format, ...);
+
+// Called whenever a config snapshot is published.
+void SetLogEnabledByConfig(bool enabled);
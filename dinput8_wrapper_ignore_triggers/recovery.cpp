@@ -0,0 +1,96 @@
+// recovery.cpp
+//
+// See recovery.h. One thread serves every device: new devices arrive through a locked queue,
+// and between attempts the thread sleeps until the earliest retry is due.
+
+#include <algorithm>
+#include <vector>
+
+#include "recovery.h"
+
+static const DWORD kFirstRetryMs = 50;
+static const DWORD kMaxRetryMs = 2000;
+
+struct RecoveryEntry {
+	RecoverableDevice* pDevice;
+	ULONGLONG dueMs;
+	DWORD delayMs;
+};
+
+static SRWLOCK g_recoveryLock = SRWLOCK_INIT;
+static std::vector<RecoverableDevice*> g_recoveryQueue;
+static HANDLE g_hRecoveryEvent = nullptr;
+static INIT_ONCE g_recoveryInitOnce = INIT_ONCE_STATIC_INIT;
+
+static DWORD WINAPI RecoveryThread(LPVOID) {
+	std::vector<RecoveryEntry> entries;
+	std::vector<RecoverableDevice*> arrived;
+	for (;;) {
+		DWORD timeout = INFINITE;
+		if (!entries.empty()) {
+			ULONGLONG now = GetTickCount64();
+			ULONGLONG due = entries[0].dueMs;
+			for (const RecoveryEntry& entry : entries) {
+				due = (std::min)(due, entry.dueMs);
+			}
+			timeout = due > now ? static_cast<DWORD>(due - now) : 0;
+		}
+		WaitForSingleObject(g_hRecoveryEvent, timeout);
+
+		AcquireSRWLockExclusive(&g_recoveryLock);
+		arrived.swap(g_recoveryQueue);
+		ReleaseSRWLockExclusive(&g_recoveryLock);
+		ULONGLONG now = GetTickCount64();
+		for (RecoverableDevice* pDevice : arrived) {
+			RecoveryEntry entry = { pDevice, now + kFirstRetryMs, kFirstRetryMs };
+			entries.push_back(entry);
+		}
+		arrived.clear();
+
+		for (size_t i = 0; i < entries.size();) {
+			RecoveryEntry& entry = entries[i];
+			if (entry.dueMs > now) {
+				++i;
+				continue;
+			}
+			if (entry.pDevice->TryRecover()) {
+				entries[i] = entries.back();
+				entries.pop_back();
+				continue;
+			}
+			entry.delayMs = (std::min)(entry.delayMs * 2, kMaxRetryMs);
+			entry.dueMs = GetTickCount64() + entry.delayMs;
+			++i;
+		}
+	}
+}
+
+// InitOnce callback. Concurrent first callers wait here until the thread exists. Returning
+// FALSE leaves the INIT_ONCE unsignaled so a later call retries.
+static BOOL CALLBACK StartRecoveryThread(PINIT_ONCE, PVOID, PVOID*) {
+	// The thread never exits, so keep this DLL mapped for the life of the process.
+	HMODULE hSelf = nullptr;
+	GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_PIN, reinterpret_cast<LPCWSTR>(&RecoveryThread), &hSelf);
+
+	if (!g_hRecoveryEvent) {
+		g_hRecoveryEvent = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+	}
+	HANDLE hThread = g_hRecoveryEvent ? CreateThread(nullptr, 0, RecoveryThread, nullptr, 0, nullptr) : nullptr;
+	if (!hThread) {
+		return FALSE;
+	}
+	SetThreadPriority(hThread, THREAD_PRIORITY_BELOW_NORMAL);
+	CloseHandle(hThread);
+	return TRUE;
+}
+
+bool QueueRecovery(RecoverableDevice* pDevice) {
+	if (!InitOnceExecuteOnce(&g_recoveryInitOnce, StartRecoveryThread, nullptr, nullptr)) {
+		return false;
+	}
+	AcquireSRWLockExclusive(&g_recoveryLock);
+	g_recoveryQueue.push_back(pDevice);
+	ReleaseSRWLockExclusive(&g_recoveryLock);
+	SetEvent(g_hRecoveryEvent);
+	return true;
+}
@@ -0,0 +1,30 @@
+// recovery.h
+//
+// Reacquires devices that lost their input (a Bluetooth controller dropping out) on a
+// background thread, so games that call Acquire in a loop on their render thread are not
+// blocked in the HID stack on every call. Each device is retried with exponential backoff
+// until it is back or nobody wants it any more.
+
+#pragma once
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+
+// Implemented by the device wrapper. The wrapper holds a reference on itself while queued.
+class RecoverableDevice {
+public:
+	// One reacquire attempt, on the recovery thread. Returns true when recovery is over,
+	// whether the device came back or is no longer wanted; the recovery thread does not touch
+	// the device again after that.
+	virtual bool TryRecover() = 0;
+
+protected:
+	~RecoverableDevice() {}
+};
+
+// Queues pDevice for its first attempt after the initial backoff, starting the thread on
+// first use; concurrent first callers all wait for it to start. Returns false if the thread
+// could not be started, in which case the caller keeps its old behaviour.
+bool QueueRecovery(RecoverableDevice* pDevice);
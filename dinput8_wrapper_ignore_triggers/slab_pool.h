@@ -0,0 +1,92 @@
+// slab_pool.h
+//
+// Fixed-size slab allocator for the wrapper COM objects.
+// Games that recreate their devices on every alt-tab or reconnect would otherwise churn the
+// process heap, which is usually the game's own contended CRT heap. Wrapper objects are
+// instead carved out of 64 KB VirtualAlloc arenas into cache-line-aligned slots and recycled
+// through a lock-free interlocked SList, so construction and destruction never take a heap
+// lock. Arenas are only ever added, never returned, and a lock is held only while adding one.
+
+#pragma once
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <new>
+
+template <size_t ObjectSize>
+class SlabPool {
+public:
+	static const size_t kCacheLine = 64;
+	static const size_t kSlotSize = (ObjectSize + kCacheLine - 1) & ~(kCacheLine - 1);
+	static const size_t kArenaSize = kSlotSize > 64 * 1024 ? kSlotSize : 64 * 1024;
+
+	static_assert(kSlotSize >= sizeof(SLIST_ENTRY), "slot must hold a free-list link");
+	static_assert(kCacheLine % MEMORY_ALLOCATION_ALIGNMENT == 0, "SList entries need MEMORY_ALLOCATION_ALIGNMENT");
+
+	void* Allocate() {
+		PSLIST_ENTRY pEntry = InterlockedPopEntrySList(&m_freeList);
+		if (!pEntry) {
+			pEntry = Grow();
+			if (!pEntry) {
+				throw std::bad_alloc();
+			}
+		}
+		return pEntry;
+	}
+
+	void Free(void* p) {
+		if (p) {
+			InterlockedPushEntrySList(&m_freeList, static_cast<PSLIST_ENTRY>(p));
+		}
+	}
+
+private:
+	// Maps a new arena, keeps its first slot for the caller and pushes the rest.
+	PSLIST_ENTRY Grow() {
+		AcquireSRWLockExclusive(&m_growLock);
+		// Another thread may have grown the pool while we waited for the lock.
+		PSLIST_ENTRY pEntry = InterlockedPopEntrySList(&m_freeList);
+		if (!pEntry) {
+			BYTE* pArena = static_cast<BYTE*>(VirtualAlloc(nullptr, kArenaSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+			if (pArena) {
+				for (size_t offset = kSlotSize; offset + kSlotSize <= kArenaSize; offset += kSlotSize) {
+					InterlockedPushEntrySList(&m_freeList, reinterpret_cast<PSLIST_ENTRY>(pArena + offset));
+				}
+				pEntry = reinterpret_cast<PSLIST_ENTRY>(pArena);
+			}
+		}
+		ReleaseSRWLockExclusive(&m_growLock);
+		return pEntry;
+	}
+
+	// Zero is a valid empty SList and a valid unlocked SRWLOCK, so a pool with static storage
+	// duration needs no constructor and is usable before any initializer has run. The free
+	// list sits on its own cache line so pushes and pops do not false-share with the lock.
+	alignas(64) SLIST_HEADER m_freeList;
+	alignas(64) SRWLOCK m_growLock;
+};
+
+// Base for a final wrapper class T whose instances should come from a SlabPool.
+// The pool lives in a function-local static of a member template, so sizeof(T) is only
+// evaluated from operator new/delete, by which point T is complete.
+template <class T>
+class SlabAllocated {
+public:
+	static void* operator new(size_t size) {
+		(void)size;
+		return GetPool().Allocate();
+	}
+
+	static void operator delete(void* p) {
+		GetPool().Free(p);
+	}
+
+private:
+	template <class U = T>
+	static SlabPool<sizeof(U)>& GetPool() {
+		static SlabPool<sizeof(U)> s_pool;
+		return s_pool;
+	}
+};
@@ -0,0 +1,24 @@
+// stats.cpp
+//
+// See stats.h.
+
+#include "stats.h"
+#include "log.h"
+
+std::atomic<unsigned long> g_stats[kStatCount];
+
+static const char* const kStatNames[kStatCount] = {
+	"buffer overflows",
+	"events filtered",
+	"event refills",
+	"failed effect updates",
+};
+
+void LogStats() {
+	for (int i = 0; i < kStatCount; ++i) {
+		unsigned long value = GetStat(static_cast<StatCounter>(i));
+		if (value != 0) {
+			Log("Stats: %s %lu", kStatNames[i], value);
+		}
+	}
+}
@@ -0,0 +1,33 @@
+// stats.h
+//
+// Process-wide counters for things the wrapper works around, written to the log when the
+// DLL unloads. Incrementing one is a single relaxed atomic add.
+
+#pragma once
+
+#include <atomic>
+
+enum StatCounter {
+	// GetDeviceData calls on which the real device reported DI_BUFFEROVERFLOW.
+	kStatBufferOverflow,
+	// Buffered events the filter removed before they reached the game.
+	kStatEventsFiltered,
+	// Extra reads GetDeviceData made to refill the game's buffer after filtering.
+	kStatEventRefills,
+	// Deferred force-feedback updates the real effect rejected when they were applied.
+	kStatEffectUpdateFailures,
+	kStatCount
+};
+
+extern std::atomic<unsigned long> g_stats[kStatCount];
+
+inline void AddStat(StatCounter counter, unsigned long amount = 1) {
+	g_stats[counter].fetch_add(amount, std::memory_order_relaxed);
+}
+
+inline unsigned long GetStat(StatCounter counter) {
+	return g_stats[counter].load(std::memory_order_relaxed);
+}
+
+// Logs every counter that is not zero. Called from DLL_PROCESS_DETACH.
+void LogStats();
@@ -0,0 +1,124 @@
+// wrapper_registry.h
+//
+// Maps real DirectInput objects to what we keep for them, so every real device gets exactly
+// one filter state no matter whether the game reached it through CreateDevice or through
+// QueryInterface on a wrapper, and whichever character width it asked for. Devices are keyed
+// by their canonical IUnknown, the one pointer both widths' interfaces agree on.
+// Lookups take the lock shared; only inserting and removing take it exclusive.
+
+#pragma once
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <unordered_map>
+#include <vector>
+
+// Own reference count for wrappers that live in a WrapperRegistry. A registry lookup can race
+// with the final Release, so lookups only take a reference through TryAddRef, which refuses
+// once the count has reached zero.
+class RegisteredWrapper {
+public:
+	bool TryAddRef() {
+		LONG count = m_refCount;
+		while (count > 0) {
+			LONG prev = InterlockedCompareExchange(&m_refCount, count + 1, count);
+			if (prev == count) {
+				return true;
+			}
+			count = prev;
+		}
+		return false;
+	}
+
+protected:
+	volatile LONG m_refCount = 1;
+};
+
+// W must derive from RegisteredWrapper. The registry does not own a reference to its
+// wrappers; a wrapper unregisters itself when its count reaches zero.
+template <class W>
+class WrapperRegistry {
+public:
+	// Returns the live wrapper for pReal with a reference added, or nullptr.
+	W* Find(const void* pReal) {
+		W* pWrapper = nullptr;
+		AcquireSRWLockShared(&m_lock);
+		auto it = GetMap().find(pReal);
+		if (it != GetMap().end() && it->second->TryAddRef()) {
+			pWrapper = it->second;
+		}
+		ReleaseSRWLockShared(&m_lock);
+		return pWrapper;
+	}
+
+	// Returns the live wrapper for pReal with a reference added, creating and registering one
+	// with create() if there is none. *pCreated tells the caller which happened, because a
+	// new wrapper takes over the caller's reference on pReal and an existing one does not.
+	template <class Create>
+	W* FindOrCreate(const void* pReal, Create create, bool* pCreated) {
+		W* pWrapper = Find(pReal);
+		if (pWrapper) {
+			*pCreated = false;
+			return pWrapper;
+		}
+
+		AcquireSRWLockExclusive(&m_lock);
+		auto& map = GetMap();
+		auto it = map.find(pReal);
+		if (it != map.end() && it->second->TryAddRef()) {
+			pWrapper = it->second;
+			*pCreated = false;
+		}
+		else {
+			// Either no entry, or one whose wrapper is already on its way out; replace it.
+			pWrapper = create();
+			map[pReal] = pWrapper;
+			*pCreated = true;
+		}
+		ReleaseSRWLockExclusive(&m_lock);
+		return pWrapper;
+	}
+
+	// Calls fn on every live wrapper, each with a reference held for the call and none of the
+	// registry's locks held, so fn may block or make wrappers release themselves.
+	template <class Fn>
+	void ForEach(Fn fn) {
+		std::vector<W*> wrappers;
+		AcquireSRWLockShared(&m_lock);
+		wrappers.reserve(GetMap().size());
+		for (auto& entry : GetMap()) {
+			if (entry.second->TryAddRef()) {
+				wrappers.push_back(entry.second);
+			}
+		}
+		ReleaseSRWLockShared(&m_lock);
+		for (W* pWrapper : wrappers) {
+			fn(pWrapper);
+			pWrapper->Release();
+		}
+	}
+
+	// Called by a wrapper whose count reached zero. The entry may already belong to a newer
+	// wrapper for the same real pointer, in which case it is left alone.
+	void Remove(const void* pReal, W* pWrapper) {
+		AcquireSRWLockExclusive(&m_lock);
+		auto& map = GetMap();
+		auto it = map.find(pReal);
+		if (it != map.end() && it->second == pWrapper) {
+			map.erase(it);
+		}
+		ReleaseSRWLockExclusive(&m_lock);
+	}
+
+private:
+	std::unordered_map<const void*, W*>& GetMap() {
+		return *m_pMap;
+	}
+
+	// Never freed, so wrappers the game releases during process teardown can still
+	// unregister safely.
+	std::unordered_map<const void*, W*>* m_pMap = new std::unordered_map<const void*, W*>();
+	SRWLOCK m_lock = SRWLOCK_INIT;
+};
@@ -0,0 +1,65 @@
+// fuzz_compact_events.cpp
+//
+// libFuzzer harness for CompactEvents and CompactActionEvents. The first byte picks the
+// filter; the rest of the input, cut into whole records, is the buffer as the device returned
+// it. Compaction may only shrink the buffer, and it runs in place on records whose offsets,
+// values and sequence numbers are arbitrary.
+
+#include <vector>
+
+#include "action_filter.h"
+#include "filter.h"
+#include "fuzz_input.h"
+
+static void FuzzCompactEvents(FuzzInput* pInput) {
+	FuzzDataFormat format;
+	DecodeDataFormat(pInput, &format);
+	FormatLayout layout;
+	BuildFormatLayout(&format.format, &layout);
+	DiAxisRange ranges[kAxisCount];
+	DecodeAxisRanges(pInput, ranges);
+	FilterConfig filter;
+	DecodeFilterConfig(pInput, &filter);
+	FilterPlan plan;
+	BuildFilterPlan(layout, ranges, filter, &plan);
+
+	uint32_t cbObjectData = (pInput->Take<uint8_t>() & 1) ? sizeof(DiDeviceObjectDataDx3) : sizeof(DiDeviceObjectData);
+	uint32_t count = static_cast<uint32_t>(pInput->Remaining() / cbObjectData);
+	std::vector<uint8_t> records(pInput->Rest(), pInput->Rest() + count * cbObjectData);
+	uint32_t kept = CompactEvents(plan, records.data(), count, cbObjectData);
+	FUZZ_CHECK(kept <= count);
+}
+
+static void FuzzCompactActionEvents(FuzzInput* pInput) {
+	uint8_t bindingCount = pInput->Take<uint8_t>();
+	std::vector<ActionBinding> bindings(bindingCount);
+	for (ActionBinding& binding : bindings) {
+		binding.appData = pInput->Take<uint8_t>();
+		const DiGuid* pGuid = kFuzzGuids[pInput->Take<uint8_t>() % (sizeof(kFuzzGuids) / sizeof(kFuzzGuids[0]))];
+		binding.guidType = pGuid ? *pGuid : kFuzzUnknownGuid;
+		binding.objId = pInput->Take<uint32_t>();
+	}
+	ActionTable table;
+	if (!BuildActionTable(bindings.data(), bindingCount, &table)) {
+		FUZZ_CHECK(table.count == 0);
+	}
+	FUZZ_CHECK(table.count <= kActionTableSize);
+	unsigned suppressMask = pInput->Take<uint8_t>();
+
+	uint32_t count = static_cast<uint32_t>(pInput->Remaining() / sizeof(DiDeviceObjectData));
+	std::vector<DiDeviceObjectData> records(count);
+	pInput->Take(records.data(), count * sizeof(DiDeviceObjectData));
+	uint32_t kept = CompactActionEvents(table, suppressMask, records.data(), count);
+	FUZZ_CHECK(kept <= count);
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* pData, size_t size) {
+	FuzzInput input(pData, size);
+	if (input.Take<uint8_t>() & 1) {
+		FuzzCompactActionEvents(&input);
+	}
+	else {
+		FuzzCompactEvents(&input);
+	}
+	return 0;
+}
@@ -0,0 +1,45 @@
+// fuzz_corpus_main.cpp
+//
+// Stand-in for libFuzzer's main when DINPUT8_FUZZ is off: runs a harness once over each file
+// named on the command line, so the seed corpus in fuzz/corpus is replayed by ctest with any
+// compiler. A failed FUZZ_CHECK aborts, which ctest reports as a failure. It does not mutate
+// inputs; for that, build with DINPUT8_FUZZ and point the harness at the same corpus.
+//
+// Usage: fuzz_<harness> file...
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* pData, size_t size);
+
+static bool ReadWholeFile(const char* pPath, std::vector<uint8_t>* pData) {
+	FILE* pFile = fopen(pPath, "rb");
+	if (!pFile) {
+		return false;
+	}
+	uint8_t chunk[64 * 1024];
+	size_t read;
+	while ((read = fread(chunk, 1, sizeof(chunk), pFile)) > 0) {
+		pData->insert(pData->end(), chunk, chunk + read);
+	}
+	fclose(pFile);
+	return true;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s file...\n", argv[0]);
+		return 2;
+	}
+	for (int i = 1; i < argc; ++i) {
+		std::vector<uint8_t> data;
+		if (!ReadWholeFile(argv[i], &data)) {
+			fprintf(stderr, "Cannot read %s\n", argv[i]);
+			return 1;
+		}
+		LLVMFuzzerTestOneInput(data.data(), data.size());
+	}
+	printf("Ran %d input(s).\n", argc - 1);
+	return 0;
+}
@@ -0,0 +1,39 @@
+// fuzz_data_format.cpp
+//
+// libFuzzer harness for ValidateDataFormat and BuildFormatLayout. Checks the layout
+// invariants filter.h promises for every format the DLL could be handed: each axis and POV
+// offset of a known layout is 4-byte aligned with a LONG's room inside dataSize.
+
+#include "filter.h"
+#include "fuzz_input.h"
+
+static void CheckOffset(const FormatLayout& layout, uint32_t offset) {
+	FUZZ_CHECK(offset % 4 == 0);
+	FUZZ_CHECK(offset <= layout.dataSize && layout.dataSize - offset >= sizeof(int32_t));
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* pData, size_t size) {
+	FuzzInput input(pData, size);
+	FuzzDataFormat format;
+	DecodeDataFormat(&input, &format);
+
+	bool valid = ValidateDataFormat(&format.format);
+	FormatLayout layout;
+	BuildFormatLayout(&format.format, &layout);
+	if (!valid) {
+		FUZZ_CHECK(!layout.known);
+		return 0;
+	}
+	FUZZ_CHECK(layout.known);
+	FUZZ_CHECK(layout.dataSize == format.format.dwDataSize);
+	for (int axis = 0; axis < kAxisCount; ++axis) {
+		if (layout.presentMask & (1u << axis)) {
+			CheckOffset(layout, layout.axisOffset[axis]);
+		}
+	}
+	FUZZ_CHECK(layout.povCount <= sizeof(layout.povOffset) / sizeof(layout.povOffset[0]));
+	for (uint32_t i = 0; i < layout.povCount; ++i) {
+		CheckOffset(layout, layout.povOffset[i]);
+	}
+	return 0;
+}
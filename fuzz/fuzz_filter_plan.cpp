@@ -0,0 +1,50 @@
+// fuzz_filter_plan.cpp
+//
+// libFuzzer harness for BuildFilterPlan. Builds a plan from a decoded format, axis ranges
+// and filter settings, then runs what the DLL does with one: the GetDeviceState policy the
+// plan selected, the neutral state, and the comparison a config reload makes against the
+// previous plan. The sanitizers catch out-of-bounds writes and overflowing arithmetic.
+
+#include <vector>
+
+#include "filter.h"
+#include "fuzz_input.h"
+#include "state_policies.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* pData, size_t size) {
+	FuzzInput input(pData, size);
+	FuzzDataFormat format;
+	DecodeDataFormat(&input, &format);
+	FormatLayout layout;
+	BuildFormatLayout(&format.format, &layout);
+	DiAxisRange ranges[kAxisCount];
+	DecodeAxisRanges(&input, ranges);
+	FilterConfig filter;
+	DecodeFilterConfig(&input, &filter);
+
+	FilterPlan plan;
+	BuildFilterPlan(layout, ranges, filter, &plan);
+	FUZZ_CHECK(plan.zeroCount <= kAxisCount && plan.transformCount <= kAxisCount);
+	FUZZ_CHECK(plan.eventRuleCount <= kAxisCount);
+
+	// DirectInput only accepts reads of the format's size. Without a known format the game
+	// may pass anything.
+	uint32_t cbData = layout.known ? layout.dataSize : input.Take<uint16_t>();
+	// The game's buffer is never null, even for an empty read.
+	std::vector<uint8_t> state(cbData > 0 ? cbData : 1);
+	input.Take(state.data(), cbData);
+	GetStateApplyFn(plan.stateKind)(plan, cbData, state.data());
+	WriteNeutralState(layout, plan, cbData, state.data());
+
+	FilterConfig next = filter;
+	DecodeFilterConfig(&input, &next);
+	FilterPlan nextPlan;
+	BuildFilterPlan(layout, ranges, next, &nextPlan);
+	uint32_t silenced[kAxisCount];
+	uint32_t silencedCount = FindNewlySilencedAxes(layout, plan, nextPlan, silenced);
+	FUZZ_CHECK(silencedCount <= kAxisCount);
+	for (uint32_t i = 0; i < silencedCount; ++i) {
+		FUZZ_CHECK(silenced[i] < kAxisCount);
+	}
+	return 0;
+}
@@ -0,0 +1,110 @@
+// fuzz_input.h
+//
+// Helpers shared by the libFuzzer harnesses: a cursor over the fuzzer's bytes, and the data
+// formats, axis ranges and filter settings decoded from them. The harnesses call the core the
+// way the DLL does, so they only produce inputs the DLL could pass: a DIDATAFORMAT's object
+// array really holds dwNumObjs entries, its GUID pointers point at GUIDs, and filter settings
+// are within what ParseConfig produces.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "config_parse.h"
+#include "dinput_types.h"
+
+// Reads fixed-size values off the front of the input. Past the end it yields zeros, so a
+// harness never has to check how much is left.
+class FuzzInput {
+public:
+	FuzzInput(const uint8_t* pData, size_t size) : m_pData(pData), m_size(size) {}
+
+	void Take(void* pOut, size_t size) {
+		size_t available = size < m_size ? size : m_size;
+		if (available > 0) {
+			memcpy(pOut, m_pData, available);
+		}
+		if (available < size) {
+			memset(static_cast<uint8_t*>(pOut) + available, 0, size - available);
+		}
+		m_pData += available;
+		m_size -= available;
+	}
+
+	template <class T>
+	T Take() {
+		T value;
+		Take(&value, sizeof(value));
+		return value;
+	}
+
+	size_t Remaining() const { return m_size; }
+	const uint8_t* Rest() const { return m_pData; }
+
+private:
+	const uint8_t* m_pData;
+	size_t m_size;
+};
+
+// A DIDATAFORMAT decoded from the input, with the storage its pointers refer to.
+struct FuzzDataFormat {
+	DiDataFormat format;
+	std::vector<DiObjectDataFormat> objects;
+};
+
+// GUIDs an object can point at, including one the filter does not know. Index 0 is null.
+static const DiGuid kFuzzUnknownGuid = { 0x12345678, 0x9ABC, 0xDEF0, { 0, 1, 2, 3, 4, 5, 6, 7 } };
+static const DiGuid* const kFuzzGuids[] = {
+	nullptr, &kDiGuidXAxis, &kDiGuidYAxis, &kDiGuidZAxis, &kDiGuidRxAxis,
+	&kDiGuidRyAxis, &kDiGuidRzAxis, &kDiGuidSlider, &kFuzzUnknownGuid,
+};
+
+// Header fields straight from the input, except that dwSize and dwObjSize are usually the
+// real sizes so the fuzzer gets past ValidateDataFormat, and dwNumObjs is capped at the
+// objects decoded.
+inline void DecodeDataFormat(FuzzInput* pInput, FuzzDataFormat* pOut) {
+	uint8_t flags = pInput->Take<uint8_t>();
+	DiDataFormat& format = pOut->format;
+	format.dwSize = (flags & 1) ? pInput->Take<uint32_t>() : sizeof(DiDataFormat);
+	format.dwObjSize = (flags & 2) ? pInput->Take<uint32_t>() : sizeof(DiObjectDataFormat);
+	format.dwFlags = pInput->Take<uint32_t>();
+	format.dwDataSize = pInput->Take<uint32_t>();
+	uint8_t objectCount = pInput->Take<uint8_t>();
+	pOut->objects.clear();
+	for (uint8_t i = 0; i < objectCount && pInput->Remaining() > 0; ++i) {
+		DiObjectDataFormat object;
+		object.pguid = kFuzzGuids[pInput->Take<uint8_t>() % (sizeof(kFuzzGuids) / sizeof(kFuzzGuids[0]))];
+		object.dwOfs = pInput->Take<uint32_t>();
+		object.dwType = pInput->Take<uint32_t>();
+		object.dwFlags = pInput->Take<uint32_t>();
+		pOut->objects.push_back(object);
+	}
+	format.dwNumObjs = static_cast<uint32_t>(pOut->objects.size());
+	format.rgodf = pOut->objects.empty() ? nullptr : pOut->objects.data();
+}
+
+// Any DIPROP_RANGE, including inverted and empty ones; the device reports what it likes.
+inline void DecodeAxisRanges(FuzzInput* pInput, DiAxisRange* pRanges) {
+	for (int axis = 0; axis < kAxisCount; ++axis) {
+		pRanges[axis].lMin = pInput->Take<int32_t>();
+		pRanges[axis].lMax = pInput->Take<int32_t>();
+	}
+}
+
+inline void DecodeFilterConfig(FuzzInput* pInput, FilterConfig* pFilter) {
+	pFilter->suppressMask = pInput->Take<uint8_t>();
+	for (int axis = 0; axis < kAxisCount; ++axis) {
+		pFilter->remapSource[axis] = static_cast<unsigned char>(pInput->Take<uint8_t>() % kAxisCount);
+		pFilter->deadzone[axis] = pInput->Take<uint16_t>() % 10001;
+	}
+	pFilter->bufferSize = 0;
+}
+
+// Invariant checks abort, which the fuzzer reports as a crash.
+#define FUZZ_CHECK(condition) \
+	do { \
+		if (!(condition)) abort(); \
+	} while (0)
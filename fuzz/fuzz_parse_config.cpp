@@ -0,0 +1,34 @@
+// fuzz_parse_config.cpp
+//
+// libFuzzer harness for ParseConfig. The input is the config file. The process key matches a
+// profile named fuzz.exe, so profile sections are exercised too. Every value that later
+// indexes or sizes something must come out in range, and the strings terminated.
+
+#include <cstring>
+
+#include "config_parse.h"
+#include "fuzz_input.h"
+
+static void CheckTerminated(const char* pText, size_t size) {
+	FUZZ_CHECK(memchr(pText, 0, size) != nullptr);
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* pData, size_t size) {
+	ProfileKey process = { HashProfileName("fuzz.exe", 8), 0x5F3A2B1C };
+	Config config;
+	ParseConfig(reinterpret_cast<const char*>(pData), size, process, &config);
+
+	FUZZ_CHECK(config.filter.suppressMask < (1u << kAxisCount));
+	for (int axis = 0; axis < kAxisCount; ++axis) {
+		FUZZ_CHECK(config.filter.remapSource[axis] < kAxisCount);
+		FUZZ_CHECK(config.filter.deadzone[axis] >= 0 && config.filter.deadzone[axis] <= 10000);
+	}
+	FUZZ_CHECK(config.ruleCount <= kMaxDeviceRules);
+	for (unsigned i = 0; i < config.ruleCount; ++i) {
+		CheckTerminated(config.rules[i].name, sizeof(config.rules[i].name));
+	}
+	CheckTerminated(config.chainDll, sizeof(config.chainDll));
+	CheckTerminated(config.captureFile, sizeof(config.captureFile));
+	CheckTerminated(config.profile, sizeof(config.profile));
+	return 0;
+}
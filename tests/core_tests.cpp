@@ -0,0 +1,851 @@
+// core_tests.cpp
+//
+// Unit tests for the platform-independent filter core (dinput8_wrapper_ignore_triggers/core):
+// data format validation and layout, filter plans and their state policies, event
+// compaction and renumbering, neutral state, buffered reads, capture files, the mock device
+// and config parsing. No framework: failed checks are printed and the exit code is non-zero.
+// Run by ctest.
+//
+// Usage: dinput8_core_tests
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "action_filter.h"
+#include "buffered_events.h"
+#include "capture_format.h"
+#include "config_parse.h"
+#include "dinput_types.h"
+#include "event_sequence.h"
+#include "filter.h"
+#include "mock_device.h"
+#include "state_policies.h"
+
+static int g_failures = 0;
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+			++g_failures; \
+		} \
+	} while (0)
+
+#define CHECK_EQ(expected, actual) \
+	do { \
+		long long expectedValue = static_cast<long long>(expected); \
+		long long actualValue = static_cast<long long>(actual); \
+		if (expectedValue != actualValue) { \
+			fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, #expected, #actual, expectedValue, actualValue); \
+			++g_failures; \
+		} \
+	} while (0)
+
+// --- Fixtures ---
+// The axis objects of c_dfDIJoystick, plus its first POV.
+static const DiObjectDataFormat kJoystickObjects[] = {
+	{ &kDiGuidXAxis, kDiJoyOfsX, kDiDftAxis, kDiDoiAspectPosition },
+	{ &kDiGuidYAxis, kDiJoyOfsY, kDiDftAxis, kDiDoiAspectPosition },
+	{ &kDiGuidZAxis, kDiJoyOfsZ, kDiDftAxis, kDiDoiAspectPosition },
+	{ &kDiGuidRxAxis, kDiJoyOfsRx, kDiDftAxis, kDiDoiAspectPosition },
+	{ &kDiGuidRyAxis, kDiJoyOfsRy, kDiDftAxis, kDiDoiAspectPosition },
+	{ &kDiGuidRzAxis, kDiJoyOfsRz, kDiDftAxis, kDiDoiAspectPosition },
+	{ &kDiGuidSlider, kDiJoyOfsSlider0, kDiDftAxis, kDiDoiAspectPosition },
+	{ &kDiGuidSlider, kDiJoyOfsSlider1, kDiDftAxis, kDiDoiAspectPosition },
+	{ nullptr, offsetof(DiJoyState, rgdwPOV), kDiDftPov, 0 },
+};
+static const uint32_t kJoystickObjectCount = sizeof(kJoystickObjects) / sizeof(kJoystickObjects[0]);
+
+static DiDataFormat MakeFormat(uint32_t dataSize, const DiObjectDataFormat* pObjects, uint32_t count) {
+	DiDataFormat format = { sizeof(DiDataFormat), sizeof(DiObjectDataFormat), 0, dataSize, count, pObjects };
+	return format;
+}
+
+static FormatLayout MakeJoystickLayout(uint32_t dataSize = sizeof(DiJoyState)) {
+	DiDataFormat format = MakeFormat(dataSize, kJoystickObjects, kJoystickObjectCount);
+	FormatLayout layout;
+	BuildFormatLayout(&format, &layout);
+	return layout;
+}
+
+// Nothing suppressed, remapped or deadzoned.
+static FilterConfig MakePassThroughConfig() {
+	FilterConfig filter = kDefaultConfig.filter;
+	filter.suppressMask = 0;
+	return filter;
+}
+
+static FilterPlan MakePlan(const FormatLayout& layout, const FilterConfig& filter) {
+	DiAxisRange ranges[kAxisCount];
+	SetDefaultAxisRanges(ranges);
+	FilterPlan plan;
+	BuildFilterPlan(layout, ranges, filter, &plan);
+	return plan;
+}
+
+static DiDeviceObjectData MakeEvent(uint32_t ofs, uint32_t data, uint32_t timeStamp = 0, uint32_t sequence = 0, uintptr_t appData = 0) {
+	DiDeviceObjectData event = { ofs, data, timeStamp, sequence, appData };
+	return event;
+}
+
+// The neutral value of DirectInput's default 0..65535 range.
+static const int32_t kDefaultNeutral = 32767;
+
+// --- Data formats ---
+static void TestValidateDataFormat() {
+	DiDataFormat valid = MakeFormat(sizeof(DiJoyState), kJoystickObjects, kJoystickObjectCount);
+	CHECK(ValidateDataFormat(&valid));
+	CHECK(!ValidateDataFormat(nullptr));
+
+	DiDataFormat format = valid;
+	format.dwSize = sizeof(DiDataFormat) - 4;
+	CHECK(!ValidateDataFormat(&format));
+
+	format = valid;
+	format.dwObjSize = sizeof(DiObjectDataFormat) + 4;
+	CHECK(!ValidateDataFormat(&format));
+
+	format = valid;
+	format.dwDataSize = 0;
+	CHECK(!ValidateDataFormat(&format));
+
+	format = valid;
+	format.dwDataSize = sizeof(DiJoyState) + 2;
+	CHECK(!ValidateDataFormat(&format));
+
+	format = valid;
+	format.dwDataSize = kMaxDataFormatSize + 4;
+	CHECK(!ValidateDataFormat(&format));
+
+	format = valid;
+	format.dwDataSize = 8;
+	format.dwNumObjs = 9;
+	CHECK(!ValidateDataFormat(&format));
+
+	format = valid;
+	format.rgodf = nullptr;
+	CHECK(!ValidateDataFormat(&format));
+
+	format.dwNumObjs = 0;
+	CHECK(ValidateDataFormat(&format));
+}
+
+static void TestBuildFormatLayout() {
+	FormatLayout layout = MakeJoystickLayout();
+	CHECK(layout.known);
+	CHECK_EQ(sizeof(DiJoyState), layout.dataSize);
+	CHECK_EQ((1u << kAxisCount) - 1, layout.presentMask);
+	CHECK_EQ(kDiJoyOfsRx, layout.axisOffset[kAxisRx]);
+	CHECK_EQ(kDiJoyOfsSlider0, layout.axisOffset[kAxisSlider0]);
+	CHECK_EQ(kDiJoyOfsSlider1, layout.axisOffset[kAxisSlider1]);
+	CHECK_EQ(1, layout.povCount);
+	CHECK_EQ(offsetof(DiJoyState, rgdwPOV), layout.povOffset[0]);
+
+	// A malformed format yields the default, size-checked layout.
+	DiDataFormat malformed = MakeFormat(sizeof(DiJoyState) + 1, kJoystickObjects, kJoystickObjectCount);
+	BuildFormatLayout(&malformed, &layout);
+	CHECK(!layout.known);
+	CHECK_EQ(sizeof(DiJoyState), layout.dataSize);
+	CHECK_EQ(kDiJoyOfsRy, layout.axisOffset[kAxisRy]);
+
+	// Objects that are misaligned, past the end, velocity axes, untyped or repeated are skipped.
+	static const DiObjectDataFormat kOddObjects[] = {
+		{ &kDiGuidXAxis, 2, kDiDftAxis, kDiDoiAspectPosition },
+		{ &kDiGuidYAxis, 16, kDiDftAxis, kDiDoiAspectPosition },
+		{ &kDiGuidZAxis, 4, kDiDftAxis, 0x200 },
+		{ nullptr, 4, kDiDftAxis, kDiDoiAspectPosition },
+		{ &kDiGuidRxAxis, 8, kDiDftAxis, 0 },
+		{ &kDiGuidRxAxis, 12, kDiDftAxis, kDiDoiAspectPosition },
+	};
+	DiDataFormat odd = MakeFormat(16, kOddObjects, 6);
+	BuildFormatLayout(&odd, &layout);
+	CHECK(layout.known);
+	CHECK_EQ(16, layout.dataSize);
+	CHECK_EQ(1u << kAxisRx, layout.presentMask);
+	CHECK_EQ(8, layout.axisOffset[kAxisRx]);
+	CHECK_EQ(0, layout.povCount);
+}
+
+// --- Filter plans ---
+static void TestBuildFilterPlanSuppress() {
+	FormatLayout layout = MakeJoystickLayout();
+	FilterPlan plan = MakePlan(layout, kDefaultConfig.filter);
+	CHECK_EQ(kStatePolicyJoyState, plan.stateKind);
+	CHECK_EQ(2, plan.zeroCount);
+	CHECK_EQ(kDefaultNeutral, plan.axisNeutral[kAxisRx]);
+	CHECK_EQ(2, plan.eventRuleCount);
+
+	DiJoyState state = {};
+	state.lX = 100;
+	state.lRx = 1;
+	state.lRy = 65535;
+	GetStateApplyFn(plan.stateKind)(plan, sizeof(state), &state);
+	CHECK_EQ(100, state.lX);
+	CHECK_EQ(kDefaultNeutral, state.lRx);
+	CHECK_EQ(kDefaultNeutral, state.lRy);
+
+	CHECK_EQ(kStatePolicyJoyState2, MakePlan(MakeJoystickLayout(sizeof(DiJoyState2)), kDefaultConfig.filter).stateKind);
+
+	FilterConfig filter = kDefaultConfig.filter;
+	filter.suppressMask = 1u << kAxisZ;
+	plan = MakePlan(layout, filter);
+	CHECK_EQ(kStatePolicyZeroTable, plan.stateKind);
+	state.lZ = 5;
+	GetStateApplyFn(plan.stateKind)(plan, sizeof(state), &state);
+	CHECK_EQ(kDefaultNeutral, state.lZ);
+
+	CHECK_EQ(kStatePolicyPassThrough, MakePlan(layout, MakePassThroughConfig()).stateKind);
+
+	// Without a format the default layout is applied only to DIJOYSTATE-sized reads.
+	FormatLayout defaultLayout;
+	SetDefaultFormatLayout(&defaultLayout);
+	plan = MakePlan(defaultLayout, kDefaultConfig.filter);
+	CHECK_EQ(kStatePolicySizeChecked, plan.stateKind);
+	CHECK_EQ(0, plan.eventRuleCount);
+	DiJoyState2 state2 = {};
+	state2.lRx = 1;
+	GetStateApplyFn(plan.stateKind)(plan, sizeof(state2), &state2);
+	CHECK_EQ(1, state2.lRx);
+	state.lRx = 1;
+	GetStateApplyFn(plan.stateKind)(plan, sizeof(state), &state);
+	CHECK_EQ(kDefaultNeutral, state.lRx);
+}
+
+static void TestBuildFilterPlanRemap() {
+	FormatLayout layout = MakeJoystickLayout();
+	FilterConfig filter = MakePassThroughConfig();
+	filter.remapSource[kAxisZ] = kAxisRz;
+	filter.remapSource[kAxisRz] = kAxisZ;
+	FilterPlan plan = MakePlan(layout, filter);
+	CHECK_EQ(kStatePolicyGeneral, plan.stateKind);
+	CHECK_EQ(2, plan.transformCount);
+
+	DiJoyState state = {};
+	state.lZ = 10;
+	state.lRz = 20;
+	GetStateApplyFn(plan.stateKind)(plan, sizeof(state), &state);
+	CHECK_EQ(20, state.lZ);
+	CHECK_EQ(10, state.lRz);
+
+	// A source the format does not carry reads as neutral.
+	static const DiObjectDataFormat kXOnly[] = {
+		{ &kDiGuidXAxis, 0, kDiDftAxis, kDiDoiAspectPosition },
+	};
+	DiDataFormat format = MakeFormat(4, kXOnly, 1);
+	BuildFormatLayout(&format, &layout);
+	filter = MakePassThroughConfig();
+	filter.remapSource[kAxisX] = kAxisRz;
+	plan = MakePlan(layout, filter);
+	CHECK_EQ(kNoSourceAxis, plan.transforms[0].srcOffset);
+	int32_t x = 1234;
+	GetStateApplyFn(plan.stateKind)(plan, sizeof(x), &x);
+	CHECK_EQ(kDefaultNeutral, x);
+
+	// A remap between ranges rescales: Rz at 0..65535 onto Z at -100..100.
+	layout = MakeJoystickLayout();
+	DiAxisRange ranges[kAxisCount];
+	SetDefaultAxisRanges(ranges);
+	ranges[kAxisZ].lMin = -100;
+	ranges[kAxisZ].lMax = 100;
+	filter = MakePassThroughConfig();
+	filter.remapSource[kAxisZ] = kAxisRz;
+	BuildFilterPlan(layout, ranges, filter, &plan);
+	state.lRz = 65535;
+	ApplyStatePolicy(plan, sizeof(state), &state);
+	CHECK_EQ(100, state.lZ);
+	state.lRz = 0;
+	ApplyStatePolicy(plan, sizeof(state), &state);
+	CHECK_EQ(-100, state.lZ);
+}
+
+static void TestBuildFilterPlanDeadzone() {
+	FormatLayout layout = MakeJoystickLayout();
+	FilterConfig filter = MakePassThroughConfig();
+	// 20.00% of the half-range: 2000 * 32767 / 10000.
+	filter.deadzone[kAxisX] = 2000;
+	FilterPlan plan = MakePlan(layout, filter);
+	CHECK_EQ(kStatePolicyGeneral, plan.stateKind);
+	CHECK_EQ(1, plan.transformCount);
+	CHECK_EQ(6553, plan.transforms[0].deadzone);
+
+	DiJoyState state = {};
+	state.lX = kDefaultNeutral + 6552;
+	ApplyStatePolicy(plan, sizeof(state), &state);
+	CHECK_EQ(kDefaultNeutral, state.lX);
+	state.lX = kDefaultNeutral - 6552;
+	ApplyStatePolicy(plan, sizeof(state), &state);
+	CHECK_EQ(kDefaultNeutral, state.lX);
+	state.lX = kDefaultNeutral + 6553;
+	ApplyStatePolicy(plan, sizeof(state), &state);
+	CHECK_EQ(kDefaultNeutral + 6553, state.lX);
+	// The distance from neutral does not overflow at the ends of the LONG range.
+	state.lX = INT32_MIN;
+	ApplyStatePolicy(plan, sizeof(state), &state);
+	CHECK_EQ(INT32_MIN, state.lX);
+
+	filter.deadzone[kAxisX] = 10000;
+	plan = MakePlan(layout, filter);
+	CHECK_EQ(32767, plan.transforms[0].deadzone);
+}
+
+// --- Buffered events ---
+static void TestCompactEvents() {
+	FormatLayout layout = MakeJoystickLayout();
+	FilterConfig filter = kDefaultConfig.filter;
+	filter.remapSource[kAxisZ] = kAxisRz;
+	filter.deadzone[kAxisY] = 5000;
+	FilterPlan plan = MakePlan(layout, filter);
+
+	DiDeviceObjectData events[] = {
+		MakeEvent(kDiJoyOfsX, 1, 10, 1),
+		MakeEvent(kDiJoyOfsRx, 2, 11, 2),
+		MakeEvent(kDiJoyOfsRz, 3, 12, 3),
+		MakeEvent(kDiJoyOfsY, kDefaultNeutral + 100, 13, 4),
+		MakeEvent(kDiJoyOfsRy, 5, 14, 5),
+		MakeEvent(64, 0x80, 15, 6),
+	};
+	uint32_t kept = CompactEvents(plan, events, 6, sizeof(DiDeviceObjectData));
+	CHECK_EQ(4, kept);
+	CHECK_EQ(kDiJoyOfsX, events[0].dwOfs);
+	// Rz feeds Z; Z's own events are dropped since nothing reads them.
+	CHECK_EQ(kDiJoyOfsZ, events[1].dwOfs);
+	CHECK_EQ(3, events[1].dwData);
+	CHECK_EQ(12, events[1].dwTimeStamp);
+	CHECK_EQ(kDiJoyOfsY, events[2].dwOfs);
+	CHECK_EQ(kDefaultNeutral, events[2].dwData);
+	CHECK_EQ(64, events[3].dwOfs);
+	CHECK_EQ(6, events[3].dwSequence);
+
+	// DX3 records are compacted the same way.
+	DiDeviceObjectDataDx3 dx3[] = {
+		{ kDiJoyOfsRx, 1, 0, 1 },
+		{ kDiJoyOfsX, 2, 0, 2 },
+		{ kDiJoyOfsRy, 3, 0, 3 },
+	};
+	CHECK_EQ(1, CompactEvents(plan, dx3, 3, sizeof(DiDeviceObjectDataDx3)));
+	CHECK_EQ(kDiJoyOfsX, dx3[0].dwOfs);
+	CHECK_EQ(2, dx3[0].dwSequence);
+
+	CHECK_EQ(0, CompactEvents(plan, events, 0, sizeof(DiDeviceObjectData)));
+}
+
+static void TestCompactActionEvents() {
+	// DIDFT_GETINSTANCE is bits 8..23 of the object ID.
+	const ActionBinding bindings[] = {
+		{ 1, kDiGuidRxAxis, 0x0302 },
+		{ 2, kDiGuidXAxis, 0x0002 },
+		{ 3, kDiGuidRxAxis, 0x0302 },
+		{ 3, kDiGuidXAxis, 0x0002 },
+		{ 4, kDiGuidSlider, 0x0602 },
+		{ 5, kDiGuidSlider, 0x0402 },
+		{ 6, kDiGuidZAxis, 0x0000 },
+	};
+	ActionTable table;
+	CHECK(BuildActionTable(bindings, 7, &table));
+	CHECK_EQ(6, table.count);
+	CHECK_EQ(1u << kAxisRx, FindActionAxes(table, 1));
+	CHECK_EQ((1u << kAxisRx) | (1u << kAxisX), FindActionAxes(table, 3));
+	// The lower slider instance is slider0.
+	CHECK_EQ(1u << kAxisSlider1, FindActionAxes(table, 4));
+	CHECK_EQ(1u << kAxisSlider0, FindActionAxes(table, 5));
+	CHECK_EQ(1u << kAxisZ, FindActionAxes(table, 6));
+	CHECK_EQ(0, FindActionAxes(table, 99));
+
+	DiDeviceObjectData events[] = {
+		MakeEvent(0, 1, 0, 1, 1),
+		MakeEvent(0, 2, 0, 2, 2),
+		MakeEvent(0, 3, 0, 3, 3),
+		MakeEvent(0, 4, 0, 4, 99),
+		MakeEvent(0, 5, 0, 5, 1),
+	};
+	// Only actions bound to nothing but suppressed axes are dropped.
+	CHECK_EQ(3, CompactActionEvents(table, 1u << kAxisRx, events, 5));
+	CHECK_EQ(2, events[0].uAppData);
+	CHECK_EQ(3, events[1].uAppData);
+	CHECK_EQ(99, events[2].uAppData);
+
+	// Nothing bound to a suppressed axis leaves the batch alone.
+	CHECK_EQ(5, CompactActionEvents(table, 1u << kAxisRy, events, 5));
+
+	// More actions than the table holds leave it empty.
+	std::vector<ActionBinding> many;
+	for (uintptr_t i = 0; i < kActionTableSize; ++i) {
+		ActionBinding binding = { i + 1, kDiGuidXAxis, 0x0002 };
+		many.push_back(binding);
+	}
+	CHECK(!BuildActionTable(many.data(), static_cast<uint32_t>(many.size()), &table));
+	CHECK_EQ(0, table.count);
+	CHECK_EQ(0, table.axisMask);
+}
+
+static void TestWriteNeutralState() {
+	FormatLayout layout = MakeJoystickLayout();
+	FilterPlan plan = MakePlan(layout, kDefaultConfig.filter);
+
+	DiJoyState state;
+	memset(&state, 0xAB, sizeof(state));
+	WriteNeutralState(layout, plan, sizeof(state), &state);
+	CHECK_EQ(kDefaultNeutral, state.lX);
+	CHECK_EQ(kDefaultNeutral, state.lRy);
+	CHECK_EQ(kDefaultNeutral, state.rglSlider[1]);
+	CHECK_EQ(kDiPovCentered, state.rgdwPOV[0]);
+	// Only one POV is in the format.
+	CHECK_EQ(0, state.rgdwPOV[1]);
+	CHECK_EQ(0, state.rgbButtons[0]);
+	CHECK_EQ(0, state.rgbButtons[31]);
+
+	// A buffer that does not match the format is only zeroed.
+	DiJoyState2 state2;
+	memset(&state2, 0xAB, sizeof(state2));
+	WriteNeutralState(layout, plan, sizeof(state2), &state2);
+	CHECK_EQ(0, state2.lX);
+	CHECK_EQ(0, state2.rgdwPOV[0]);
+	CHECK_EQ(0, state2.rglFSlider[1]);
+}
+
+static void TestFindNewlySilencedAxes() {
+	FormatLayout layout = MakeJoystickLayout();
+	FilterPlan before = MakePlan(layout, MakePassThroughConfig());
+	FilterPlan after = MakePlan(layout, kDefaultConfig.filter);
+	uint32_t axes[kAxisCount];
+	CHECK_EQ(2, FindNewlySilencedAxes(layout, before, after, axes));
+	CHECK_EQ(kAxisRx, axes[0]);
+	CHECK_EQ(kAxisRy, axes[1]);
+	CHECK_EQ(0, FindNewlySilencedAxes(layout, after, before, axes));
+	CHECK_EQ(0, FindNewlySilencedAxes(layout, after, after, axes));
+
+	// Remapping Z to read Rz silences Rz, whose events now go to Z, but not Z.
+	FilterConfig filter = MakePassThroughConfig();
+	filter.remapSource[kAxisZ] = kAxisRz;
+	FilterPlan remapped = MakePlan(layout, filter);
+	CHECK_EQ(1, FindNewlySilencedAxes(layout, before, remapped, axes));
+	CHECK_EQ(kAxisRz, axes[0]);
+
+	FormatLayout unknown;
+	SetDefaultFormatLayout(&unknown);
+	CHECK_EQ(0, FindNewlySilencedAxes(unknown, before, after, axes));
+}
+
+// --- Event renumbering ---
+static void TestSequenceEvents() {
+	EventSequence sequence;
+	ResetEventSequence(&sequence);
+
+	// Nothing dropped: the device's numbers pass through.
+	DiDeviceObjectData batch[4] = {
+		MakeEvent(0, 0, 100, 10),
+		MakeEvent(0, 0, 110, 11),
+	};
+	SequenceEvents(&sequence, batch, 0, 2, sizeof(DiDeviceObjectData), false, 500);
+	CHECK_EQ(10, batch[0].dwSequence);
+	CHECK_EQ(11, batch[1].dwSequence);
+	CHECK(!sequence.renumbering);
+	CHECK_EQ(12, sequence.nextSequence);
+
+	// Once something is dropped, numbering continues from the last record handed out.
+	batch[0] = MakeEvent(0, 0, 120, 15);
+	batch[1] = MakeEvent(0, 0, 130, 17);
+	SequenceEvents(&sequence, batch, 0, 2, sizeof(DiDeviceObjectData), true, 500);
+	CHECK_EQ(12, batch[0].dwSequence);
+	CHECK_EQ(13, batch[1].dwSequence);
+	CHECK(sequence.renumbering);
+
+	// And stays renumbered even for a batch with nothing dropped.
+	batch[0] = MakeEvent(0, 0, 140, 20);
+	SequenceEvents(&sequence, batch, 0, 1, sizeof(DiDeviceObjectData), false, 500);
+	CHECK_EQ(14, batch[0].dwSequence);
+
+	// Synthesized records go first, timed between the last record and the next device one.
+	WriteSynthesizedEvent(&batch[0], sizeof(DiDeviceObjectData), kDiJoyOfsRx, kDefaultNeutral);
+	WriteSynthesizedEvent(&batch[1], sizeof(DiDeviceObjectData), kDiJoyOfsRy, kDefaultNeutral);
+	batch[2] = MakeEvent(kDiJoyOfsX, 1, 170, 21);
+	SequenceEvents(&sequence, batch, 2, 3, sizeof(DiDeviceObjectData), false, 500);
+	CHECK_EQ(kDiJoyOfsRx, batch[0].dwOfs);
+	CHECK_EQ(150, batch[0].dwTimeStamp);
+	CHECK_EQ(160, batch[1].dwTimeStamp);
+	CHECK_EQ(170, batch[2].dwTimeStamp);
+	CHECK_EQ(15, batch[0].dwSequence);
+	CHECK_EQ(17, batch[2].dwSequence);
+
+	// With no device record to time against, they are spread up to now.
+	WriteSynthesizedEvent(&batch[0], sizeof(DiDeviceObjectData), kDiJoyOfsRx, 0);
+	SequenceEvents(&sequence, batch, 1, 1, sizeof(DiDeviceObjectData), false, 270);
+	CHECK_EQ(220, batch[0].dwTimeStamp);
+	CHECK_EQ(18, batch[0].dwSequence);
+
+	// A peek on a copy leaves the device's counter alone.
+	EventSequence preview = sequence;
+	batch[0] = MakeEvent(0, 0, 300, 30);
+	SequenceEvents(&preview, batch, 0, 1, sizeof(DiDeviceObjectData), true, 500);
+	CHECK_EQ(19, batch[0].dwSequence);
+	CHECK_EQ(19, sequence.nextSequence);
+
+	// The first batch of a fresh device continues from the device's numbering.
+	ResetEventSequence(&sequence);
+	DiDeviceObjectDataDx3 dx3[2] = {};
+	WriteSynthesizedEvent(&dx3[0], sizeof(DiDeviceObjectDataDx3), kDiJoyOfsRx, 0);
+	dx3[1].dwOfs = kDiJoyOfsX;
+	dx3[1].dwTimeStamp = 50;
+	dx3[1].dwSequence = 40;
+	SequenceEvents(&sequence, dx3, 1, 2, sizeof(DiDeviceObjectDataDx3), false, 500);
+	CHECK_EQ(39, dx3[0].dwSequence);
+	CHECK_EQ(40, dx3[1].dwSequence);
+	CHECK_EQ(50, dx3[0].dwTimeStamp);
+}
+
+// --- Buffered reads ---
+static void TestReadFilteredEvents() {
+	FilterPlan plan = MakePlan(MakeJoystickLayout(), kDefaultConfig.filter);
+	MockDevice device(sizeof(DiJoyState));
+	for (uint32_t i = 0; i < 6; ++i) {
+		device.PushEvent(i < 4 ? kDiJoyOfsRx : kDiJoyOfsX, i, 100 + i);
+	}
+	BufferedEventState events;
+	InitBufferedEventState(&events);
+	uint32_t owedOffset = kDiJoyOfsRy;
+	int32_t owedValue = kDefaultNeutral;
+	QueueNeutralEvents(&events, false, &owedOffset, &owedValue, 1);
+
+	unsigned reads = 0;
+	auto read = [&](uint8_t* pBatch, uint32_t* pCount) {
+		++reads;
+		return device.GetDeviceData(sizeof(DiDeviceObjectData), pBatch, pCount, 0);
+	};
+	DiDeviceObjectData buffer[3] = {};
+	uint32_t count = 3;
+	BufferedReadStats stats;
+	CHECK_EQ(kDiOk, ReadFilteredEvents(&events, plan, sizeof(DiDeviceObjectData), buffer, &count, false, 500, read, &stats));
+	// The owed event, then the two X events read after the dropped Rx ones were refilled.
+	CHECK_EQ(3, count);
+	CHECK_EQ(kDiJoyOfsRy, buffer[0].dwOfs);
+	CHECK_EQ(kDiJoyOfsX, buffer[1].dwOfs);
+	CHECK_EQ(kDiJoyOfsX, buffer[2].dwOfs);
+	CHECK_EQ(4, stats.eventsFiltered);
+	CHECK_EQ(2, stats.refills);
+	CHECK_EQ(3u, reads);
+	CHECK_EQ(buffer[0].dwSequence + 1, buffer[1].dwSequence);
+	CHECK_EQ(buffer[1].dwSequence + 1, buffer[2].dwSequence);
+	CHECK_EQ(0, events.neutralCount);
+	CHECK_EQ(0, device.GetPendingEventCount());
+
+	// A failed first read keeps the owed events for the next call.
+	QueueNeutralEvents(&events, false, &owedOffset, &owedValue, 1);
+	count = 3;
+	auto fail = [](uint8_t*, uint32_t* pCount) {
+		*pCount = 0;
+		return static_cast<int32_t>(0x8007001E);
+	};
+	CHECK(ReadFilteredEvents(&events, plan, sizeof(DiDeviceObjectData), buffer, &count, false, 500, fail, &stats) < 0);
+	CHECK_EQ(0, count);
+	CHECK_EQ(1, events.neutralCount);
+}
+
+// --- Captures ---
+static bool NextRecord(CaptureReader* pReader, CaptureRecordKind kind, uint16_t device, uint64_t timeUs, CaptureRecord* pRecord) {
+	return pReader->Next(pRecord) && pRecord->kind == kind && pRecord->device == device && pRecord->timeUs == timeUs;
+}
+
+static void TestCaptureRoundTrip() {
+	// What the DLL records from a device: its format and ranges, then polled state and
+	// buffered events.
+	MockDevice device(sizeof(DiJoyState));
+	DiJoyState frames[3] = {};
+	frames[0].lX = kDefaultNeutral;
+	frames[0].lRx = -5;
+	frames[0].rgbButtons[3] = 0x80;
+	frames[1] = frames[0];
+	frames[1].lX = 1;
+	frames[1].rgdwPOV[2] = 9000;
+	frames[2] = frames[1];
+	for (const DiJoyState& frame : frames) {
+		device.PushState(&frame);
+	}
+	device.PushEvent(kDiJoyOfsX, 1, 100);
+	device.PushEvent(kDiJoyOfsRx, 2, 101);
+	device.PushEvent(kDiJoyOfsY, 3, 102);
+
+	CaptureEncoder encoder;
+	DiDataFormat format = MakeFormat(sizeof(DiJoyState), kJoystickObjects, kJoystickObjectCount);
+	encoder.AddFormat(0, 1, &format);
+	DiAxisRange ranges[kAxisCount];
+	SetDefaultAxisRanges(ranges);
+	ranges[kAxisZ].lMin = -100;
+	ranges[kAxisZ].lMax = 100;
+	encoder.AddRanges(0, 2, ranges, kAxisCount);
+
+	size_t stateRecordSize[3];
+	for (uint32_t i = 0; i < 3; ++i) {
+		DiJoyState state;
+		int32_t hr = device.GetDeviceState(sizeof(state), &state);
+		size_t before = encoder.GetBuffer().size();
+		encoder.AddState(0, 10 + i, hr, sizeof(state), &state);
+		stateRecordSize[i] = encoder.GetBuffer().size() - before;
+	}
+	// After the first state, only the changed words are stored.
+	CHECK(stateRecordSize[0] > sizeof(DiJoyState));
+	CHECK(stateRecordSize[1] < stateRecordSize[0]);
+	CHECK(stateRecordSize[2] < stateRecordSize[1]);
+	encoder.AddState(0, 13, kDiErrInvalidParam, sizeof(DiJoyState), nullptr);
+
+	DiDeviceObjectData events[4];
+	uint32_t count = 4;
+	int32_t hr = device.GetDeviceData(sizeof(DiDeviceObjectData), events, &count, kDiGddPeek);
+	encoder.AddEvents(0, 20, hr, sizeof(DiDeviceObjectData), events, count, kDiGddPeek);
+	DiDeviceObjectDataDx3 dx3[4];
+	count = 4;
+	hr = device.GetDeviceData(sizeof(DiDeviceObjectDataDx3), dx3, &count, 0);
+	encoder.AddEvents(1, 21, hr, sizeof(DiDeviceObjectDataDx3), dx3, count, 0);
+
+	// A new format starts the device's delta encoding over.
+	encoder.AddFormat(0, 30, &format);
+	encoder.AddState(0, 31, kDiOk, sizeof(frames[2]), &frames[2]);
+
+	const std::vector<uint8_t>& capture = encoder.GetBuffer();
+	CaptureReader reader;
+	CHECK(!reader.Open(capture.data(), 6));
+	CHECK(reader.Open(capture.data(), capture.size()));
+	for (int pass = 0; pass < 2; ++pass) {
+		CaptureRecord record;
+		CHECK(NextRecord(&reader, kCaptureRecordFormat, 0, 1, &record));
+		CHECK_EQ(sizeof(DiJoyState), record.format.dwDataSize);
+		CHECK_EQ(kJoystickObjectCount, record.format.dwNumObjs);
+		for (uint32_t i = 0; i < kJoystickObjectCount && i < record.format.dwNumObjs; ++i) {
+			const DiObjectDataFormat& object = record.format.rgodf[i];
+			CHECK_EQ(kJoystickObjects[i].dwOfs, object.dwOfs);
+			CHECK_EQ(kJoystickObjects[i].dwType, object.dwType);
+			CHECK_EQ(kJoystickObjects[i].dwFlags, object.dwFlags);
+			CHECK(kJoystickObjects[i].pguid ? object.pguid && *object.pguid == *kJoystickObjects[i].pguid : !object.pguid);
+		}
+
+		CHECK(NextRecord(&reader, kCaptureRecordRanges, 0, 2, &record));
+		CHECK_EQ(kAxisCount, record.rangeCount);
+		CHECK(record.rangeCount == kAxisCount && memcmp(record.pRanges, ranges, sizeof(ranges)) == 0);
+
+		for (uint32_t i = 0; i < 3; ++i) {
+			CHECK(NextRecord(&reader, kCaptureRecordState, 0, 10 + i, &record));
+			CHECK_EQ(kDiOk, record.hr);
+			CHECK_EQ(sizeof(DiJoyState), record.cbData);
+			CHECK(record.pState && memcmp(record.pState, &frames[i], sizeof(DiJoyState)) == 0);
+		}
+		CHECK(NextRecord(&reader, kCaptureRecordState, 0, 13, &record));
+		CHECK_EQ(kDiErrInvalidParam, record.hr);
+		CHECK(!record.pState);
+
+		CHECK(NextRecord(&reader, kCaptureRecordEvents, 0, 20, &record));
+		CHECK_EQ(sizeof(DiDeviceObjectData), record.cbObjectData);
+		CHECK_EQ(kDiGddPeek, record.dwFlags);
+		CHECK_EQ(3, record.eventCount);
+		for (uint32_t i = 0; i < 3 && i < record.eventCount; ++i) {
+			CHECK_EQ(events[i].dwOfs, record.pEvents[i].dwOfs);
+			CHECK_EQ(events[i].dwData, record.pEvents[i].dwData);
+			CHECK_EQ(events[i].dwTimeStamp, record.pEvents[i].dwTimeStamp);
+			CHECK_EQ(events[i].dwSequence, record.pEvents[i].dwSequence);
+		}
+
+		// DX3 records are widened.
+		CHECK(NextRecord(&reader, kCaptureRecordEvents, 1, 21, &record));
+		CHECK_EQ(sizeof(DiDeviceObjectDataDx3), record.cbObjectData);
+		CHECK_EQ(3, record.eventCount);
+		for (uint32_t i = 0; i < 3 && i < record.eventCount; ++i) {
+			CHECK_EQ(dx3[i].dwOfs, record.pEvents[i].dwOfs);
+			CHECK_EQ(dx3[i].dwSequence, record.pEvents[i].dwSequence);
+			CHECK_EQ(0, record.pEvents[i].uAppData);
+		}
+
+		CHECK(NextRecord(&reader, kCaptureRecordFormat, 0, 30, &record));
+		CHECK(NextRecord(&reader, kCaptureRecordState, 0, 31, &record));
+		CHECK(record.pState && memcmp(record.pState, &frames[2], sizeof(DiJoyState)) == 0);
+		CHECK(!reader.Next(&record));
+		reader.Rewind();
+	}
+
+	// A truncated capture ends at the last whole record.
+	CHECK(reader.Open(capture.data(), capture.size() - 1));
+	CaptureRecord record;
+	uint32_t records = 0;
+	while (reader.Next(&record)) {
+		++records;
+	}
+	CHECK_EQ(9, records);
+}
+
+// --- Mock device ---
+static void TestMockDevice() {
+	MockDevice device(sizeof(DiJoyState));
+	DiJoyState state = {};
+	state.lX = 1;
+	device.PushState(&state);
+	state.lX = 2;
+	device.PushState(&state);
+	CHECK_EQ(2, device.GetFrameCount());
+
+	DiJoyState out;
+	CHECK_EQ(kDiErrInvalidParam, device.GetDeviceState(sizeof(DiJoyState2), &out));
+	CHECK_EQ(kDiOk, device.GetDeviceState(sizeof(out), &out));
+	CHECK_EQ(1, out.lX);
+	CHECK_EQ(kDiOk, device.GetDeviceState(sizeof(out), &out));
+	CHECK_EQ(2, out.lX);
+	// Frames loop.
+	CHECK_EQ(kDiOk, device.GetDeviceState(sizeof(out), &out));
+	CHECK_EQ(1, out.lX);
+
+	device.PushEvent(kDiJoyOfsX, 10, 100);
+	device.PushEvent(kDiJoyOfsY, 20, 101);
+	device.PushEvent(kDiJoyOfsZ, 30, 102);
+	DiDeviceObjectData events[4];
+	uint32_t count = 4;
+	CHECK_EQ(kDiErrInvalidParam, device.GetDeviceData(12, events, &count, 0));
+	count = 2;
+	CHECK_EQ(kDiOk, device.GetDeviceData(sizeof(DiDeviceObjectData), events, &count, kDiGddPeek));
+	CHECK_EQ(2, count);
+	CHECK_EQ(3, device.GetPendingEventCount());
+	count = 4;
+	CHECK_EQ(kDiOk, device.GetDeviceData(sizeof(DiDeviceObjectData), events, &count, 0));
+	CHECK_EQ(3, count);
+	CHECK_EQ(kDiJoyOfsZ, events[2].dwOfs);
+	CHECK_EQ(3, events[2].dwSequence);
+	CHECK_EQ(0, device.GetPendingEventCount());
+}
+
+// --- Config parsing ---
+static ProfileKey MakeProfileKey(const char* name, unsigned long timestamp) {
+	ProfileKey key = { HashProfileName(name, strlen(name)), timestamp };
+	return key;
+}
+
+static Config Parse(const std::string& text, const ProfileKey& process) {
+	Config config;
+	ParseConfig(text.data(), text.size(), process, &config);
+	return config;
+}
+
+static void TestParseConfigDefaults() {
+	Config config = Parse("", MakeProfileKey("game.exe", 0));
+	CHECK_EQ(kDefaultConfig.filter.suppressMask, config.filter.suppressMask);
+	CHECK_EQ(1, config.ruleCount);
+	CHECK(config.recoveryEnabled);
+	CHECK_EQ(0, config.profile[0]);
+
+	config = Parse(
+		"[logging]\n"
+		"enabled = yes\n"
+		"[filter]\n"
+		"suppress = none\n"
+		"remap.Z = RZ ; comment\n"
+		"remap.q = x\n"
+		"buffer_size = 999999\n"
+		"[devices]\n"
+		"pass = name:Xbox\n"
+		"wrap = vidpid:054C:0CE6\n"
+		"wrap = bogus\n"
+		"[recovery]\n"
+		"report = neutral\n",
+		MakeProfileKey("game.exe", 0));
+	CHECK(config.logEnabled);
+	CHECK_EQ(0, config.filter.suppressMask);
+	CHECK_EQ(kAxisRz, config.filter.remapSource[kAxisZ]);
+	CHECK_EQ(64 * 1024, config.filter.bufferSize);
+	CHECK_EQ(2, config.ruleCount);
+	CHECK_EQ(kDeviceMatchVidPid, config.rules[1].kind);
+	CHECK_EQ(0x054C, config.rules[1].vid);
+	CHECK_EQ(0x0CE6, config.rules[1].pid);
+	CHECK(config.recoveryReportsNeutral);
+
+	DeviceIdentity pad = { false, true, 0x054C, 0x0CE6, "Wireless Controller" };
+	CHECK(ShouldWrapDevice(config, pad));
+	DeviceIdentity xbox = { true, true, 0x054C, 0x0CE6, "XBOX Controller" };
+	CHECK(!ShouldWrapDevice(config, xbox));
+}
+
+static void TestParseConfigDeadzone() {
+	Config config = Parse(
+		"[filter]\n"
+		"deadzone.x = 2000\n"
+		"deadzone.y = 20000\n"
+		"deadzone.z = -5\n"
+		"deadzone.rz = 1\n",
+		MakeProfileKey("game.exe", 0));
+	// Hundredths of a percent, clamped to 0..10000 like DIPROP_DEADZONE.
+	CHECK_EQ(2000, config.filter.deadzone[kAxisX]);
+	CHECK_EQ(10000, config.filter.deadzone[kAxisY]);
+	CHECK_EQ(0, config.filter.deadzone[kAxisZ]);
+	CHECK_EQ(1, config.filter.deadzone[kAxisRz]);
+
+	FilterPlan plan = MakePlan(MakeJoystickLayout(), config.filter);
+	for (uint32_t i = 0; i < plan.transformCount; ++i) {
+		if (plan.transforms[i].dstOffset == kDiJoyOfsX) {
+			CHECK_EQ(6553, plan.transforms[i].deadzone);
+		}
+		if (plan.transforms[i].dstOffset == kDiJoyOfsRz) {
+			CHECK_EQ(3, plan.transforms[i].deadzone);
+		}
+	}
+}
+
+static void TestParseConfigProfiles() {
+	// The build-specific profile comes first in the file but is applied last.
+	const std::string text =
+		"[profile:GAME.EXE@5F3A2B1C]\n"
+		"suppress = z\n"
+		"[filter]\n"
+		"suppress = x\n"
+		"deadzone.x = 100\n"
+		"[profile:game.exe]\n"
+		"suppress = y\n"
+		"deadzone.x = 200\n"
+		"pass = all\n"
+		"[profile:other.exe]\n"
+		"suppress = slider1\n"
+		"[filter]\n"
+		"remap.z = rz\n";
+
+	Config config = Parse(text, MakeProfileKey("Game.exe", 0x5F3A2B1C));
+	CHECK_EQ(1u << kAxisZ, config.filter.suppressMask);
+	CHECK_EQ(200, config.filter.deadzone[kAxisX]);
+	CHECK_EQ(kAxisRz, config.filter.remapSource[kAxisZ]);
+	CHECK(strcmp(config.profile, "game.exe@5f3a2b1c") == 0);
+	// A profile's wrap/pass replace the [devices] rules.
+	CHECK_EQ(1, config.ruleCount);
+	CHECK(!config.rules[0].wrap);
+	CHECK_EQ(kDeviceMatchAll, config.rules[0].kind);
+
+	// Another build of the same game only gets the name profile.
+	config = Parse(text, MakeProfileKey("game.exe", 0x12345678));
+	CHECK_EQ(1u << kAxisY, config.filter.suppressMask);
+	CHECK(strcmp(config.profile, "game.exe") == 0);
+
+	// Another game gets neither.
+	config = Parse(text, MakeProfileKey("ys8.exe", 0x5F3A2B1C));
+	CHECK_EQ(1u << kAxisX, config.filter.suppressMask);
+	CHECK_EQ(100, config.filter.deadzone[kAxisX]);
+	CHECK_EQ(0, config.profile[0]);
+	CHECK_EQ(1, config.ruleCount);
+	CHECK(config.rules[0].wrap);
+}
+
+int main() {
+	TestValidateDataFormat();
+	TestBuildFormatLayout();
+	TestBuildFilterPlanSuppress();
+	TestBuildFilterPlanRemap();
+	TestBuildFilterPlanDeadzone();
+	TestCompactEvents();
+	TestCompactActionEvents();
+	TestWriteNeutralState();
+	TestFindNewlySilencedAxes();
+	TestSequenceEvents();
+	TestReadFilteredEvents();
+	TestCaptureRoundTrip();
+	TestMockDevice();
+	TestParseConfigDefaults();
+	TestParseConfigDeadzone();
+	TestParseConfigProfiles();
+
+	if (g_failures > 0) {
+		fprintf(stderr, "%d check(s) failed.\n", g_failures);
+		return 1;
+	}
+	printf("All core tests passed.\n");
+	return 0;
+}
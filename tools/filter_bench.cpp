@@ -0,0 +1,260 @@
+// filter_bench.cpp
+//
+// Measures what the wrapper adds to GetDeviceState and GetDeviceData over calling the device
+// directly. The filtered cases run the code the DLL runs (core/) against a MockDevice returning
+// canned state: GetDeviceState applies the plan through the function pointer the wrapper
+// dispatches through, and GetDeviceData goes through ReadFilteredEvents, with its lock,
+// refill reads and renumbering.
+//
+// Results are written as JSON in the layout Google Benchmark uses, so its compare.py and
+// other tooling for that format can diff two runs.
+//
+// Usage: dinput8_filter_bench [--out=results.json] [--min-time=0.2]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "buffered_events.h"
+#include "config_parse.h"
+#include "dinput_types.h"
+#include "filter.h"
+#include "mock_device.h"
+#include "state_policies.h"
+
+// --- Harness ---
+// Sink for results, so the compiler cannot drop the work being timed.
+static volatile uint32_t g_sink;
+
+struct BenchResult {
+	std::string name;
+	uint64_t iterations;
+	double nsPerOp;
+	double cpuNsPerOp;
+};
+
+static double g_minTimeSeconds = 0.2;
+
+// Runs body(iterations) in growing batches until one batch takes at least g_minTimeSeconds.
+template <class Body>
+static BenchResult RunBench(const std::string& name, Body body) {
+	typedef std::chrono::steady_clock Clock;
+	uint64_t iterations = 1;
+	for (;;) {
+		Clock::time_point start = Clock::now();
+		clock_t cpuStart = clock();
+		body(iterations);
+		double cpuSeconds = static_cast<double>(clock() - cpuStart) / CLOCKS_PER_SEC;
+		double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		if (seconds >= g_minTimeSeconds || iterations >= (1ull << 40)) {
+			double count = static_cast<double>(iterations);
+			BenchResult result = { name, iterations, seconds * 1e9 / count, cpuSeconds * 1e9 / count };
+			fprintf(stderr, "%-40s %12.2f ns %14llu iterations\n", name.c_str(), result.nsPerOp, static_cast<unsigned long long>(iterations));
+			return result;
+		}
+		// Aim a little past the target so the next batch is usually the last.
+		double scale = seconds > 0 ? g_minTimeSeconds * 1.4 / seconds : 10.0;
+		if (scale > 10.0) scale = 10.0;
+		if (scale < 2.0) scale = 2.0;
+		iterations = static_cast<uint64_t>(static_cast<double>(iterations) * scale);
+	}
+}
+
+// --- Device setup ---
+// Axis objects of c_dfDIJoystick / c_dfDIJoystick2 that the filter looks at.
+static const DiObjectDataFormat kJoystickAxes[] = {
+	{ &kDiGuidXAxis, kDiJoyOfsX, kDiDftAxis, kDiDoiAspectPosition },
+	{ &kDiGuidYAxis, kDiJoyOfsY, kDiDftAxis, kDiDoiAspectPosition },
+	{ &kDiGuidZAxis, kDiJoyOfsZ, kDiDftAxis, kDiDoiAspectPosition },
+	{ &kDiGuidRxAxis, kDiJoyOfsRx, kDiDftAxis, kDiDoiAspectPosition },
+	{ &kDiGuidRyAxis, kDiJoyOfsRy, kDiDftAxis, kDiDoiAspectPosition },
+	{ &kDiGuidRzAxis, kDiJoyOfsRz, kDiDftAxis, kDiDoiAspectPosition },
+	{ &kDiGuidSlider, kDiJoyOfsSlider0, kDiDftAxis, kDiDoiAspectPosition },
+	{ &kDiGuidSlider, kDiJoyOfsSlider1, kDiDftAxis, kDiDoiAspectPosition },
+};
+
+// pRanges null means every axis at DirectInput's default range.
+static FilterPlan MakePlan(uint32_t dataSize, const FilterConfig& filter, const DiAxisRange* pRanges = nullptr) {
+	DiDataFormat format = { sizeof(DiDataFormat), sizeof(DiObjectDataFormat), 0, dataSize, 8, kJoystickAxes };
+	FormatLayout layout;
+	BuildFormatLayout(&format, &layout);
+	DiAxisRange ranges[kAxisCount];
+	SetDefaultAxisRanges(ranges);
+	if (pRanges) {
+		std::copy(pRanges, pRanges + kAxisCount, ranges);
+	}
+	FilterPlan plan;
+	BuildFilterPlan(layout, ranges, filter, &plan);
+	return plan;
+}
+
+// A few frames of stick noise, so the state copy is not always the same cache line contents.
+static void FillStates(MockDevice* pDevice, uint32_t dataSize) {
+	std::vector<uint8_t> frame(dataSize);
+	for (int i = 0; i < 16; ++i) {
+		DiJoyState* pState = reinterpret_cast<DiJoyState*>(frame.data());
+		pState->lX = 32767 + i * 97;
+		pState->lY = 32767 - i * 89;
+		pState->lRx = 1000 * i;
+		pState->lRy = 2000 * i;
+		pDevice->PushState(frame.data());
+	}
+}
+
+// --- GetDeviceState ---
+static BenchResult BenchStateDirect(const std::string& name, uint32_t dataSize) {
+	MockDevice device(dataSize);
+	FillStates(&device, dataSize);
+	std::vector<uint8_t> buffer(dataSize);
+	return RunBench(name, [&](uint64_t iterations) {
+		for (uint64_t i = 0; i < iterations; ++i) {
+			device.GetDeviceState(dataSize, buffer.data());
+			g_sink = buffer[kDiJoyOfsRx];
+		}
+	});
+}
+
+static BenchResult BenchStateFiltered(const std::string& name, uint32_t dataSize, const FilterConfig& filter, const DiAxisRange* pRanges = nullptr) {
+	MockDevice device(dataSize);
+	FillStates(&device, dataSize);
+	std::vector<uint8_t> buffer(dataSize);
+	FilterPlan plan = MakePlan(dataSize, filter, pRanges);
+	// Loaded through a volatile, like the wrapper's published filter, so the call stays indirect.
+	StateApplyFn volatile pfnApply = GetStateApplyFn(plan.stateKind);
+	return RunBench(name, [&](uint64_t iterations) {
+		for (uint64_t i = 0; i < iterations; ++i) {
+			if (device.GetDeviceState(dataSize, buffer.data()) >= 0) {
+				pfnApply(plan, dataSize, buffer.data());
+			}
+			g_sink = buffer[kDiJoyOfsRx];
+		}
+	});
+}
+
+// --- GetDeviceData ---
+static void QueueEvents(MockDevice* pDevice, uint32_t count) {
+	static const uint32_t kOffsets[] = { kDiJoyOfsX, kDiJoyOfsY, kDiJoyOfsRx, kDiJoyOfsRy };
+	for (uint32_t i = 0; i < count; ++i) {
+		pDevice->PushEvent(kOffsets[i & 3], 32767 + i, i);
+	}
+}
+
+// Every variant refills the mock's queue each iteration, so the differences between them are
+// the wrapper's own cost. pPlan null reads the device directly; otherwise the read goes
+// through ReadFilteredEvents, which refills the space dropped events leave.
+static BenchResult BenchEvents(const std::string& name, uint32_t count, const FilterPlan* pPlan) {
+	MockDevice device(sizeof(DiJoyState));
+	BufferedEventState events;
+	InitBufferedEventState(&events);
+	std::vector<DiDeviceObjectData> buffer(count);
+	auto read = [&](uint8_t* pBatch, uint32_t* pCount) {
+		return device.GetDeviceData(sizeof(DiDeviceObjectData), pBatch, pCount, 0);
+	};
+	return RunBench(name, [&](uint64_t iterations) {
+		for (uint64_t i = 0; i < iterations; ++i) {
+			QueueEvents(&device, count);
+			uint32_t inOut = count;
+			if (pPlan) {
+				BufferedReadStats stats;
+				ReadFilteredEvents(&events, *pPlan, sizeof(DiDeviceObjectData), buffer.data(), &inOut, false, static_cast<uint32_t>(i), read, &stats);
+			}
+			else {
+				device.GetDeviceData(sizeof(DiDeviceObjectData), buffer.data(), &inOut, 0);
+			}
+			g_sink = inOut;
+		}
+	});
+}
+
+// --- Output ---
+static void WriteJson(FILE* pFile, const std::vector<BenchResult>& results) {
+	char date[64];
+	time_t now = time(nullptr);
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+	fprintf(pFile, "{\n  \"context\": {\n");
+	fprintf(pFile, "    \"date\": \"%s\",\n", date);
+	fprintf(pFile, "    \"executable\": \"dinput8_filter_bench\",\n");
+#ifdef NDEBUG
+	fprintf(pFile, "    \"library_build_type\": \"release\"\n");
+#else
+	fprintf(pFile, "    \"library_build_type\": \"debug\"\n");
+#endif
+	fprintf(pFile, "  },\n  \"benchmarks\": [\n");
+	for (size_t i = 0; i < results.size(); ++i) {
+		const BenchResult& r = results[i];
+		fprintf(pFile, "    {\n");
+		fprintf(pFile, "      \"name\": \"%s\",\n", r.name.c_str());
+		fprintf(pFile, "      \"run_name\": \"%s\",\n", r.name.c_str());
+		fprintf(pFile, "      \"run_type\": \"iteration\",\n");
+		fprintf(pFile, "      \"iterations\": %llu,\n", static_cast<unsigned long long>(r.iterations));
+		fprintf(pFile, "      \"real_time\": %.4f,\n", r.nsPerOp);
+		fprintf(pFile, "      \"cpu_time\": %.4f,\n", r.cpuNsPerOp);
+		fprintf(pFile, "      \"time_unit\": \"ns\"\n");
+		fprintf(pFile, "    }%s\n", i + 1 < results.size() ? "," : "");
+	}
+	fprintf(pFile, "  ]\n}\n");
+}
+
+int main(int argc, char** argv) {
+	const char* pOutPath = nullptr;
+	for (int i = 1; i < argc; ++i) {
+		if (strncmp(argv[i], "--out=", 6) == 0) {
+			pOutPath = argv[i] + 6;
+		}
+		else if (strncmp(argv[i], "--min-time=", 11) == 0) {
+			g_minTimeSeconds = atof(argv[i] + 11);
+		}
+		else {
+			fprintf(stderr, "Usage: %s [--out=results.json] [--min-time=seconds]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	FilterConfig none = kDefaultConfig.filter;
+	none.suppressMask = 0;
+	FilterConfig rxRy = kDefaultConfig.filter;
+	FilterConfig general = kDefaultConfig.filter;
+	general.remapSource[kAxisZ] = kAxisRz;
+	general.deadzone[kAxisX] = 2000;
+	general.deadzone[kAxisY] = 2000;
+	// The game set Z to -1000..1000, so remapped Rz values are rescaled.
+	DiAxisRange rescaled[kAxisCount];
+	SetDefaultAxisRanges(rescaled);
+	rescaled[kAxisZ].lMin = -1000;
+	rescaled[kAxisZ].lMax = 1000;
+
+	std::vector<BenchResult> results;
+	results.push_back(BenchStateDirect("GetDeviceState/direct/DIJOYSTATE", sizeof(DiJoyState)));
+	results.push_back(BenchStateFiltered("GetDeviceState/passthrough/DIJOYSTATE", sizeof(DiJoyState), none));
+	results.push_back(BenchStateFiltered("GetDeviceState/rxry/DIJOYSTATE", sizeof(DiJoyState), rxRy));
+	results.push_back(BenchStateFiltered("GetDeviceState/general/DIJOYSTATE", sizeof(DiJoyState), general));
+	results.push_back(BenchStateFiltered("GetDeviceState/rescaled/DIJOYSTATE", sizeof(DiJoyState), general, rescaled));
+	results.push_back(BenchStateDirect("GetDeviceState/direct/DIJOYSTATE2", sizeof(DiJoyState2)));
+	results.push_back(BenchStateFiltered("GetDeviceState/rxry/DIJOYSTATE2", sizeof(DiJoyState2), rxRy));
+
+	FilterPlan nonePlan = MakePlan(sizeof(DiJoyState), none);
+	FilterPlan rxRyPlan = MakePlan(sizeof(DiJoyState), rxRy);
+	const uint32_t kBatchSizes[] = { 1, 16, 64, 256 };
+	for (uint32_t count : kBatchSizes) {
+		results.push_back(BenchEvents("GetDeviceData/direct/" + std::to_string(count), count, nullptr));
+		results.push_back(BenchEvents("GetDeviceData/passthrough/" + std::to_string(count), count, &nonePlan));
+		results.push_back(BenchEvents("GetDeviceData/rxry/" + std::to_string(count), count, &rxRyPlan));
+	}
+
+	FILE* pFile = pOutPath ? fopen(pOutPath, "w") : stdout;
+	if (!pFile) {
+		fprintf(stderr, "Cannot write %s\n", pOutPath);
+		return 1;
+	}
+	WriteJson(pFile, results);
+	if (pFile != stdout) {
+		fclose(pFile);
+	}
+	return 0;
+}
@@ -0,0 +1,259 @@
+// filter_replay.cpp
+//
+// Pushes a capture recorded by the DLL's capture mode (core/capture_format.h) through the
+// filter pipeline as fast as it will go. The capture is decoded up front, so the timed part
+// is only the filtering: plan-selected GetDeviceState policies and GetDeviceData event
+// compaction and renumbering, per device, with the plans rebuilt at every recorded
+// SetDataFormat and axis range change.
+//
+// The output includes a checksum of everything the filter produced, so two builds can be
+// checked for identical behaviour on the same capture as well as compared for speed.
+//
+// Usage: dinput8_filter_replay capture.di8r [--config=dinput8-wrapper.ini] [--exe=game.exe]
+//                              [--exe-timestamp=5F3A2B1C] [--repeat=N]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "capture_format.h"
+#include "config_parse.h"
+#include "dinput_types.h"
+#include "event_sequence.h"
+#include "filter.h"
+#include "state_policies.h"
+
+// One recorded call, decoded.
+struct ReplayItem {
+	CaptureRecordKind kind;
+	uint16_t device;
+	// kCaptureRecordFormat.
+	FormatLayout layout;
+	// kCaptureRecordState: the raw state. kCaptureRecordEvents: the raw records.
+	uint32_t cbData;
+	std::vector<uint8_t> state;
+	std::vector<DiDeviceObjectData> events;
+	// kCaptureRecordRanges.
+	std::vector<DiAxisRange> ranges;
+};
+
+struct ReplayDevice {
+	FormatLayout layout;
+	DiAxisRange ranges[kAxisCount];
+	FilterPlan plan;
+	EventSequence sequence;
+};
+
+static bool ReadWholeFile(const char* pPath, std::vector<uint8_t>* pData) {
+	FILE* pFile = fopen(pPath, "rb");
+	if (!pFile) {
+		return false;
+	}
+	uint8_t chunk[64 * 1024];
+	size_t read;
+	while ((read = fread(chunk, 1, sizeof(chunk), pFile)) > 0) {
+		pData->insert(pData->end(), chunk, chunk + read);
+	}
+	fclose(pFile);
+	return true;
+}
+
+static bool DecodeCapture(const std::vector<uint8_t>& data, std::vector<ReplayItem>* pItems) {
+	CaptureReader reader;
+	if (!reader.Open(data.data(), data.size())) {
+		return false;
+	}
+	CaptureRecord record;
+	while (reader.Next(&record)) {
+		ReplayItem item;
+		item.kind = record.kind;
+		item.device = record.device;
+		item.cbData = 0;
+		if (record.kind == kCaptureRecordFormat) {
+			BuildFormatLayout(&record.format, &item.layout);
+		}
+		else if (record.kind == kCaptureRecordState && record.pState) {
+			item.cbData = record.cbData;
+			item.state.assign(record.pState, record.pState + record.cbData);
+		}
+		else if (record.kind == kCaptureRecordEvents && record.eventCount > 0) {
+			item.events.assign(record.pEvents, record.pEvents + record.eventCount);
+		}
+		else if (record.kind == kCaptureRecordRanges) {
+			item.ranges.assign(record.pRanges, record.pRanges + record.rangeCount);
+		}
+		else {
+			continue;
+		}
+		pItems->push_back(std::move(item));
+	}
+	return true;
+}
+
+static inline uint64_t HashBytes(uint64_t hash, const void* pData, size_t size) {
+	const uint8_t* pBytes = static_cast<const uint8_t*>(pData);
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= pBytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// Prints pText as a JSON string literal. Paths and profile names come from the user, so
+// backslashes, quotes and control characters are escaped; other bytes pass through as UTF-8.
+static void PrintJsonString(const char* pText) {
+	putchar('"');
+	for (const unsigned char* p = reinterpret_cast<const unsigned char*>(pText); *p; ++p) {
+		switch (*p) {
+		case '"': fputs("\\\"", stdout); break;
+		case '\\': fputs("\\\\", stdout); break;
+		case '\b': fputs("\\b", stdout); break;
+		case '\f': fputs("\\f", stdout); break;
+		case '\n': fputs("\\n", stdout); break;
+		case '\r': fputs("\\r", stdout); break;
+		case '\t': fputs("\\t", stdout); break;
+		default:
+			if (*p < 0x20) {
+				printf("\\u%04x", *p);
+			}
+			else {
+				putchar(*p);
+			}
+			break;
+		}
+	}
+	putchar('"');
+}
+
+int main(int argc, char** argv) {
+	const char* pCapturePath = nullptr;
+	const char* pConfigPath = nullptr;
+	std::string exeName;
+	unsigned long exeTimestamp = 0;
+	unsigned repeat = 1;
+	for (int i = 1; i < argc; ++i) {
+		if (strncmp(argv[i], "--config=", 9) == 0) {
+			pConfigPath = argv[i] + 9;
+		}
+		else if (strncmp(argv[i], "--exe=", 6) == 0) {
+			exeName = argv[i] + 6;
+		}
+		else if (strncmp(argv[i], "--exe-timestamp=", 16) == 0) {
+			exeTimestamp = strtoul(argv[i] + 16, nullptr, 16);
+		}
+		else if (strncmp(argv[i], "--repeat=", 9) == 0) {
+			repeat = static_cast<unsigned>(strtoul(argv[i] + 9, nullptr, 10));
+		}
+		else if (argv[i][0] != '-' && !pCapturePath) {
+			pCapturePath = argv[i];
+		}
+		else {
+			pCapturePath = nullptr;
+			break;
+		}
+	}
+	if (!pCapturePath || repeat == 0) {
+		fprintf(stderr, "Usage: %s capture.di8r [--config=file.ini] [--exe=game.exe] [--exe-timestamp=hex] [--repeat=N]\n", argv[0]);
+		return 2;
+	}
+
+	Config config;
+	ProfileKey process = { HashProfileName(exeName.c_str(), exeName.size()), exeTimestamp };
+	if (pConfigPath) {
+		std::vector<uint8_t> text;
+		if (!ReadWholeFile(pConfigPath, &text)) {
+			fprintf(stderr, "Cannot read %s\n", pConfigPath);
+			return 1;
+		}
+		ParseConfig(reinterpret_cast<const char*>(text.data()), text.size(), process, &config);
+	}
+	else {
+		SetConfigDefaults(&config);
+	}
+
+	std::vector<uint8_t> data;
+	std::vector<ReplayItem> items;
+	if (!ReadWholeFile(pCapturePath, &data) || !DecodeCapture(data, &items)) {
+		fprintf(stderr, "Cannot read capture %s\n", pCapturePath);
+		return 1;
+	}
+
+	uint64_t stateCalls = 0;
+	uint64_t eventsIn = 0;
+	uint64_t eventsOut = 0;
+	uint64_t checksum = 14695981039346656037ull;
+	std::vector<uint8_t> stateBuffer;
+	std::vector<DiDeviceObjectData> eventBuffer;
+
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point start = Clock::now();
+	for (unsigned pass = 0; pass < repeat; ++pass) {
+		// Every pass starts from devices nobody has called SetDataFormat on, as in the game.
+		std::vector<ReplayDevice> devices;
+		for (const ReplayItem& item : items) {
+			if (item.device >= devices.size()) {
+				size_t first = devices.size();
+				devices.resize(item.device + 1);
+				for (size_t d = first; d < devices.size(); ++d) {
+					SetDefaultFormatLayout(&devices[d].layout);
+					SetDefaultAxisRanges(devices[d].ranges);
+					BuildFilterPlan(devices[d].layout, devices[d].ranges, config.filter, &devices[d].plan);
+					ResetEventSequence(&devices[d].sequence);
+				}
+			}
+			ReplayDevice& device = devices[item.device];
+
+			switch (item.kind) {
+			case kCaptureRecordFormat:
+				device.layout = item.layout;
+				BuildFilterPlan(device.layout, device.ranges, config.filter, &device.plan);
+				break;
+			case kCaptureRecordRanges:
+				for (size_t axis = 0; axis < item.ranges.size() && axis < kAxisCount; ++axis) {
+					device.ranges[axis] = item.ranges[axis];
+				}
+				BuildFilterPlan(device.layout, device.ranges, config.filter, &device.plan);
+				break;
+			case kCaptureRecordState:
+				stateBuffer.assign(item.state.begin(), item.state.end());
+				ApplyStatePolicy(device.plan, item.cbData, stateBuffer.data());
+				checksum = HashBytes(checksum, stateBuffer.data(), stateBuffer.size());
+				++stateCalls;
+				break;
+			case kCaptureRecordEvents: {
+				eventBuffer.assign(item.events.begin(), item.events.end());
+				uint32_t count = static_cast<uint32_t>(eventBuffer.size());
+				if (device.plan.eventRuleCount > 0) {
+					count = CompactEvents(device.plan, eventBuffer.data(), count, sizeof(DiDeviceObjectData));
+				}
+				SequenceEvents(&device.sequence, eventBuffer.data(), 0, count, sizeof(DiDeviceObjectData), count != eventBuffer.size(), 0);
+				checksum = HashBytes(checksum, eventBuffer.data(), count * sizeof(DiDeviceObjectData));
+				eventsIn += item.events.size();
+				eventsOut += count;
+				break;
+			}
+			}
+		}
+	}
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	printf("{\n");
+	printf("  \"capture\": ");
+	PrintJsonString(pCapturePath);
+	printf(",\n  \"profile\": ");
+	PrintJsonString(config.profile);
+	printf(",\n");
+	printf("  \"repeat\": %u,\n", repeat);
+	printf("  \"records\": %llu,\n", static_cast<unsigned long long>(items.size()));
+	printf("  \"state_calls\": %llu,\n", static_cast<unsigned long long>(stateCalls));
+	printf("  \"events_in\": %llu,\n", static_cast<unsigned long long>(eventsIn));
+	printf("  \"events_out\": %llu,\n", static_cast<unsigned long long>(eventsOut));
+	printf("  \"seconds\": %.6f,\n", seconds);
+	printf("  \"ns_per_record\": %.2f,\n", items.empty() ? 0.0 : seconds * 1e9 / (static_cast<double>(items.size()) * repeat));
+	printf("  \"checksum\": \"%016llx\"\n", static_cast<unsigned long long>(checksum));
+	printf("}\n");
+	return 0;
+}